@@ -1,14 +1,14 @@
 #include "app_config.h"
 #include "esp_mac.h"
 #include "sdkconfig.h"
-#include <stdio.h>
+#include "telemetry.h"
 
 float temp_threshold = 30.0f; // Default High Threshold
 float hum_threshold = 80.0f;  // Default High Threshold
 uint32_t mqtt_send_interval_ms = 60000; // Default 60 seconds
 
-char mqtt_pub_topic[128] = {0};
-char mqtt_sub_topic[128] = {0};
+char mqtt_pub_topic[TELEMETRY_TOPIC_MAX] = {0};
+char mqtt_sub_topic[TELEMETRY_TOPIC_MAX] = {0};
 
 void app_config_init(void)
 {
@@ -16,15 +16,12 @@ void app_config_init(void)
     esp_read_mac(mac, ESP_MAC_WIFI_STA);
 
 #ifndef CONFIG_MQTT_PUB_TOPIC
-#define CONFIG_MQTT_PUB_TOPIC "cold_storage/data"
+#define CONFIG_MQTT_PUB_TOPIC TELEMETRY_DEFAULT_PUB_TOPIC
 #endif
 #ifndef CONFIG_MQTT_SUB_TOPIC
-#define CONFIG_MQTT_SUB_TOPIC "cold_storage/commands"
+#define CONFIG_MQTT_SUB_TOPIC TELEMETRY_DEFAULT_SUB_TOPIC
 #endif
 
-    // Format: MAC_ADDRESS/TOPIC
-    snprintf(mqtt_pub_topic, sizeof(mqtt_pub_topic), "%02X%02X%02X%02X%02X%02X/%s",
-             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], CONFIG_MQTT_PUB_TOPIC);
-    snprintf(mqtt_sub_topic, sizeof(mqtt_sub_topic), "%02X%02X%02X%02X%02X%02X/%s",
-             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], CONFIG_MQTT_SUB_TOPIC);
+    telemetry_format_topic(mqtt_pub_topic, sizeof(mqtt_pub_topic), mac, CONFIG_MQTT_PUB_TOPIC);
+    telemetry_format_topic(mqtt_sub_topic, sizeof(mqtt_sub_topic), mac, CONFIG_MQTT_SUB_TOPIC);
 }
\ No newline at end of file
@@ -262,12 +262,24 @@ esp_err_t gsm_module_init()
     // Check if modem is responding to AT commands
     ESP_LOGI(TAG, "Checking modem response...");
     bool modem_ready = false;
+#ifdef CONFIG_SIM7670_NEGOTIATE_BAUD
+    const int baud_rates[] = {3000000, 921600, 460800};
+    int baud = CONFIG_SIM7670_BAUD_RATE;
+#endif
     for (int i = 0; i < 20; i++)
     {
+#ifdef CONFIG_SIM7670_NEGOTIATE_BAUD
+        // Also finds the modem at a previously negotiated (stored) rate
+        esp_err_t err = esp_modem_negotiate_baud(dce, baud_rates, sizeof(baud_rates) / sizeof(baud_rates[0]), true, &baud);
+#else
         esp_err_t err = esp_modem_sync(dce);
+#endif
         if (err == ESP_OK)
         {
             ESP_LOGI(TAG, "Modem responded to AT command");
+#ifdef CONFIG_SIM7670_NEGOTIATE_BAUD
+            ESP_LOGI(TAG, "UART baud rate: %d", baud);
+#endif
             modem_ready = true;
             break;
         }
@@ -362,11 +374,11 @@ void gsm_module_process_data(float *temp_threshold, float *hum_threshold)
 
         // Retry SMS configuration to ensure modem is in Text Mode
         // If this fails, AT+CMGL="ALL" will likely fail or return PDU garbage
+        // The three commands are sent on one command line (single round trip), 1000 ms for each of them
+        static const char *const sms_config[] = {"AT+CMGF=1", "AT+CPMS=\"SM\",\"SM\",\"SM\"", "AT+CNMI=2,1"};
         for (int i = 0; i < 3; i++)
         {
-            if (esp_modem_at(dce, "AT+CMGF=1", NULL, 1000) == ESP_OK &&
-                esp_modem_at(dce, "AT+CPMS=\"SM\",\"SM\",\"SM\"", NULL, 1000) == ESP_OK &&
-                esp_modem_at(dce, "AT+CNMI=2,1", NULL, 1000) == ESP_OK)
+            if (esp_modem_at_batch(dce, sms_config, sizeof(sms_config) / sizeof(sms_config[0]), NULL, 1000) == ESP_OK)
             {
                 break;
             }
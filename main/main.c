@@ -8,6 +8,7 @@
 #include "network.h"
 #include "gsm_module.h"
 #include "app_config.h"
+#include "telemetry.h"
 
 static const char *TAG = "MAIN";
 
@@ -85,8 +86,8 @@ void app_main(void)
         {
             ESP_LOGW(TAG, "Threshold Exceeded! Sending Notifications...");
 
-            char msg[64];
-            snprintf(msg, sizeof(msg), "ALERT: Temp %.2f C, Hum %.2f %%", readings.dht_temp, readings.dht_humidity);
+            char msg[TELEMETRY_ALERT_MAX];
+            telemetry_format_alert(msg, sizeof(msg), &readings);
 
 #ifdef CONFIG_CONNECTION_TYPE_GSM
             gsm_module_mqtt_publish(msg);
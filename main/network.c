@@ -5,6 +5,7 @@
 #include "mqtt_client.h"
 #include "sdkconfig.h"
 #include "app_config.h"
+#include "telemetry.h"
 #ifdef CONFIG_CONNECTION_TYPE_WIFI
 #include <wifi_provisioning/manager.h>
 #include <wifi_provisioning/scheme_softap.h>
@@ -162,10 +163,8 @@ void network_send_data(const sensor_readings_t *readings)
         return;
     }
 
-    char payload[128];
-    snprintf(payload, sizeof(payload),
-             "{\"dht_temp\": %.2f, \"dht_hum\": %.2f, \"ds_temp\": %.2f}",
-             readings->dht_temp, readings->dht_humidity, readings->ds_temp);
+    char payload[TELEMETRY_PAYLOAD_MAX];
+    telemetry_format_payload(payload, sizeof(payload), readings);
 
     int msg_id = esp_mqtt_client_publish(mqtt_client, mqtt_pub_topic, payload, 0, 1, 0);
     ESP_LOGI(TAG, "MQTT Sent: %s, ID: %d", payload, msg_id);
@@ -0,0 +1,21 @@
+#include "telemetry.h"
+#include <stdio.h>
+
+int telemetry_format_topic(char *out, size_t out_len, const uint8_t mac[6], const char *suffix)
+{
+    // Format: MAC_ADDRESS/TOPIC
+    return snprintf(out, out_len, "%02X%02X%02X%02X%02X%02X/%s",
+                    mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], suffix);
+}
+
+int telemetry_format_payload(char *out, size_t out_len, const sensor_readings_t *readings)
+{
+    return snprintf(out, out_len,
+                    "{\"dht_temp\": %.2f, \"dht_hum\": %.2f, \"ds_temp\": %.2f}",
+                    readings->dht_temp, readings->dht_humidity, readings->ds_temp);
+}
+
+int telemetry_format_alert(char *out, size_t out_len, const sensor_readings_t *readings)
+{
+    return snprintf(out, out_len, "ALERT: Temp %.2f C, Hum %.2f %%", readings->dht_temp, readings->dht_humidity);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file telemetry.h
+ * @brief MQTT topic and payload formatting shared by the firmware and host tools
+ *
+ * This module has no ESP-IDF dependencies, so the same code that builds the
+ * device traffic can be compiled for Linux (see tools/fleet_sim).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sensors.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TELEMETRY_DEFAULT_PUB_TOPIC "cold_storage/data"     // Used when CONFIG_MQTT_PUB_TOPIC is not set
+#define TELEMETRY_DEFAULT_SUB_TOPIC "cold_storage/commands" // Used when CONFIG_MQTT_SUB_TOPIC is not set
+
+#define TELEMETRY_TOPIC_MAX 128   // Size of the MAC prefixed topic buffers
+#define TELEMETRY_PAYLOAD_MAX 128 // Size of the JSON readings payload buffer
+#define TELEMETRY_ALERT_MAX 64    // Size of the threshold alert message buffer
+
+    /**
+     * @brief Format a device topic as MAC_ADDRESS/SUFFIX.
+     *
+     * @param out Output buffer.
+     * @param out_len Size of the output buffer.
+     * @param mac Station MAC address of the device.
+     * @param suffix Topic suffix (e.g. CONFIG_MQTT_PUB_TOPIC).
+     * @return int Length of the formatted topic (snprintf semantics).
+     */
+    int telemetry_format_topic(char *out, size_t out_len, const uint8_t mac[6], const char *suffix);
+
+    /**
+     * @brief Format the periodic sensor readings as the JSON payload published over MQTT.
+     *
+     * @param out Output buffer.
+     * @param out_len Size of the output buffer.
+     * @param readings Sensor readings to encode.
+     * @return int Length of the formatted payload (snprintf semantics).
+     */
+    int telemetry_format_payload(char *out, size_t out_len, const sensor_readings_t *readings);
+
+    /**
+     * @brief Format the threshold alert notification sent over SMS/GSM MQTT.
+     *
+     * @param out Output buffer.
+     * @param out_len Size of the output buffer.
+     * @param readings Sensor readings that exceeded the thresholds.
+     * @return int Length of the formatted message (snprintf semantics).
+     */
+    int telemetry_format_alert(char *out, size_t out_len, const sensor_readings_t *readings);
+
+#ifdef __cplusplus
+}
+#endif
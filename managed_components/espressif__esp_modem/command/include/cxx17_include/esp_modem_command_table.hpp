@@ -0,0 +1,318 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "cxx17_include/esp_modem_command_library_17.hpp"
+
+namespace esp_modem {
+namespace dce_commands {
+namespace table {
+/**
+ * @brief Descriptors of all AT commands are generated from esp_modem_command_declare.inc
+ *
+ * Each DCE command is followed by the AT commands it sends:
+ * ESP_MODEM_DECLARE_AT_COMMAND(name, command, timeout_ms, pass_phrase, fail_phrase)
+ * Commands ending with "\r" are sent as they are, the other commands are prefixes of commands with parameters.
+ * Phrases could list several alternatives separated by '|'
+ */
+/**
+ * @brief Sends the initial AT sequence to sync up with the device
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc sync{"AT\r", "OK", "ERROR", 500};
+/**
+ * @brief Reads the operator name
+ * @param[out] name operator name
+ * @param[out] act access technology
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_operator_name{"AT+COPS?\r", "OK", "ERROR", 75000};
+/**
+ * @brief Stores current user profile
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc store_profile{"AT&W\r", "OK", "ERROR", 500};
+/**
+ * @brief Sets the supplied PIN code
+ * @param[in] pin Pin
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_pin{"AT+CPIN=", "OK", "ERROR", 500};
+/**
+ * @brief Execute the supplied AT command in raw mode (doesn't append '\r' to command, returns everything)
+ * @param[in] cmd String command that's send to DTE
+ * @param[out] out Raw output from DTE
+ * @param[in] pass Pattern in response for the API to return OK
+ * @param[in] fail Pattern in response for the API to return FAIL
+ * @param[in] timeout AT command timeout in milliseconds
+ * @return OK, FAIL or TIMEOUT
+ */
+/**
+ * @brief Execute the supplied AT command
+ * @param[in] cmd AT command
+ * @param[out] out Command output string
+ * @param[in] timeout AT command timeout in milliseconds
+ * @return OK, FAIL or TIMEOUT
+ */
+/**
+ * @brief Checks if the SIM needs a PIN
+ * @param[out] pin_ok true if the SIM card doesn't need a PIN to unlock
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc read_pin{"AT+CPIN?\r", "OK", "ERROR", 500};
+/**
+ * @brief Sets echo mode
+ * @param[in] echo_on true if echo mode on (repeats the commands)
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_echo{"ATE", "OK", "ERROR", 500};
+/**
+ * @brief Sets the Txt or Pdu mode for SMS (only txt is supported)
+ * @param[in] txt true if txt mode
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc sms_txt_mode{"AT+CMGF=", "OK", "ERROR", 500};
+/**
+ * @brief Sets the default (GSM) character set
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc sms_character_set{"AT+CSCS=\"GSM\"\r", "OK", "ERROR", 500};
+/**
+ * @brief Sends SMS message in txt mode
+ * @param[in] number Phone number to send the message to
+ * @param[in] message Text message to be sent
+ * @return OK, FAIL or TIMEOUT
+ */
+/**
+ * @brief Resumes data mode (Switches back to the data mode, which was temporarily suspended)
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc resume_data_mode{"ATO\r", "CONNECT", "ERROR", 5000};
+/**
+ * @brief Sets php context
+ * @param[in] p1 PdP context struct to setup modem cellular connection
+ * @return OK, FAIL or TIMEOUT
+ */
+/**
+ * @brief Switches to the command mode
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_command_mode{"+++", "NO CARRIER|OK", "ERROR", 5000};
+/**
+ * @brief Switches to the CMUX mode
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_cmux{"AT+CMUX=0\r", "OK", "ERROR", 500};
+/**
+ * @brief Reads the IMSI number
+ * @param[out] imsi Module's IMSI number
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_imsi{"AT+CIMI\r", "OK", "ERROR", 5000};
+/**
+ * @brief Reads the IMEI number
+ * @param[out] imei Module's IMEI number
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_imei{"AT+CGSN\r", "OK", "ERROR", 5000};
+/**
+ * @brief Reads the module name
+ * @param[out] name module name
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_module_name{"AT+CGMM\r", "OK", "ERROR", 5000};
+inline constexpr command_desc get_identification{"ATI\r", "OK", "ERROR", 5000};
+/**
+ * @brief Sets the modem to data mode
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_data_mode{"ATD*99#\r", "CONNECT", "ERROR", 5000};
+inline constexpr command_desc set_data_mode_alt{"ATD*99##\r", "CONNECT", "ERROR", 5000};
+/**
+ * @brief Get Signal quality
+ * @param[out] rssi signal strength indication
+ * @param[out] ber channel bit error rate
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_signal_quality{"AT+CSQ\r", "OK", "ERROR", 500};
+/**
+ * @brief Sets HW control flow
+ * @param[in] dce_flow 0=none, 2=RTS hw flow control of DCE
+ * @param[in] dte_flow 0=none, 2=CTS hw flow control of DTE
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_flow_control{"AT+IFC=", "OK", "ERROR", 500};
+/**
+ * @brief Hangs up current data call
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc hang_up{"ATH\r", "OK", "ERROR", 90000};
+/**
+ * @brief Get voltage levels of modem power up circuitry
+ * @param[out] voltage Current status in mV
+ * @param[out] bcs charge status (-1-Not available, 0-Not charging, 1-Charging, 2-Charging done)
+ * @param[out] bcl 1-100% battery capacity, -1-Not available
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_battery_status{"AT+CBC\r", "OK", "ERROR", 500};
+/**
+ * @brief Power down the module
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc power_down{"AT+QPOWD=1\r", "POWERED DOWN", "ERROR", 1000};
+inline constexpr command_desc power_down_sim76xx{"AT+CPOF\r", "OK", "ERROR", 1000};
+inline constexpr command_desc power_down_sim70xx{"AT+CPOWD=1\r", "POWER DOWN", "ERROR", 1000};
+inline constexpr command_desc power_down_sim8xx{"AT+CPOWD=1\r", "POWER DOWN", "ERROR", 1000};
+/**
+ * @brief Reset the module
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc reset{"AT+CRESET\r", "PB DONE", "ERROR", 60000};
+/**
+ * @brief Configures the baudrate
+ * @param[in] baud Desired baud rate of the DTE
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_baud{"AT+IPR=", "OK", "ERROR", 500};
+/**
+ * @brief Force an attempt to connect to a specific operator
+ * @param[in] mode mode of attempt
+ * mode=0 - automatic
+ * mode=1 - manual
+ * mode=2 - deregister
+ * mode=3 - set format for read operation
+ * mode=4 - manual with fallback to automatic
+ * @param[in] format what format the operator is given in
+ * format=0 - long format
+ * format=1 - short format
+ * format=2 - numeric
+ * @param[in] oper the operator to connect to
+ * @return OK, FAIL or TIMEOUT
+ */
+/**
+ * @brief Attach or detach from the GPRS service
+ * @param[in] state 1-attach 0-detach
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_network_attachment_state{"AT+CGATT=", "OK", "ERROR", 500};
+/**
+ * @brief Get network attachment state
+ * @param[out] state 1-attached 0-detached
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_network_attachment_state{"AT+CGATT?\r", "OK", "ERROR", 500};
+/**
+ * @brief What mode the radio should be set to
+ * @param[in] state state 1-full 0-minimum ...
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_radio_state{"AT+CFUN=", "OK", "ERROR", 15000};
+/**
+ * @brief Get current radio state
+ * @param[out] state 1-full 0-minimum ...
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_radio_state{"AT+CFUN?\r", "OK", "ERROR", 500};
+/**
+ * @brief Set network mode
+ * @param[in] mode preferred mode
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_network_mode{"AT+CNMP=", "OK", "ERROR", 500};
+/**
+ * @brief Preferred network mode (CAT-M and/or NB-IoT)
+ * @param[in] mode preferred selection
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_preferred_mode{"AT+CMNB=", "OK", "ERROR", 500};
+/**
+ * @brief Set network bands for CAT-M or NB-IoT
+ * @param[in] mode CAT-M or NB-IoT
+ * @param[in] bands bitmap in hex representing bands
+ * @param[in] size size of teh bands bitmap
+ * @return OK, FAIL or TIMEOUT
+ */
+/**
+ * @brief Show network system mode
+ * @param[out] mode current network mode
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_network_system_mode{"AT+CNSMOD?\r", "OK", "ERROR", 500};
+/**
+ * @brief GNSS power control
+ * @param[out] mode power mode (0 - off, 1 - on)
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc set_gnss_power_mode{"AT+CGNSPWR=", "OK", "ERROR", 500};
+inline constexpr command_desc set_gnss_power_mode_sim76xx{"AT+CGPS=", "OK", "ERROR", 500};
+/**
+ * @brief GNSS power control
+ * @param[out] mode power mode (0 - off, 1 - on)
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc get_gnss_power_mode{"AT+CGNSPWR?\r", "OK", "ERROR", 500};
+/**
+ * @brief Configure PSM
+ * @param[in] mode psm mode (0 - off, 1 - on, 2 - off & discard stored params)
+ * @return OK, FAIL or TIMEOUT
+ */
+inline constexpr command_desc config_psm{"AT+CPSMS=", "OK", "ERROR", 5000};
+/**
+ * @brief Configure CEREG urc
+ * @param[in] value
+ * value = 0 - Disable network URC
+ * value = 1 - Enable network URC
+ * value = 2 - Enable network URC with location information
+ * value = 3 - Enable network URC with location information and EMM cause
+ * value = 4 - Enable network URC with location information and PSM value
+ * value = 5 - Enable network URC with location information and PSM value, EMM cause
+ */
+inline constexpr command_desc config_network_registration_urc{"AT+CEREG=", "OK", "ERROR", 500};
+/**
+ *  @brief Gets the current network registration state
+ *  @param[out] state The current network registration state
+ *  state = 0 - Not registered, MT is not currently searching an operator to register to
+ *  state = 1 - Registered, home network
+ *  state = 2 - Not registered, but MT is currently trying to attach or searching an operator to register to
+ *  state = 3 - Registration denied
+ *  state = 4 - Unknown
+ *  state = 5 - Registered, Roaming
+ *  state = 6 - Registered, for SMS only, home network (NB-IoT only)
+ *  state = 7 - Registered, for SMS only, roaming (NB-IoT only)
+ *  state = 8 - Attached for emergency bearer services only
+ *  state = 9 - Registered for CSFB not preferred, home network
+ *  state = 10 - Registered for CSFB not preferred, roaming
+ */
+inline constexpr command_desc get_network_registration_state{"AT+CEREG?\r", "OK", "ERROR", 500};
+/**
+ *  @brief Configures the mobile termination error (+CME ERROR)
+ *  @param[in] mode The form of the final result code
+ *  mode = 0 - Disable, use and send ERROR instead
+ *  mode = 1 - Enable, use numeric error values
+ *  mode = 2 - Enable, result code and use verbose error values
+ */
+inline constexpr command_desc config_mobile_termination_error{"AT+CMEE=", "OK", "ERROR", 500};
+/**
+ * @brief Configure eDRX
+ * @param[in] mode
+ * mode = 0 - Disable
+ * mode = 1 - Enable
+ * mode = 2 - Enable + URC
+ * mode = 3 - Disable + Reset parameter.
+ * @param[in] access_technology
+ * act = 0 - ACT is not using eDRX (used in URC)
+ * act = 1 - EC-GSM-IoT (A/Gb mode)
+ * act = 2 - GSM (A/Gb mode)
+ * act = 3 - UTRAN (Iu mode)
+ * act = 4 - E-UTRAN (WB-S1 mode)
+ * act = 5 - E-UTRAN (NB-S1 mode)
+ * @param[in] edrx_value nible string containing encoded eDRX time
+ * @param[in] ptw_value nible string containing encoded Paging Time Window
+ */
+} // table
+} // dce_commands
+} // esp_modem
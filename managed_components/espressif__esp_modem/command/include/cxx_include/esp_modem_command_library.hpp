@@ -340,6 +340,35 @@ command_result set_network_bands_sim76xx(CommandableIf *t, const std::string &mo
 command_result power_down_sim8xx(CommandableIf *t);
 command_result set_data_mode_alt(CommandableIf *t);
 command_result set_pdp_context(CommandableIf *t, PdpContext &pdp, uint32_t timeout_ms);
+/**
+ * @brief Sends several commands chained on one command line (e.g. AT+CMGF=1;+CNMI=2,1) in one round trip
+ *
+ * Information responses are assigned to the commands by their prefix (+CPMS: ... belongs to +CPMS),
+ * unprefixed lines belong to the last identified command. If the line fails, the DCE doesn't tell which
+ * command failed, so the commands are sent again one by one until the first failure.
+ * Use it for commands which could be repeated safely (configuration).
+ * @param[in] commands Commands with or without the "AT" prefix
+ * @param[out] replies Result and information response of each command
+ * @param[in] timeout_ms Timeout of each command (a line of N commands waits up to N times as long)
+ * @return OK if all commands passed, FAIL or TIMEOUT otherwise
+ */
+command_result at_batch(CommandableIf *t, const std::vector<std::string> &commands, std::vector<command_reply> &replies, uint32_t timeout_ms);
+
+/**
+ * @brief Negotiates the highest baud rate supported by both the modem and the DTE terminal
+ *
+ * The modem is looked up at the current rate (or at any of the candidate rates, as a previously negotiated rate
+ * might have been persisted). Then the candidates are tried from the highest one: the modem is switched by AT+IPR,
+ * the terminal follows and the link is verified by AT probes and by the CRC of the ATI reply (compared to the reply
+ * at the current rate). If the verification fails, both sides return to the previous rate and a lower candidate
+ * is tried.
+ * @param[in] dte DTE of the modem (its primary terminal changes the rate)
+ * @param[in] rates Candidate baud rates
+ * @param[in,out] baud Current baud rate of the terminal, updated with the negotiated rate
+ * @param[in] persist Store the negotiated rate to the modem profile (AT&W)
+ * @return OK if the modem is in sync at the (possibly unchanged) baud rate, FAIL or TIMEOUT otherwise
+ */
+command_result negotiate_baud(DTE *dte, const std::vector<int> &rates, int &baud, bool persist);
 /**
  * @}
  */
@@ -0,0 +1,35 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "cxx17_include/esp_modem_command_library_17.hpp"
+
+//  --- ESP-MODEM command module starts here ---
+namespace esp_modem {
+namespace dce_commands {
+namespace table {
+
+/**
+ * @brief Descriptors of all AT commands are generated from esp_modem_command_declare.inc
+ *
+ * Each DCE command is followed by the AT commands it sends:
+ * ESP_MODEM_DECLARE_AT_COMMAND(name, command, timeout_ms, pass_phrase, fail_phrase)
+ * Commands ending with "\r" are sent as they are, the other commands are prefixes of commands with parameters.
+ * Phrases could list several alternatives separated by '|'
+ */
+#define ESP_MODEM_DECLARE_DCE_COMMAND(name, return_type, ...)
+#define ESP_MODEM_DECLARE_AT_COMMAND(name, command, timeout_ms, pass_phrase, fail_phrase) \
+        inline constexpr command_desc name{command, pass_phrase, fail_phrase, timeout_ms};
+
+#include "esp_modem_command_declare.inc"
+
+#undef ESP_MODEM_DECLARE_AT_COMMAND
+#undef ESP_MODEM_DECLARE_DCE_COMMAND
+
+} // table
+} // dce_commands
+} // esp_modem
@@ -3,7 +3,11 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
+#pragma once
+
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <list>
 #include "esp_log.h"
 #include "cxx_include/esp_modem_dte.hpp"
@@ -14,4 +18,74 @@ command_result generic_command(CommandableIf *t, const std::string &command,
                                const std::list<std::string_view> &pass_phrase,
                                const std::list<std::string_view> &fail_phrase,
                                uint32_t timeout_ms);
-}
+
+/**
+ * @brief Command with its reply phrases and timeout, which are only referenced (not copied),
+ * so that the frequently issued commands don't allocate memory
+ *
+ * Descriptors of the library commands are generated to a constexpr table (see ESP_MODEM_DECLARE_AT_COMMAND in esp_modem_command_declare.inc).
+ * Replies are classified by a phrase_matcher, so the pass and fail phrases together must not exceed 63 characters.
+ */
+struct command_desc {
+    std::string_view command;       /*!< Command to issue, including the terminating "\r" (or a prefix of a command with parameters) */
+    std::string_view pass_phrase;   /*!< Pattern to find in replies to complete the command successfully (alternatives separated by '|') */
+    std::string_view fail_phrase;   /*!< If this pattern found the command fails immediately (alternatives separated by '|') */
+    uint32_t timeout_ms;            /*!< Command timeout in ms */
+};
+
+command_result generic_command(CommandableIf *t, const command_desc &cmd);
+
+template <typename T> command_result generic_get_string(CommandableIf *t, const command_desc &cmd, T &output);
+
+/**
+ * @brief String of a fixed capacity, used to format commands and to capture short replies without heap allocations
+ *
+ * Appending data which doesn't fit marks the string as overflown, see ok()
+ */
+template <size_t N> class fixed_string {
+public:
+    fixed_string &operator+=(std::string_view s)
+    {
+        if (s.size() > N - len) {
+            overflow = true;
+            s = s.substr(0, N - len);
+        }
+        s.copy(buf + len, s.size());
+        len += s.size();
+        return *this;
+    }
+    fixed_string &operator+=(int value)
+    {
+        auto res = std::to_chars(buf + len, buf + N, value);
+        if (res.ec != std::errc()) {
+            overflow = true;
+            return *this;
+        }
+        len = res.ptr - buf;
+        return *this;
+    }
+    void assign(std::string_view s)
+    {
+        clear();
+        *this += s;
+    }
+    void clear()
+    {
+        len = 0;
+        overflow = false;
+    }
+    [[nodiscard]] bool ok() const
+    {
+        return !overflow;
+    }
+    [[nodiscard]] std::string_view view() const
+    {
+        return std::string_view(buf, len);
+    }
+private:
+    char buf[N];
+    size_t len{0};
+    bool overflow{false};
+};
+
+} // esp_modem::dce_commands
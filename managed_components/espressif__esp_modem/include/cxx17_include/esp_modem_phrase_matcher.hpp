@@ -0,0 +1,232 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace esp_modem {
+
+/**
+ * @brief Multi-pattern matcher (Aho-Corasick automaton) classifying replies by sets of phrases
+ *
+ * Phrases are added with a tag, the matcher then scans the reply just once (regardless of the number of phrases)
+ * and reports the lowest tag of all phrases found. The scan could be resumed with the next fragment of the reply,
+ * so phrases split between fragments are found, too. Data which cannot start any phrase are skipped a word
+ * at a time.
+ *
+ * The automaton uses fixed storage (no heap allocations). The command library builds it once per phrase set
+ * and keeps it, as building is much costlier than scanning a reply.
+ * @tparam MaxNodes Capacity of the automaton, i.e. total length of all phrases + 1 (at most 255)
+ */
+template <size_t MaxNodes = 64>
+class phrase_matcher {
+    static_assert(MaxNodes > 1 && MaxNodes <= UINT8_MAX, "Nodes are indexed by uint8_t");
+public:
+    static constexpr int no_match = -1;
+
+    /**
+     * @brief State of the scan, which is carried across the fragments of one reply
+     */
+    struct state {
+        uint8_t node{0};            /*!< Current node of the automaton */
+        int tag{no_match};          /*!< Lowest tag found so far */
+    };
+
+    /**
+     * @brief Adds a phrase to find
+     * @param phrase Non-empty phrase
+     * @param tag Non-negative number reported if the phrase found (lower tags take precedence)
+     * @return false if the phrase is empty or the automaton capacity was exceeded
+     */
+    bool add(std::string_view phrase, int tag)
+    {
+        if (phrase.empty() || tag < 0) {
+            return false;
+        }
+        uint8_t node = 0;
+        for (auto ch : phrase) {
+            auto byte = static_cast<uint8_t>(ch);
+            auto c = child(node, byte);
+            if (c == 0) {
+                if (count >= MaxNodes) {
+                    return false;
+                }
+                c = count++;
+                nodes[c] = node_t{byte, 0, nodes[node].first_child, 0, no_match};
+                nodes[node].first_child = c;
+            }
+            node = c;
+        }
+        nodes[node].tag = lower(nodes[node].tag, tag);
+        lowest_tag = lower(lowest_tag, tag);
+        return true;
+    }
+
+    /**
+     * @brief Adds alternative phrases separated by '|' (empty alternatives are ignored)
+     * @return false if the automaton capacity was exceeded
+     */
+    bool add_any(std::string_view phrases, int tag)
+    {
+        while (!phrases.empty()) {
+            auto end = phrases.find('|');
+            auto phrase = phrases.substr(0, end);
+            if (!phrase.empty() && !add(phrase, tag)) {
+                return false;
+            }
+            if (end == std::string_view::npos) {
+                break;
+            }
+            phrases.remove_prefix(end + 1);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Completes the automaton, needs to be called after adding all phrases (and before scanning)
+     */
+    void build()
+    {
+        // breadth first, so that the failure links of shorter prefixes are ready
+        uint8_t queue[MaxNodes];
+        size_t head = 0, tail = 0;
+        for (auto child = nodes[0].first_child; child != 0; child = nodes[child].next_sibling) {
+            nodes[child].fail = 0;
+            queue[tail++] = child;
+        }
+        while (head < tail) {
+            auto parent = queue[head++];
+            for (auto child = nodes[parent].first_child; child != 0; child = nodes[child].next_sibling) {
+                nodes[child].fail = next(nodes[parent].fail, nodes[child].byte);
+                // a node reports also the phrases ending in its suffix (the failure node)
+                nodes[child].tag = lower(nodes[child].tag, nodes[nodes[child].fail].tag);
+                queue[tail++] = child;
+            }
+        }
+        start_count = 0;
+        for (auto child = nodes[0].first_child; child != 0; child = nodes[child].next_sibling) {
+            if (start_count < sizeof(start_bytes)) {
+                start_bytes[start_count] = nodes[child].byte;
+            }
+            start_count++;
+        }
+    }
+
+    /**
+     * @brief Scans the next fragment of the reply
+     * @param s Scan state (default constructed for the first fragment)
+     * @return The lowest tag found so far, or no_match
+     */
+    int scan(state &s, const uint8_t *data, size_t len) const
+    {
+        size_t pos = 0;
+        auto node = s.node;
+        while (pos < len) {
+            if (node == 0) {
+                pos = skip(data, pos, len);
+                if (pos == len) {
+                    break;
+                }
+            }
+            node = next(node, data[pos++]);
+            if (nodes[node].tag != no_match) {
+                s.tag = lower(s.tag, nodes[node].tag);
+                if (s.tag == lowest_tag) {
+                    break;      // no better match possible
+                }
+            }
+        }
+        s.node = node;
+        return s.tag;
+    }
+
+    /**
+     * @brief Scans one complete reply
+     * @return The lowest tag found, or no_match
+     */
+    int find(std::string_view reply) const
+    {
+        state s;
+        return scan(s, reinterpret_cast<const uint8_t *>(reply.data()), reply.size());
+    }
+
+private:
+    struct node_t {
+        uint8_t byte;           /*!< Byte of the edge leading to this node */
+        uint8_t first_child;    /*!< Children are kept in a list, 0 terminates the list (root is no child) */
+        uint8_t next_sibling;
+        uint8_t fail;           /*!< Longest proper suffix of this node, which is also a node */
+        int tag;                /*!< Lowest tag of phrases ending at this node */
+    };
+
+    static constexpr int lower(int a, int b)
+    {
+        return a == no_match ? b : (b == no_match || a < b ? a : b);
+    }
+
+    uint8_t child(uint8_t parent, uint8_t byte) const
+    {
+        for (auto c = nodes[parent].first_child; c != 0; c = nodes[c].next_sibling) {
+            if (nodes[c].byte == byte) {
+                return c;
+            }
+        }
+        return 0;
+    }
+
+    uint8_t next(uint8_t node, uint8_t byte) const
+    {
+        while (true) {
+            if (auto c = child(node, byte)) {
+                return c;
+            }
+            if (node == 0) {
+                return 0;
+            }
+            node = nodes[node].fail;
+        }
+    }
+
+    /**
+     * @brief Skips the bytes, which cannot start any phrase, checks a word at a time if there're only a few start bytes
+     */
+    size_t skip(const uint8_t *data, size_t pos, size_t len) const
+    {
+        if (start_count <= sizeof(start_bytes)) {
+            // native word, so that 32-bit targets don't emulate 64-bit arithmetic
+            constexpr size_t ones = SIZE_MAX / 0xFF;
+            constexpr size_t highs = ones << 7;
+            while (pos + sizeof(size_t) <= len) {
+                size_t word;
+                memcpy(&word, data + pos, sizeof(word));
+                size_t found = 0;
+                for (size_t i = 0; i < start_count; ++i) {
+                    size_t diff = word ^ (ones * start_bytes[i]);
+                    found |= (diff - ones) & ~diff & highs;     // a high bit set for a zero byte
+                }
+                if (found) {
+                    break;      // find the exact byte below
+                }
+                pos += sizeof(size_t);
+            }
+        }
+        while (pos < len && child(0, data[pos]) == 0) {
+            pos++;
+        }
+        return pos;
+    }
+
+    node_t nodes[MaxNodes] {{0, 0, 0, 0, no_match}};
+    uint8_t count{1};
+    uint8_t start_bytes[8] {};
+    size_t start_count{0};
+    int lowest_tag{no_match};
+};
+
+} // namespace esp_modem
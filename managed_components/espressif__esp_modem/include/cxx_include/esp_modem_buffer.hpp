@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 namespace esp_modem {
 
 /**
@@ -42,4 +45,125 @@ struct unique_buffer {
     size_t consumed{};
 };
 
+/**
+ * Read-only view to a contiguous part of a buffer
+ */
+struct buffer_view {
+    uint8_t *data;
+    size_t len;
+};
+
+/**
+ * Ring buffer used to accumulate data that didn't fit the unique_buffer
+ *
+ * Storage is allocated on first use and then kept for the lifetime of the owner, so that
+ * repeated use (clear() and refill) causes no heap traffic. The capacity only grows (doubles)
+ * if more data than the current capacity needs to be held at once.
+ */
+struct ring_buffer {
+    explicit ring_buffer(size_t capacity): cap(capacity) {}
+    ring_buffer(ring_buffer const &) = delete;
+    ring_buffer &operator=(ring_buffer const &) = delete;
+
+    /**
+     * @brief Returns a pointer to at least `len` bytes of contiguous free space after the stored data
+     * (allocates, linearizes or grows the storage if needed)
+     */
+    uint8_t *prepare(size_t len);
+
+    /**
+     * @brief Marks `len` bytes of the prepared space as written
+     */
+    void commit(size_t len);
+
+    /**
+     * @brief Copies the data at the end of the buffer
+     */
+    void append(const uint8_t *data, size_t len);
+
+    /**
+     * @brief Drops `len` bytes from the front of the buffer
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief Returns up to two views that cover the stored data in order (the second one is empty unless wrapped)
+     */
+    [[nodiscard]] std::pair<buffer_view, buffer_view> readable() const;
+
+    /**
+     * @brief Makes the stored data contiguous (in place, no-op unless wrapped)
+     * @return Pointer to the first stored byte
+     */
+    uint8_t *linearize();
+
+    /**
+     * @brief Grows the storage to at least `capacity` bytes, keeping the stored data
+     */
+    void reserve(size_t capacity);
+
+    void clear()
+    {
+        head = 0;
+        len = 0;
+    }
+    [[nodiscard]] size_t size() const
+    {
+        return len;
+    }
+    [[nodiscard]] size_t capacity() const
+    {
+        return cap;
+    }
+    [[nodiscard]] bool empty() const
+    {
+        return len == 0;
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> data;
+    size_t cap;         /*!< Capacity, storage is allocated lazily */
+    size_t head{};      /*!< Position of the first stored byte */
+    size_t len{};       /*!< Number of stored bytes */
+};
+
+/**
+ * Pool of fixed-size blocks
+ *
+ * Blocks are allocated on first use, up to the configured count, and then recycled, so that
+ * the steady state causes no heap traffic. The pool is not thread safe.
+ */
+struct block_pool {
+    block_pool() = default;
+    block_pool(block_pool const &) = delete;
+    block_pool &operator=(block_pool const &) = delete;
+
+    /**
+     * @brief Sets the block size and the maximum number of blocks (no block may be in use)
+     */
+    void configure(size_t size, size_t count);
+
+    /**
+     * @brief Takes a block from the pool
+     * @return The block of block_size() bytes, nullptr if all blocks are in use
+     */
+    uint8_t *acquire();
+
+    /**
+     * @brief Returns the block to the pool
+     */
+    void release(uint8_t *block);
+
+    [[nodiscard]] size_t block_size() const
+    {
+        return size;
+    }
+
+private:
+    size_t size{};
+    size_t count{};
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;   /*!< All allocated blocks */
+    std::vector<uint8_t *> free_blocks;               /*!< Blocks not in use */
+};
+
 }
@@ -6,12 +6,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
 #include "esp_modem_terminal.hpp"
 #include "cxx_include/esp_modem_buffer.hpp"
+#include "cxx_include/esp_modem_stats.hpp"
+#include "cxx_include/esp_modem_flush_queue.hpp"
 
 namespace esp_modem {
 
-constexpr size_t MAX_TERMINALS_NUM = 2;
+constexpr size_t MAX_TERMINALS_NUM = 8;     /*!< Maximum number of virtual terminals (DLCIs besides the control one) */
 /**
  * @defgroup ESP_MODEM_CMUX ESP_MODEM CMUX class
  * @brief Definition of CMUX terminal
@@ -47,9 +51,27 @@ class CMuxInstance;
  */
 class CMux {
 public:
-    explicit CMux(std::shared_ptr<Terminal> t, unique_buffer &&b):
-        term(std::move(t)), payload_start(nullptr), total_payload_size(0), buffer(std::move(b))  {}
-    ~CMux() = default;
+    /**
+     * @brief Reasons of restarting the CMUX state machine (indexes of cmux_stats::recoveries)
+     */
+    enum class protocol_mismatch_reason {
+        MISSED_LEAD_SOF,
+        MISSED_TRAIL_SOF,
+        WRONG_CRC,
+        UNEXPECTED_HEADER,
+        UNEXPECTED_DATA,
+        READ_BEHIND_BUFFER,
+        UNKNOWN
+    };
+
+    /**
+     * @param t The original terminal
+     * @param b Processing buffer
+     * @param c Counters to update (e.g. kept by the DTE across CMUX sessions), nullptr to use internal ones
+     * @param terminals Number of virtual terminals to open (DLCIs 1 to terminals), up to MAX_TERMINALS_NUM
+     */
+    explicit CMux(std::shared_ptr<Terminal> t, unique_buffer &&b, cmux_counters *c = nullptr, size_t terminals = 2);
+    ~CMux();
 
     /**
      * @brief Initializes CMux protocol
@@ -77,15 +99,51 @@ public:
      */
     void set_read_cb(int inst, std::function<bool(uint8_t *data, size_t len)> f);
 
+    /**
+     * @brief Sets the priority of the task passing the payloads to the terminal's read callback
+     * (if ESP_MODEM_CMUX_DISPATCH_QUEUE_SIZE > 0), takes effect on init()
+     * @param inst Index of the terminal
+     * @param priority Task priority, 0 for the default ESP_MODEM_CMUX_DISPATCH_TASK_PRIORITY
+     */
+    void set_dispatch_priority(int inst, size_t priority);
+
+    /**
+     * @brief Number of the virtual terminals
+     */
+    size_t terminals_num() const
+    {
+        return virtual_terms;
+    }
+
     /**
      * @brief Writes to the appropriate terminal
+     *
+     * The frames are assembled into one buffer and written to the terminal at once. If another
+     * thread is writing at the moment, the frames are queued and written by that thread together
+     * with the frames queued in the meantime (back to back frames coalesce into one terminal write).
+     * While the device doesn't accept frames on this terminal (flow control), the write waits for it
+     * to resume (up to 5s), which slows down the writer (e.g. the PPP output) instead of losing the frames.
+     *
      * @param i Index of the terminal
      * @param data Data to write
      * @param len Data length to write
-     * @return The actual written length
+     * @return The actual written length, 0 if stopped by flow control, -1 on error
      */
     int write(int i, uint8_t *data, size_t len);
 
+    /**
+     * @brief Asks the device to stop (or resume) sending frames on all virtual terminals (FCoff/FCon command)
+     * @param on false to stop, true to resume
+     */
+    void set_rx_flow(bool on);
+
+    /**
+     * @brief Asks the device to stop (or resume) sending frames on one virtual terminal (MSC command with FC bit)
+     * @param i Index of the terminal
+     * @param on false to stop, true to resume
+     */
+    void set_rx_flow(int i, bool on);
+
     /**
      * @brief Recovers the protocol
      *
@@ -96,23 +154,43 @@ public:
      */
     bool recover();
 
-private:
+    /**
+     * @brief Reads the protocol statistics (payload bytes per DLCI and recoveries)
+     */
+    void get_stats(cmux_stats &s) const
+    {
+        counters->get(s);
+    }
 
-    enum class protocol_mismatch_reason {
-        MISSED_LEAD_SOF,
-        MISSED_TRAIL_SOF,
-        WRONG_CRC,
-        UNEXPECTED_HEADER,
-        UNEXPECTED_DATA,
-        READ_BEHIND_BUFFER,
-        UNKNOWN
-    };
+private:
 
     static uint8_t fcs_crc(const uint8_t frame[6]);     /*!< Utility to calculate FCS CRC */
+    static uint8_t fcs_update(uint8_t crc, uint8_t byte);   /*!< Adds one byte to the FCS CRC (table driven) */
     bool data_available(uint8_t *data, size_t len);     /*!< Called when valid data available (returns false on unexpected data format) */
     void send_sabm(size_t i);                           /*!< Sending initial SABM */
     void send_disconnect(size_t i);                     /*!< Sending closing request for each virtual or control terminal */
+    void send_pn(size_t i);                             /*!< Sending parameter negotiation (frame size) for a virtual terminal */
+    void negotiate_frame_size();                        /*!< Negotiates the frame size of the virtual terminals (keeps the default if refused) */
+    void send_control(const uint8_t *message, size_t len); /*!< Sending a message over the control terminal */
+    bool on_control(uint8_t *data, size_t len);         /*!< Processes a control message (PN, flow control), false if not handled */
+    void set_tx_flow(size_t i, bool on);                /*!< Device's flow control of DLCI i (0 for all) */
+    bool wait_for_tx_flow(size_t i);                    /*!< Waits until DLCI i may send, false on timeout */
+    void transmit(const uint8_t *frame, size_t len);    /*!< Queues a frame and writes the queue */
+    bool wait_for_tx_room();                            /*!< Waits until the writing thread takes the queued frames, false on timeout */
+    size_t write_frames(uint8_t *data, size_t len);     /*!< Writes the frames taken from the queue to the terminal, returns the bytes written */
     bool on_cmux_data(uint8_t *data, size_t len);       /*!< Called from terminal layer when raw CMUX protocol data available */
+    void append_payload(uint8_t *data, size_t len);     /*!< Adds the next part of the payload to its reassembly block */
+    void park_payload();                                /*!< Moves the partial payload from the Rx buffer to a reassembly block */
+    void release_payload();                             /*!< Forgets the payload and returns its reassembly block to the pool */
+    uint8_t *acquire_block();                           /*!< Takes a block from the pool (nullptr if exhausted) */
+    void release_block(uint8_t *block);                 /*!< Returns a block to the pool */
+    void deliver(int i, uint8_t *data, size_t len);     /*!< Passes the payload to the read callback (or to its dispatch queue) */
+
+    struct dispatch_queue;                              /*!< Payloads waiting for the read callback of a terminal */
+    void start_dispatch();                              /*!< Starts the dispatch tasks (if enabled) */
+    void stop_dispatch();                               /*!< Passes the queued payloads and stops the dispatch tasks */
+    void enqueue(dispatch_queue &q, uint8_t *block, size_t len); /*!< Queues the block (or drops it if the queue is full) */
+    void dispatch_task(dispatch_queue &q);              /*!< Passes the queued payloads to the read callback */
 
     struct CMuxFrame;                                   /*!< Forward declare the Frame struct, used in protocol decoders */
     /**
@@ -131,6 +209,7 @@ private:
     std::function<bool(uint8_t *data, size_t len)> read_cb[MAX_TERMINALS_NUM];  /*!< Function pointers to read callbacks */
     std::shared_ptr<Terminal> term;                   /*!< The original terminal */
     cmux_state state;                                 /*!< CMux protocol state */
+    size_t virtual_terms;                             /*!< Number of the virtual terminals */
 
     /**
      * CMux control fields and offsets
@@ -139,17 +218,34 @@ private:
     uint8_t type;
     size_t payload_len;
     uint8_t frame_header[6];
+    uint8_t rx_fcs;                                   /*!< FCS of the received header, checked in the footer */
     size_t frame_header_offset;
-    uint8_t *payload_start;
+    uint8_t *payload_start;                           /*!< Payload of the current frame (in the Rx buffer or in payload_block) */
     size_t total_payload_size;
-    int sabm_ack;
+    uint8_t *payload_block{nullptr};                  /*!< Reassembly block of the payload spanning several reads */
+    SignalGroup handshake;                            /*!< Acknowledged SABM/DISC (bit per DLCI) and received PN replies */
+    size_t frame_size[MAX_TERMINALS_NUM + 1];         /*!< Maximum frame payload (N1) per DLCI */
 
     /**
      * Processing unique buffer (reused and transferred from it's parent DTE)
      */
     unique_buffer buffer;
+    block_pool rx_blocks;                             /*!< Reassembly blocks and the blocks of the dispatched payloads */
+    Lock rx_blocks_lock;                              /*!< The blocks are returned by the dispatch tasks */
+    std::unique_ptr<dispatch_queue> dispatch[MAX_TERMINALS_NUM];    /*!< Dispatch queue per terminal (if enabled) */
+    size_t dispatch_priority[MAX_TERMINALS_NUM] = {}; /*!< Priorities of the dispatch tasks (0: default) */
+
+    cmux_counters own_counters;                       /*!< Used if no external counters supplied */
+    cmux_counters *counters;                          /*!< Protocol statistics */
+
+    Lock lock;                                        /*!< Serializes processing of the received data and recover() */
 
-    Lock lock;
+    flush_queue tx{[this](uint8_t *data, size_t len) {
+        return write_frames(data, len);
+    }};                                               /*!< Frames of all writers, written by one of them at a time */
+    Lock tx_lock;                                     /*!< Guards the flow control state */
+    bool tx_flow_off[MAX_TERMINALS_NUM + 1] = {};     /*!< Device stopped accepting frames per DLCI ([0]: all of them) */
+    SignalGroup tx_flow;                              /*!< Bit per DLCI, set when the flow resumes */
 };
 
 /**
@@ -78,6 +78,31 @@ public:
         return dte->command(command, std::move(got_line), time_ms);
     }
 
+    /**
+     * @brief Sends several commands on one command line, see dce_commands::at_batch()
+     */
+    command_result at_batch(const std::vector<std::string> &commands, std::vector<command_reply> &replies, uint32_t time_ms = 500)
+    {
+        return dce_commands::at_batch(dte.get(), commands, replies, time_ms);
+    }
+
+    /**
+     * @brief Switches the modem and the DTE to the highest common baud rate, see dce_commands::negotiate_baud()
+     */
+    command_result negotiate_baud(const std::vector<int> &rates, int &baud, bool persist = true)
+    {
+        return dce_commands::negotiate_baud(dte.get(), rates, baud, persist);
+    }
+
+    /**
+     * @brief Reads the statistics of the DTE (including CMUX) and of the network interface
+     */
+    void get_stats(modem_stats &s)
+    {
+        dte->get_stats(s.dte);
+        netif.get_stats(s.netif);
+    }
+
     modem_mode guess_mode(bool with_cmux = false)
     {
         return mode.guess(dte.get(), with_cmux);
@@ -108,6 +133,16 @@ public:
     {
         dte->set_enhanced_urc_cb(enhanced_cb);
     }
+
+    void add_urc_handler(const std::string &prefix, UrcRouter::handler_cb handler)
+    {
+        dte->add_urc_handler(prefix, std::move(handler));
+    }
+
+    void remove_urc_handler(const std::string &prefix)
+    {
+        dte->remove_urc_handler(prefix);
+    }
 #endif
 
     /**
@@ -8,12 +8,15 @@
 
 #include <memory>
 #include <utility>
+#include <map>
 #include <cstddef>
 #include <cstdint>
 #include "cxx_include/esp_modem_primitives.hpp"
 #include "cxx_include/esp_modem_terminal.hpp"
 #include "cxx_include/esp_modem_types.hpp"
 #include "cxx_include/esp_modem_buffer.hpp"
+#include "cxx_include/esp_modem_urc_router.hpp"
+#include "cxx_include/esp_modem_stats.hpp"
 
 struct esp_modem_dte_config;
 
@@ -53,7 +56,7 @@ public:
     explicit DTE(const esp_modem_dte_config *config, std::unique_ptr<Terminal> t, std::unique_ptr<Terminal> s);
     explicit DTE(std::unique_ptr<Terminal> t, std::unique_ptr<Terminal> s);
 
-    ~DTE() = default;
+    ~DTE();
 
     /**
      * @brief Writing to the underlying terminal
@@ -91,6 +94,21 @@ public:
      */
     void set_read_cb(std::function<bool(uint8_t *data, size_t len)> f);
 
+    /**
+     * @brief Data mode sink, receives the payload directly from the terminal's read callback
+     */
+    typedef void (*data_sink_cb)(void *ctx, uint8_t *data, size_t len);
+
+    /**
+     * @brief Connects the data terminal directly to the sink (used by the Netif in data mode)
+     *
+     * Unlike set_read_cb(), the received data are passed to a plain function without another
+     * std::function hop, so the per-packet overhead is minimal
+     * @param sink Function to be called on data available, nullptr restores the command callbacks
+     * @param ctx Context passed to the sink
+     */
+    void set_data_sink(data_sink_cb sink, void *ctx);
+
     /**
      * @brief Sets read callback for manual command processing
      * Note that this API also locks the command API, which can only be used
@@ -151,8 +169,64 @@ public:
     {
         command_cb.enhanced_urc_handler = std::move(enhanced_cb);
     }
+
+    /**
+     * @brief Registers a handler of the URC lines starting with the prefix (e.g. "+CMTI", "RING")
+     *
+     * Each complete URC line is dispatched just once. While a line based command (command_lines()) is in progress,
+     * the URC lines are not passed to the command, unless the command solicited them (see UrcRouter::dispatch())
+     * @param prefix URC prefix
+     * @param handler Handler of the URC lines, nullptr removes the current handler
+     */
+    void add_urc_handler(const std::string &prefix, UrcRouter::handler_cb handler);
+
+    /**
+     * @brief Removes the handler of the URC prefix
+     */
+    void remove_urc_handler(const std::string &prefix)
+    {
+        add_urc_handler(prefix, nullptr);
+    }
 #endif
 
+    /**
+     * @brief Changes the baud rate of the primary terminal (the modem has to be switched separately, e.g. by AT+IPR)
+     * @param baud Baud rate to set
+     * @return true on success
+     */
+    bool set_baud_rate(int baud)
+    {
+        return primary_term->set_baud_rate(baud);
+    }
+
+    /**
+     * @brief Reads the statistics of this DTE (transferred bytes, command latencies, buffer usage, CMUX recoveries)
+     * @param s Statistics to fill
+     */
+    void get_stats(dte_stats &s);
+
+    /**
+     * @brief Creates a terminal of another CMUX virtual terminal (DLCI i+1)
+     *
+     * The virtual terminals 0 and 1 are used by this DTE, the others could serve separate traffic
+     * (e.g. GNSS NMEA sentences or URCs) by a DTE of their own. The terminal stops working once
+     * this DTE leaves the CMUX mode.
+     *
+     * @param i Index of the virtual terminal (from 2 to ESP_MODEM_CMUX_TERMINALS - 1)
+     * @return The terminal, or nullptr if not in CMUX mode or the index is out of range
+     */
+    std::unique_ptr<Terminal> create_cmux_terminal(size_t i);
+
+    /**
+     * @brief Asks the device to stop (or resume) sending data on all CMUX virtual terminals
+     *
+     * The device might flow control us, too: writes wait while it doesn't accept data
+     *
+     * @param on false to stop, true to resume
+     * @return false if not in CMUX mode
+     */
+    bool set_rx_flow(bool on);
+
     /**
      * @brief Sets the DTE to desired mode (Command/Data/Cmux)
      * @param m Desired operation mode
@@ -174,6 +248,37 @@ public:
      */
     command_result command(const std::string &command, got_line_cb got_line, uint32_t time_ms, char separator) override;
 
+    /**
+     * @brief Sends the command, but passes each complete line of the reply to the callback just once
+     *
+     * The DTE remembers where the last complete line ended, so the processing cost scales
+     * with the number of received bytes, rather than with the square of the reply length
+     */
+    command_result command_lines(const std::string &command, got_line_cb got_line, uint32_t time_ms, char separator) override;
+
+    /**
+     * @brief Sends the command and passes each complete line to the referenced callback (same as above),
+     * without allocating memory
+     */
+    command_result command_lines(const char *command, size_t len, got_line_ref got_line, uint32_t time_ms, char separator) override;
+
+    /**
+     * @brief Queues the command and returns immediately, the result is reported by a callback
+     *
+     * Queued commands are sent by the DTE command task (created on first use) one at a time, as AT is half-duplex,
+     * in the order of priority and then submission. They share the link with the synchronous command() API,
+     * and each reply is passed only to the got_line callback of the command that is in progress.
+     * @param command String parameter representing command
+     * @param got_line Function to be called after line available as a response
+     * @param time_ms Time in ms to wait for the answer (counted from sending the command)
+     * @param done Function to be called from the command task with OK, FAIL or TIMEOUT
+     * @param priority Commands with higher priority are sent first
+     * @param separator Character treated as a line separator, typically '\n'
+     * @return true if the command was queued
+     */
+    bool command_async(const std::string &command, got_line_cb got_line, uint32_t time_ms, command_done_cb done,
+                       int priority = 0, char separator = '\n');
+
     /**
      * @brief Allows this DTE to recover from a generic connection issue
      *
@@ -206,6 +311,9 @@ private:
     [[nodiscard]] bool setup_cmux();                        /*!< Internal setup of CMUX mode */
     [[nodiscard]] bool exit_cmux();                         /*!< Exit of CMUX mode and cleanup  */
     void exit_cmux_internal();                              /*!< Cleanup CMUX */
+    void queue_task();                                      /*!< Sends the queued commands */
+    void reset_buffer();                                    /*!< Discards the accumulated reply data */
+    command_result command_impl(const char *command, size_t len, got_line_ref got_line, uint32_t time_ms, char separator, bool by_line);
 
 #ifdef CONFIG_ESP_MODEM_URC_HANDLER
     /**
@@ -235,6 +343,26 @@ private:
 #endif
 
     Lock internal_lock{};                                   /*!< Locks DTE operations */
+
+    /**
+     * @brief Live statistics, declared before the terminals so that it outlives them (CMUX updates the counters)
+     */
+    struct stats_counters {
+        transfer_counters command;
+        transfer_counters data;
+        stat_high_water buffer_high_water;
+        stat_high_water inflatable_high_water;
+        stat_counter errors[dte_stats::terminal_errors];
+        cmux_counters cmux;
+        Lock commands_lock{};                               /*!< Locks the command statistics below */
+        latency_histogram latency{};
+        uint32_t sent{};
+        uint32_t timeouts{};
+        size_t command_count{};
+        command_stats per_command[dte_stats::max_commands] {};
+        void add_command(const char *command, size_t len, command_result result, uint32_t ms);
+    } stats;
+
     unique_buffer buffer;                                   /*!< DTE buffer */
     std::shared_ptr<CMux> cmux_term;                        /*!< Primary terminal for this DTE */
     std::shared_ptr<Terminal> primary_term;                 /*!< Reference to the primary terminal (mostly for sending commands) */
@@ -243,34 +371,30 @@ private:
     std::function<bool(uint8_t *data, size_t len)> on_data; /*!< on data callback for current terminal */
     std::function<void(terminal_error err)> user_error_cb;  /*!< user callback on error event from attached terminals */
 
-#ifdef CONFIG_ESP_MODEM_USE_INFLATABLE_BUFFER_IF_NEEDED
     /**
-     * @brief Implements an extra buffer that is used to capture partial reads from underlying terminals
-     * when we run out of the standard buffer
+     * @brief Queue of asynchronous commands, processed by a task created on the first command_async()
      */
-    struct extra_buffer {
-        extra_buffer(): buffer(nullptr) {}
-        ~extra_buffer()
-        {
-            delete buffer;
-        }
-        std::vector<uint8_t> *buffer;
-        size_t consumed{0};
-        void grow(size_t need_size);
-        void deflate()
-        {
-            grow(0);
-            consumed = 0;
-        }
-        [[nodiscard]] uint8_t *begin() const
-        {
-            return &buffer->at(0);
-        }
-        [[nodiscard]] uint8_t *current() const
-        {
-            return &buffer->at(0) + consumed;
-        }
-    } inflatable;
+    struct command_queue {
+        static const size_t PENDING = SignalGroup::bit0;        /*!< Commands are waiting in the queue */
+        static const size_t STOP = SignalGroup::bit1;           /*!< Request to finish the command task */
+        static const size_t EXITED = SignalGroup::bit2;         /*!< The command task has finished */
+        static const size_t PARKED = SignalGroup::bit3;         /*!< Never set, the finished task waits for it until deleted */
+        struct entry {
+            std::string command;
+            got_line_cb got_line;
+            command_done_cb done;
+            uint32_t time_ms;
+            char separator;
+        };
+        std::multimap<int, entry, std::greater<int>> pending;  /*!< Ordered by priority, FIFO within the same priority */
+        SignalGroup signal;                                     /*!< Event group used to control the command task */
+        std::unique_ptr<Task> task;                             /*!< Command task */
+    };
+    Lock queue_lock{};                                      /*!< Locks the command queue (not the DTE) */
+    std::unique_ptr<command_queue> queue;                   /*!< Asynchronous commands, allocated on first use */
+
+#ifdef CONFIG_ESP_MODEM_USE_INFLATABLE_BUFFER_IF_NEEDED
+    ring_buffer inflatable{CONFIG_ESP_MODEM_INFLATABLE_BUFFER_SIZE}; /*!< Captures partial reads from underlying terminals when we run out of the standard buffer */
 #endif // CONFIG_ESP_MODEM_USE_INFLATABLE_BUFFER_IF_NEEDED
 
     /**
@@ -280,22 +404,32 @@ private:
 #ifdef CONFIG_ESP_MODEM_URC_HANDLER
         got_line_cb urc_handler {};                             /*!< URC callback if enabled */
         enhanced_urc_cb enhanced_urc_handler {};                /*!< Enhanced URC callback with consumption control */
+        UrcRouter urc_router {};                                /*!< URC handlers registered per prefix */
+        const char *command {};                                 /*!< Command in progress (to recognize the solicited lines) */
+        size_t command_len {};
+        bool route_lines(uint8_t *data, size_t consumed, size_t len); /*!< Dispatches the new complete URC lines */
 #endif
         static const size_t GOT_LINE = SignalGroup::bit0;       /*!< Bit indicating response available */
-        got_line_cb got_line;                                   /*!< Supplied command callback */
+        got_line_ref got_line;                                  /*!< Supplied command callback (owned by the caller of command()) */
         Lock line_lock{};                                       /*!< Command callback locking mechanism */
         char separator{};                                       /*!< Command reply separator (end of line/processing unit) */
+        bool by_line{};                                         /*!< Pass only the new complete lines to got_line */
+        size_t line_start{};                                    /*!< End of the last complete line passed to got_line (in by_line mode) */
         command_result result{};                                /*!< Command return code */
+        bool stopped{};                                         /*!< The DTE is being destroyed, commands fail at once */
         SignalGroup signal;                                     /*!< Event group used to signal request-response operations */
         bool process_line(uint8_t *data, size_t consumed, size_t len, DTE* dte = nullptr);  /*!< Lets the processing callback handle one line (processing unit) */
         bool wait_for_line(uint32_t time_ms)                    /*!< Waiting for command processing */
         {
             return signal.wait_any(command_cb::GOT_LINE, time_ms);
         }
-        void set(got_line_cb l, char s = '\n')                  /*!< Sets the command callback atomically */
+        bool set(got_line_ref l, char s = '\n', bool lines = false) /*!< Sets the command callback atomically, false if stopped */
         {
             Scoped<Lock> lock(line_lock);
-            if (l) {
+            if (l && stopped) {
+                give_up();
+                return false;
+            } else if (l) {
                 // if we set the line callback, we have to reset the signal and the result
                 signal.clear(GOT_LINE);
                 result = command_result::TIMEOUT;
@@ -305,14 +439,28 @@ private:
                     ESP_MODEM_THROW_IF_ERROR(ESP_ERR_INVALID_STATE);
                 }
             }
-            got_line = std::move(l);
+            got_line = l;
             separator = s;
+            by_line = lines;
+#ifdef CONFIG_ESP_MODEM_URC_HANDLER
+            if (!urc_router.empty()) {
+                return true;    // line_start tracks the routed URC lines, which mustn't be passed again
+            }
+#endif
+            line_start = 0;
+            return true;
         }
         void give_up()                                          /*!< Reports other than timeout error when processing replies (out of buffer) */
         {
             result = command_result::FAIL;
             signal.set(GOT_LINE);
         }
+        void stop()                                             /*!< Fails the command in progress and all the later ones */
+        {
+            Scoped<Lock> lock(line_lock);
+            stopped = true;
+            give_up();
+        }
     } command_cb;                                               /*!< Command callback utility class */
 };
 
@@ -0,0 +1,72 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include "cxx_include/esp_modem_primitives.hpp"
+
+namespace esp_modem {
+
+/**
+ * @brief Queue of data appended by several threads and passed on by one thread at a time
+ *
+ * The first thread finding the queue idle passes the queued data (also the data appended meanwhile
+ * by the other threads) to the output in batches, without holding the lock, so that the output could block.
+ * The data keep the order in which they were appended.
+ */
+class flush_queue {
+public:
+    /**
+     * @brief Passes the data on
+     * @return Number of bytes passed (less than len on failure)
+     */
+    using output_cb = std::function<size_t(uint8_t *data, size_t len)>;
+
+    explicit flush_queue(output_cb output): output(std::move(output)) {}
+
+    /**
+     * @brief Appends the data, hold the lock to append several parts at once
+     */
+    void append(const uint8_t *data, size_t len);
+
+    /**
+     * @brief Stream position of the end of the appended data (bytes appended since creation)
+     */
+    uint64_t end();
+
+    /**
+     * @brief Waits until the passing thread takes the queued data, unless there're fewer than limit bytes
+     * @return false on timeout
+     */
+    bool wait_for_room(size_t limit, uint32_t time_ms);
+
+    /**
+     * @brief Passes the queued data on, unless another thread does
+     *
+     * Failures to pass the data of other threads (outside of from..to) are reported by the next call
+     * of flush() of any thread, as the threads passing their data to another one have returned already.
+     * @param from, to Stream positions of the caller's data
+     * @return false if the caller's data (or data of other threads since the last call) weren't passed
+     */
+    bool flush(uint64_t from = 0, uint64_t to = 0);
+
+    Lock lock;                                  /*!< Guards the queue */
+
+private:
+    output_cb output;
+    std::vector<uint8_t> pending;               /*!< Data waiting to be passed */
+    std::vector<uint8_t> out;                   /*!< Data being passed (swapped with the pending ones) */
+    bool flushing{false};                       /*!< One of the threads is passing the data */
+    bool lost{false};                           /*!< Data of other threads weren't passed, not reported yet */
+    uint64_t taken{0};                          /*!< Stream position of the first pending byte */
+    SignalGroup room;                           /*!< Set when the passing thread takes the pending data */
+};
+
+} // namespace esp_modem
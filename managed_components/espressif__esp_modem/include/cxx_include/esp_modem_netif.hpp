@@ -7,9 +7,12 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
 #include <cstddef>
+#include <cstring>
 #include "esp_netif.h"
 #include "cxx_include/esp_modem_primitives.hpp"
+#include "cxx_include/esp_modem_stats.hpp"
 
 namespace esp_modem {
 
@@ -30,6 +33,116 @@ struct ppp_netif_driver {
 * @{
 */
 
+/**
+ * @brief Counts the PPP frames ending in the received data
+ *
+ * A frame ends at a flag preceded by some data (the flag between two frames is usually shared).
+ * @param in_frame Whether the previous data ended inside a frame, updated for the next data
+ * @return Number of frames ending in the data
+ */
+inline size_t ppp_frames_ended(const uint8_t *data, size_t len, bool &in_frame)
+{
+    size_t frames = 0;
+    const uint8_t *end = data + len;
+    while (data < end) {
+        auto flag = static_cast<const uint8_t *>(memchr(data, 0x7E, end - data));
+        if (flag == nullptr) {
+            in_frame = true;
+            break;
+        }
+        if (flag > data || in_frame) {
+            ++frames;
+        }
+        in_frame = false;
+        data = flag + 1;
+    }
+    return frames;
+}
+
+/**
+ * @brief Coalesces the received chunks of PPP frames, so that the network stack is called once per
+ * frame (or per full batch) instead of once per terminal read
+ *
+ * A chunk completing a frame is passed in place if nothing is batched (no copy), otherwise the chunks
+ * are copied to the batch (allocated on first use) until a frame completes or the batch is full.
+ * Not thread safe, the chunks come from the single reader of the data terminal.
+ */
+class ppp_rx_batch {
+public:
+    using sink_cb = void (*)(void *ctx, uint8_t *data, size_t len);
+
+    /**
+     * @param capacity Size of the batch, 0 to pass every chunk directly
+     * @param sink Receiver of the batched data
+     * @param ctx Context of the sink
+     */
+    ppp_rx_batch(size_t capacity, sink_cb sink, void *ctx): cap(capacity), sink(sink), ctx(ctx) {}
+    ppp_rx_batch(ppp_rx_batch const &) = delete;
+    ppp_rx_batch &operator=(ppp_rx_batch const &) = delete;
+
+    /**
+     * @brief Adds the received chunk, passes it (with the batched data) to the sink if it completes a frame
+     * @param ends The chunk completes a frame (see ppp_frames_ended())
+     */
+    void receive(uint8_t *data, size_t len, bool ends)
+    {
+        if (len == 0) {
+            return;
+        }
+        if (ends && batched == 0) {
+            sink(ctx, data, len);
+            return;
+        }
+        if (len > cap - batched) {
+            flush();
+            if (len > cap) {
+                sink(ctx, data, len);
+                return;
+            }
+        }
+        if (batch == nullptr) {
+            batch.reset(new uint8_t[cap]);
+        }
+        memcpy(batch.get() + batched, data, len);
+        batched += len;
+        if (ends) {
+            flush();
+        }
+    }
+
+    /**
+     * @brief Passes the batched data to the sink
+     */
+    void flush()
+    {
+        if (batched > 0) {
+            size_t len = batched;
+            batched = 0;
+            sink(ctx, batch.get(), len);
+        }
+    }
+
+    /**
+     * @brief Drops the batched data (the unfinished frame of a stopped PPP session)
+     */
+    void clear()
+    {
+        batched = 0;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return batched;
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> batch;
+    size_t cap;
+    size_t batched{0};                                  /*!< Number of batched bytes */
+    sink_cb sink;
+    void *ctx;
+};
+
 /**
  * @brief Network interface class responsible to glue the esp-netif to the modem's DCE
  */
@@ -66,10 +179,59 @@ public:
 
     void receive(uint8_t *data, size_t len);
 
+    /**
+     * @brief Reads the statistics of the network interface (packets and bytes in/out)
+     */
+    void get_stats(netif_stats &s) const
+    {
+        s.packets_in = packets_in.get();
+        s.packets_out = packets_out.get();
+        s.bytes_in = bytes_in.get();
+        s.bytes_out = bytes_out.get();
+    }
+
 private:
 
+    /**
+     * @brief Updates the receive statistics, PPP frames are counted by their closing flags
+     * @return Number of frames ending in the data
+     */
+    size_t count_received(const uint8_t *data, size_t len)
+    {
+        bytes_in.add(len);
+#if defined(CONFIG_ESP_MODEM_USE_PPP_MODE) || defined(CONFIG_IDF_TARGET_LINUX)
+        size_t frames = ppp_frames_ended(data, len, rx_in_frame);
+#else
+        size_t frames = 1;
+#endif
+        if (frames > 0) {
+            packets_in.add(frames);
+        }
+        return frames;
+    }
+
+    void count_sent(size_t len)
+    {
+        packets_out.add();
+        bytes_out.add(len);
+    }
+
     static esp_err_t esp_modem_dte_transmit(void *h, void *buffer, size_t len);
 
+    static void on_data(void *ctx, uint8_t *data, size_t len);
+
+    static void on_frames(void *ctx, uint8_t *data, size_t len);    /*!< Passes the batched frames to the network stack */
+
+    void set_running(bool on)
+    {
+        running.store(on, std::memory_order_release);
+    }
+
+    bool is_running() const
+    {
+        return running.load(std::memory_order_acquire);
+    }
+
     static esp_err_t esp_modem_post_attach(esp_netif_t *esp_netif, void *args);
 
     static void on_ppp_changed(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
@@ -77,8 +239,16 @@ private:
     std::shared_ptr<DTE> ppp_dte;
     struct ppp_netif_driver driver {};
     SignalGroup signal;
-    static const size_t PPP_STARTED = SignalGroup::bit0;
     static const size_t PPP_EXIT = SignalGroup::bit1;
+    std::atomic<bool> running{false};                   /*!< PPP started, gates the transmit path without locking */
+    stat_counter packets_in;
+    stat_counter packets_out;
+    stat_counter bytes_in;
+    stat_counter bytes_out;
+    bool rx_in_frame{false};                            /*!< Received data ended inside a frame */
+#if CONFIG_ESP_MODEM_PPP_RX_BATCH_SIZE > 0
+    ppp_rx_batch rx_batch{CONFIG_ESP_MODEM_PPP_RX_BATCH_SIZE, on_frames, this};
+#endif
 };
 
 /**
@@ -0,0 +1,140 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <functional>
+#include "esp_modem_config.h"
+#include "cxx_include/esp_modem_api.hpp"
+#include "cxx_include/esp_modem_dce_factory.hpp"
+
+namespace esp_modem {
+
+/**
+ * @defgroup ESP_MODEM_POOL
+ * @brief Pool of several modems (DCEs) serving the same kind of work
+ */
+/** @addtogroup ESP_MODEM_POOL
+* @{
+*/
+
+/**
+ * @brief Health of one modem of the pool, as seen by the last check and the recent jobs
+ */
+struct modem_health {
+    bool healthy;                               /*!< The modem is used for new jobs */
+    int rssi;                                   /*!< Signal quality of the last check (99 = unknown) */
+    int ber;                                    /*!< Bit error rate of the last check (99 = unknown) */
+    int registration;                           /*!< Network registration state of the last check (-1 = unknown) */
+    uint32_t load;                              /*!< Jobs assigned to the modem right now */
+    uint32_t jobs;                              /*!< Jobs processed by the modem */
+    uint32_t failures;                          /*!< Consecutive failed jobs */
+};
+
+/**
+ * @brief Dispatches the work to the least loaded healthy modem of the pool
+ *
+ * Each job runs exclusively on one modem. If it fails, it's retried on another modem, so that one bad
+ * SIM card doesn't stall the work, and a modem failing several jobs in a row is taken out of the rotation
+ * until the next health check finds it working. Jobs from several threads run concurrently on different
+ * modems, so the throughput scales with the number of modems.
+ */
+class ModemPool {
+public:
+    /**
+     * @brief Pool configuration
+     */
+    struct config {
+        size_t attempts = 2;                    /*!< Modems to try per job (the first one and the retries) */
+        uint32_t max_failures = 3;              /*!< Consecutive failures marking the modem unhealthy */
+        bool require_registration = false;      /*!< Healthy modems must be registered (home or roaming) */
+    };
+
+    /**
+     * @brief Work to be done on a modem
+     */
+    using job_cb = std::function<command_result(DCE &dce)>;
+
+    ModemPool() = default;
+
+    explicit ModemPool(const config &c): cfg(c) {}
+
+    /**
+     * @brief Adds the modem to the pool (healthy until checked), all modems have to be added before running jobs
+     * @return Index of the modem in the pool
+     */
+    size_t add(std::unique_ptr<DCE> dce);
+
+    /**
+     * @brief Creates the modem with the factory and adds it to the pool
+     * @return Index of the modem in the pool
+     * @throws esp_modem::esp_err_exception if the DCE cannot be created
+     */
+    size_t add(dce_factory::Factory &factory, const dce_factory::config *dce_cfg, std::shared_ptr<DTE> dte, esp_netif_t *netif);
+
+    /**
+     * @brief Number of modems in the pool
+     */
+    size_t size() const
+    {
+        return modems.size();
+    }
+
+    /**
+     * @brief Access to the modem (e.g. for its setup), the caller must not use it concurrently with the pool jobs
+     */
+    DCE &at(size_t index)
+    {
+        return *modems.at(index)->dce;
+    }
+
+    /**
+     * @brief Checks all modems (sync, signal quality and registration) and updates their health
+     * @return Number of healthy modems
+     */
+    size_t check_health();
+
+    /**
+     * @brief Reads the health of the modem
+     */
+    modem_health health(size_t index);
+
+    /**
+     * @brief Runs the job on the least loaded healthy modem, retries it on another modem on failure
+     * @param job Work to be done
+     * @param used Index of the modem which completed the job (or failed last), optional
+     * @return result of the job, FAIL if there's no healthy modem
+     */
+    command_result run(const job_cb &job, size_t *used = nullptr);
+
+    /**
+     * @brief Sends the SMS through the least loaded healthy modem
+     */
+    command_result send_sms(const std::string &number, const std::string &message, size_t *used = nullptr);
+
+private:
+    struct member {
+        size_t index;
+        std::unique_ptr<DCE> dce;
+        Lock busy;                              /*!< Held while running a job or the health check */
+        modem_health health;
+    };
+    member *acquire(std::vector<member *> &tried);
+    void release(member *m, command_result result);
+
+    config cfg;
+    Lock lock;                                  /*!< Protects the modems' health and load */
+    std::vector<std::unique_ptr<member>> modems;
+};
+
+/**
+ * @}
+ */
+
+} // namespace esp_modem
@@ -69,6 +69,7 @@ public:
     static void Delete();
     static void Relinquish();
     static void Delay(uint32_t delay);
+    static uint32_t Now();      // monotonic time in ms (wraps around)
 private:
     TaskT task_handle;
 };
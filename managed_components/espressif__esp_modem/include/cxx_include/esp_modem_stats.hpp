@@ -0,0 +1,215 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace esp_modem {
+
+/**
+ * @defgroup ESP_MODEM_STATS
+ * @brief Runtime statistics of the DTE, CMUX and network interface layers
+ *
+ * The counters are always enabled and cheap enough to be kept in production: the transfer, error and CMUX counters
+ * are updated with relaxed atomic operations, the command statistics (latency, per command) are updated under a lock
+ * once per command, which is taken also by the DTE::get_stats() snapshot only. All counters are totals since creation of the DTE (or Netif) and wrap around at 2^32,
+ * so the consumers publishing them periodically should report the differences between two snapshots.
+ */
+/** @addtogroup ESP_MODEM_STATS
+* @{
+*/
+
+/**
+ * @brief Bytes transferred over one channel
+ */
+struct transfer_stats {
+    uint32_t bytes_in;                          /*!< Received bytes */
+    uint32_t bytes_out;                         /*!< Sent bytes */
+};
+
+/**
+ * @brief Histogram of round-trip times of AT commands (from sending the command to its final reply)
+ *
+ * Buckets are limited (from above, exclusive) by 10, 50, 100, 500, 1000, 5000 and 30000 ms, the last one is unlimited
+ */
+struct latency_histogram {
+    static const size_t buckets = 8;
+    uint32_t count[buckets];                    /*!< Number of replies in each bucket */
+    uint32_t max_ms;                            /*!< The longest round-trip */
+
+    /**
+     * @brief Upper limit of the bucket in ms (UINT32_MAX for the last one)
+     */
+    static uint32_t limit_ms(size_t bucket)
+    {
+        static const uint32_t limits[buckets] = { 10, 50, 100, 500, 1000, 5000, 30000, UINT32_MAX };
+        return limits[bucket < buckets ? bucket : buckets - 1];
+    }
+
+    void add(uint32_t ms)
+    {
+        size_t i = 0;
+        while (i < buckets - 1 && ms >= limit_ms(i)) {
+            ++i;
+        }
+        count[i]++;
+        if (ms > max_ms) {
+            max_ms = ms;
+        }
+    }
+};
+
+/**
+ * @brief Statistics of one AT command, commands are told apart by the text preceding the parameters
+ * (e.g. "AT+CPIN" for both "AT+CPIN?\r" and "AT+CPIN=1234\r")
+ */
+struct command_stats {
+    static const size_t name_len = 16;
+    char name[name_len];                        /*!< Command name (null terminated, possibly truncated) */
+    uint32_t sent;                              /*!< Number of times the command was sent */
+    uint32_t failures;                          /*!< Replies with a fail phrase (e.g. ERROR) */
+    uint32_t timeouts;                          /*!< Commands without a final reply */
+    latency_histogram latency;                  /*!< Round-trip times of the replied commands */
+};
+
+/**
+ * @brief Statistics of the CMUX protocol
+ */
+struct cmux_stats {
+    static const size_t channels = 9;           /*!< Control channel (DLCI 0) and up to 8 virtual terminals */
+    static const size_t recovery_reasons = 7;   /*!< Number of CMux::protocol_mismatch_reason values */
+    transfer_stats dlci[channels];              /*!< Payload bytes per DLCI */
+    uint32_t dropped[channels];                 /*!< Payloads dropped per DLCI, as its dispatch queue was full */
+    uint32_t recoveries[recovery_reasons];      /*!< Protocol restarts indexed by CMux::protocol_mismatch_reason */
+};
+
+/**
+ * @brief Statistics of the DTE
+ */
+struct dte_stats {
+    static const size_t max_commands = 16;      /*!< Commands tracked separately (the rest is accounted to "*") */
+    static const size_t terminal_errors = 4;    /*!< Number of terminal_error values */
+    transfer_stats command;                     /*!< Command channel (the primary terminal, or CMUX command DLCI) */
+    transfer_stats data;                        /*!< Data channel (the secondary terminal, or CMUX data DLCI) */
+    uint32_t buffer_high_water;                 /*!< Most bytes accumulated in the DTE buffer */
+    uint32_t inflatable_high_water;             /*!< Most bytes accumulated in the inflatable buffer */
+    uint32_t errors[terminal_errors];           /*!< Errors reported by terminals, indexed by terminal_error */
+    latency_histogram latency;                  /*!< Round-trip times of all replied commands */
+    uint32_t commands;                          /*!< Number of commands sent */
+    uint32_t timeouts;                          /*!< Number of commands without a final reply */
+    size_t command_count;                       /*!< Number of valid entries in per_command */
+    command_stats per_command[max_commands];    /*!< Statistics per command */
+    cmux_stats cmux;                            /*!< CMUX totals (all CMUX sessions of this DTE) */
+};
+
+/**
+ * @brief Statistics of the PPP network interface
+ */
+struct netif_stats {
+    uint32_t packets_in;                        /*!< Received PPP frames (counted by the closing flags) */
+    uint32_t packets_out;                       /*!< Frames passed to the DTE by the PPP stack */
+    uint32_t bytes_in;                          /*!< Received bytes */
+    uint32_t bytes_out;                         /*!< Sent bytes */
+};
+
+/**
+ * @brief Statistics of the whole modem stack
+ */
+struct modem_stats {
+    dte_stats dte;
+    netif_stats netif;
+};
+
+/**
+ * @brief Monotonic counter, updated with relaxed atomics
+ */
+class stat_counter {
+public:
+    void add(uint32_t n = 1)
+    {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint32_t get() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+private:
+    std::atomic<uint32_t> value{0};
+};
+
+/**
+ * @brief Keeps the highest value seen
+ */
+class stat_high_water {
+public:
+    void update(uint32_t v)
+    {
+        auto current = value.load(std::memory_order_relaxed);
+        while (v > current && !value.compare_exchange_weak(current, v, std::memory_order_relaxed)) {
+        }
+    }
+    uint32_t get() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+private:
+    std::atomic<uint32_t> value{0};
+};
+
+/**
+ * @brief Byte counters of one channel
+ */
+struct transfer_counters {
+    stat_counter bytes_in;
+    stat_counter bytes_out;
+
+    void received(int len)
+    {
+        if (len > 0) {
+            bytes_in.add(len);
+        }
+    }
+    void sent(int len)
+    {
+        if (len > 0) {
+            bytes_out.add(len);
+        }
+    }
+    void get(transfer_stats &s) const
+    {
+        s.bytes_in = bytes_in.get();
+        s.bytes_out = bytes_out.get();
+    }
+};
+
+/**
+ * @brief Live counters of the CMUX protocol
+ */
+struct cmux_counters {
+    transfer_counters dlci[cmux_stats::channels];
+    stat_counter dropped[cmux_stats::channels];
+    stat_counter recoveries[cmux_stats::recovery_reasons];
+
+    void get(cmux_stats &s) const
+    {
+        for (size_t i = 0; i < cmux_stats::channels; ++i) {
+            dlci[i].get(s.dlci[i]);
+            s.dropped[i] = dropped[i].get();
+        }
+        for (size_t i = 0; i < cmux_stats::recovery_reasons; ++i) {
+            s.recoveries[i] = recoveries[i].get();
+        }
+    }
+};
+
+/**
+ * @}
+ */
+
+} // namespace esp_modem
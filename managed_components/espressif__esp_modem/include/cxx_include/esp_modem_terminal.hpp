@@ -73,6 +73,16 @@ public:
 
     virtual void stop() = 0;
 
+    /**
+     * @brief Changes the baud rate of the underlying interface (if applicable)
+     * @param baud Baud rate to set
+     * @return true on success, false if the terminal doesn't support the rate (or changing rates at all)
+     */
+    virtual bool set_baud_rate(int /*baud*/)
+    {
+        return false;
+    }
+
 protected:
     std::function<bool(uint8_t *data, size_t len)> on_read;
     std::function<void(terminal_error)> on_error;
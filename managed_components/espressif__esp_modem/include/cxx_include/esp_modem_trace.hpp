@@ -0,0 +1,181 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include "cxx_include/esp_modem_terminal.hpp"
+#include "cxx_include/esp_modem_flush_queue.hpp"
+
+#if defined(CONFIG_IDF_TARGET_LINUX)
+#include <thread>
+#include <condition_variable>
+#endif
+
+namespace esp_modem {
+
+/**
+ * @defgroup ESP_MODEM_TRACE
+ * @brief Recording of the terminal traffic and its replay
+ *
+ * The trace is a compact binary stream:
+ * - header: "EMTR" followed by the format version (1)
+ * - records: varint(time since the previous record in us), varint(length << 1 | direction), payload
+ *   where the direction is 0 for data received from the device and 1 for data sent to the device
+ *   (varints are little endian base 128, as in protobuf)
+ */
+/** @addtogroup ESP_MODEM_TRACE
+* @{
+*/
+
+/**
+ * @brief One record of the trace
+ */
+struct trace_record {
+    uint64_t time_us;                           /*!< Time since the start of the recording */
+    bool sent;                                  /*!< Data sent to the device (false: received) */
+    const uint8_t *data;                        /*!< Payload (points into the trace) */
+    size_t len;                                 /*!< Payload length */
+};
+
+/**
+ * @brief Iterates over the records of a trace
+ */
+class TraceReader {
+public:
+    TraceReader(const uint8_t *trace, size_t len);
+
+    /**
+     * @brief Checks the trace header
+     */
+    bool valid() const
+    {
+        return pos != 0;
+    }
+
+    /**
+     * @brief Reads the next record
+     * @return false at the end of the trace (or if it's truncated)
+     */
+    bool next(trace_record &record);
+
+private:
+    const uint8_t *trace;
+    size_t len;
+    size_t pos;
+    uint64_t time_us{0};
+};
+
+/**
+ * @brief Terminal decorator recording all data read from and written to the underlying terminal
+ *
+ * The encoded trace is passed in chunks to the sink (e.g. to be written to a file or kept in memory).
+ * Writes are recorded before they're passed down, so that the replies always follow their commands.
+ */
+class RecordingTerminal : public Terminal {
+public:
+    /**
+     * @brief Receives the encoded trace
+     */
+    using sink_cb = std::function<void(const uint8_t *data, size_t len)>;
+
+    RecordingTerminal(std::unique_ptr<Terminal> term, sink_cb sink);
+
+    int write(uint8_t *data, size_t len) override;
+
+    int read(uint8_t *data, size_t len) override;
+
+    void set_read_cb(std::function<bool(uint8_t *data, size_t len)> f) override;
+
+    void start() override
+    {
+        term->start();
+    }
+
+    void stop() override
+    {
+        term->stop();
+    }
+
+    bool set_baud_rate(int baud) override
+    {
+        return term->set_baud_rate(baud);
+    }
+
+private:
+    void record(bool sent, const uint8_t *data, size_t len);
+
+    std::unique_ptr<Terminal> term;
+    sink_cb sink;
+    uint64_t last_us;
+    flush_queue records;                        /*!< Records come from the reading and the writing threads */
+};
+
+#if defined(CONFIG_IDF_TARGET_LINUX)
+/**
+ * @brief Terminal replaying the received data of a trace
+ *
+ * The replay follows the DTE: the data received after a write are fed only once the DTE writes
+ * at least as many bytes as recorded, so that the replies don't come before the commands.
+ * The data are fed either as fast as possible or in real time (keeping the recorded timing),
+ * the replay begins with start() (again from the beginning after stop() or the end of the replay).
+ */
+class ReplayTerminal : public Terminal {
+public:
+    explicit ReplayTerminal(std::vector<uint8_t> trace, bool real_time = false);
+
+    ~ReplayTerminal() override;
+
+    int write(uint8_t *data, size_t len) override;
+
+    int read(uint8_t *data, size_t len) override;
+
+    void set_read_cb(std::function<bool(uint8_t *data, size_t len)> f) override;
+
+    void start() override;
+
+    void stop() override;
+
+    /**
+     * @brief Checks the trace header
+     */
+    bool valid() const
+    {
+        return TraceReader(trace.data(), trace.size()).valid();
+    }
+
+    /**
+     * @brief Waits until all records are replayed
+     * @return true if the replay finished
+     */
+    bool wait_for_end(uint32_t time_ms);
+
+private:
+    void replay(unsigned run);
+
+    std::vector<uint8_t> trace;
+    bool real_time;
+    std::mutex m;
+    std::condition_variable notify;
+    std::vector<uint8_t> pending;               /*!< Fed data not yet read by the DTE */
+    size_t written{0};                          /*!< Bytes written by the DTE */
+    bool running{false};
+    bool finished{false};
+    unsigned generation{0};                     /*!< Identifies the current replay thread */
+    std::thread thread;
+    std::thread retired;                        /*!< Thread which started the current one from its read callback */
+};
+#endif // CONFIG_IDF_TARGET_LINUX
+
+/**
+ * @}
+ */
+
+} // namespace esp_modem
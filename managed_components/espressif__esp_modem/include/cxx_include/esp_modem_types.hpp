@@ -6,8 +6,11 @@
 
 #pragma once
 
+#include <cstring>
 #include <functional>
 #include <string>
+#include <type_traits>
+#include <vector>
 #include <cstddef>
 #include <cstdint>
 
@@ -61,6 +64,49 @@ enum class command_result {
 
 typedef std::function<command_result(uint8_t *data, size_t len)> got_line_cb;
 
+typedef std::function<void(command_result result)> command_done_cb;
+
+/**
+ * @brief Non-owning reference to a line callback (a lightweight alternative to got_line_cb)
+ *
+ * Refers to a callable object without copying it, so it never allocates. The referenced
+ * object must outlive the command which uses this reference, so only named objects (lvalues)
+ * are accepted, not temporaries.
+ */
+class got_line_ref {
+public:
+    got_line_ref() = default;
+    got_line_ref(std::nullptr_t) {}
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, got_line_ref>::value>::type>
+    got_line_ref(F &f): obj(const_cast<void *>(static_cast<const void *>(&f))), call(&invoke<F>) {}
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, got_line_ref>::value &&
+                                                             !std::is_lvalue_reference<F>::value>::type>
+    got_line_ref(F &&f) = delete;
+    command_result operator()(uint8_t *data, size_t len) const
+    {
+        return call(obj, data, len);
+    }
+    explicit operator bool() const
+    {
+        return call != nullptr;
+    }
+private:
+    template <typename F> static command_result invoke(void *obj, uint8_t *data, size_t len)
+    {
+        return (*static_cast<F *>(obj))(data, len);
+    }
+    void *obj{nullptr};
+    command_result (*call)(void *obj, uint8_t *data, size_t len) {nullptr};
+};
+
+/**
+ * @brief Reply to one command of a batch (see dce_commands::at_batch())
+ */
+struct command_reply {
+    command_result result{command_result::TIMEOUT};     /*!< Result of this command, TIMEOUT if it hasn't been executed */
+    std::string out;                                    /*!< Information response lines of this command */
+};
+
 /**
  * @brief PDP context used for configuring and setting the data mode up
  */
@@ -93,6 +139,53 @@ public:
     virtual command_result command(const std::string &command, got_line_cb got_line, uint32_t time_ms, const char separator) = 0;
     virtual command_result command(const std::string &command, got_line_cb got_line, uint32_t time_ms) = 0;
 
+    /**
+     * @brief Sends custom AT command, but the callback receives each complete line of the reply just once
+     * (unlike command(), which passes the entire reply accumulated so far)
+     *
+     * The default implementation splits the replies of command(), DTE implements it natively
+     * @param command Command to be sent
+     * @param got_line callback called for every complete line (including the separator)
+     * @param time_ms timeout in milliseconds
+     * @param separator Character treated as a line separator, typically '\n'
+     * @return OK, FAIL or TIMEOUT
+     */
+    virtual command_result command_lines(const std::string &command, got_line_cb got_line, uint32_t time_ms, const char separator)
+    {
+        size_t line_start = 0;
+        return this->command(command, [&](uint8_t *data, size_t len) {
+            if (line_start > len) {
+                line_start = 0; // the reply is not accumulated, started over
+            }
+            while (auto end = static_cast<uint8_t *>(memchr(data + line_start, separator, len - line_start))) {
+                size_t line_end = end - data + 1;
+                auto res = got_line(data + line_start, line_end - line_start);
+                line_start = line_end;
+                if (res != command_result::TIMEOUT) {
+                    return res;
+                }
+            }
+            return command_result::TIMEOUT;
+        }, time_ms, separator);
+    }
+
+    /**
+     * @brief Sends custom AT command (same as command_lines() above), but without allocating memory
+     *
+     * Used by the library for frequently issued commands, the default implementation
+     * falls back to command_lines() with an owned copy of the command and the callback
+     * @param command Command to be sent (not necessarily null-terminated)
+     * @param len Length of the command
+     * @param got_line Reference to the callback called for every complete line
+     * @param time_ms timeout in milliseconds
+     * @param separator Character treated as a line separator, typically '\n'
+     * @return OK, FAIL or TIMEOUT
+     */
+    virtual command_result command_lines(const char *command, size_t len, got_line_ref got_line, uint32_t time_ms, const char separator)
+    {
+        return command_lines(std::string(command, len), got_line, time_ms, separator);
+    }
+
     virtual int write(uint8_t *data, size_t len) = 0;
     virtual void on_read(got_line_cb on_data) = 0;
 };
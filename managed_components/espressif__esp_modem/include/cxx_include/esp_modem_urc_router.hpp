@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace esp_modem {
+
+/**
+ * @defgroup ESP_MODEM_URC_ROUTER
+ * @brief Dispatching of unsolicited result codes to handlers registered per prefix
+ */
+/** @addtogroup ESP_MODEM_URC_ROUTER
+* @{
+*/
+
+/**
+ * @brief Routes complete URC lines (e.g. "+CMTI: \"SM\",3") to the handlers registered for their prefixes
+ *
+ * Prefixes are kept in a trie, so that a line is matched in a single pass regardless of the number of
+ * registered handlers. If more prefixes match a line, the longest one wins.
+ */
+class UrcRouter {
+public:
+    /**
+     * @brief URC handler, receives the complete line including the line terminator
+     */
+    typedef std::function<void(uint8_t *line, size_t len)> handler_cb;
+
+    /**
+     * @brief Registers (or replaces) the handler for lines starting with the prefix
+     * @param prefix URC prefix, e.g. "+CREG", "RING", "NO CARRIER"
+     * @param handler Handler to call, nullptr removes the current handler
+     */
+    void add(const std::string &prefix, handler_cb handler);
+
+    /**
+     * @brief Removes the handler of the prefix
+     */
+    void remove(const std::string &prefix)
+    {
+        add(prefix, nullptr);
+    }
+
+    /**
+     * @brief Checks if there's any handler registered
+     */
+    bool empty() const
+    {
+        return handlers.empty();
+    }
+
+    /**
+     * @brief Dispatches the line to the handler of its longest matching prefix
+     *
+     * Lines which reply to the issued command (the command contains the prefix without the trailing colon,
+     * e.g. "+CREG: 0,1" replying to "AT+CREG?") are not treated as URCs.
+     * @param line Complete line, leading CR/LF characters are ignored
+     * @param len Length of the line
+     * @param command Command in progress (or nullptr)
+     * @param command_len Length of the command
+     * @return true if the line was dispatched as an URC
+     */
+    bool dispatch(uint8_t *line, size_t len, const char *command = nullptr, size_t command_len = 0) const;
+
+private:
+    static const uint16_t none = 0;             /*!< Terminates the child lists (the root is nobody's child) */
+    struct node {
+        char c;                                 /*!< Character of the edge leading to this node */
+        uint16_t first_child;
+        uint16_t next_sibling;
+        int handler;                            /*!< Index of the handler ending at this node, or -1 */
+    };
+    struct entry {
+        std::string prefix;
+        handler_cb handler;
+    };
+    uint16_t child(uint16_t parent, char c) const;
+    void insert(const std::string &prefix, int handler);
+    bool solicited(const std::string &prefix, const char *command, size_t command_len) const;
+
+    std::vector<node> trie{node{0, none, none, -1}};   /*!< Prefix trie, root at index 0 */
+    std::vector<entry> handlers;                /*!< Registered handlers (indexed by the trie nodes) */
+};
+
+/**
+ * @}
+ */
+
+} // namespace esp_modem
@@ -80,6 +80,33 @@ typedef enum esp_modem_terminal_error {
  */
 typedef void (*esp_modem_terminal_error_cbt)(esp_modem_terminal_error_t);
 
+/**
+ * @brief Modem statistics (totals since creation of the DCE, wrapping around at 2^32)
+ */
+typedef struct esp_modem_stats {
+    uint32_t command_bytes_in;          /**< Bytes received on the command channel */
+    uint32_t command_bytes_out;         /**< Bytes sent on the command channel */
+    uint32_t data_bytes_in;             /**< Bytes received on the data channel */
+    uint32_t data_bytes_out;            /**< Bytes sent on the data channel */
+    uint32_t dlci_bytes_in[9];          /**< CMUX payload bytes received per DLCI */
+    uint32_t dlci_bytes_out[9];         /**< CMUX payload bytes sent per DLCI */
+    uint32_t dlci_dropped[9];           /**< CMUX payloads dropped per DLCI (full dispatch queue) */
+    uint32_t cmux_recoveries[7];        /**< CMUX protocol restarts per reason (missed leading SOF, missed trailing SOF,
+                                             wrong CRC, unexpected header, unexpected data, read behind buffer, unknown) */
+    uint32_t buffer_high_water;         /**< Most bytes accumulated in the DTE buffer */
+    uint32_t inflatable_high_water;     /**< Most bytes accumulated in the inflatable buffer */
+    uint32_t terminal_errors[4];        /**< Terminal errors indexed by esp_modem_terminal_error_t */
+    uint32_t commands;                  /**< AT commands sent */
+    uint32_t command_timeouts;          /**< AT commands without a final reply */
+    uint32_t latency_histogram[8];      /**< Round-trip times of AT commands: <10, <50, <100, <500, <1000, <5000,
+                                             <30000 and >=30000 ms */
+    uint32_t latency_max_ms;            /**< The longest round-trip time of an AT command */
+    uint32_t ppp_packets_in;            /**< PPP frames received */
+    uint32_t ppp_packets_out;           /**< PPP frames sent */
+    uint32_t ppp_bytes_in;              /**< PPP bytes received */
+    uint32_t ppp_bytes_out;             /**< PPP bytes sent */
+} esp_modem_stats_t;
+
 /**
  * @brief Create a generic DCE handle for new modem API
  *
@@ -139,6 +166,36 @@ esp_err_t esp_modem_set_mode(esp_modem_dce_t *dce, esp_modem_dce_mode_t mode);
 
 esp_err_t esp_modem_command(esp_modem_dce_t *dce, const char *command, esp_err_t(*got_line_cb)(uint8_t *data, size_t len), uint32_t timeout_ms);
 
+/**
+ * @brief Sends several AT commands chained on one command line (one round trip instead of one per command)
+ *
+ * If the line fails, the commands are repeated one by one to find the failing one,
+ * so use it only for commands which could be safely repeated (e.g. configuration)
+ *
+ * @param dce Modem DCE handle
+ * @param cmds Array of commands, with or without the "AT" prefix
+ * @param count Number of commands
+ * @param results Optional array of `count` results (ESP_OK, ESP_FAIL, or ESP_ERR_TIMEOUT if not executed)
+ * @param timeout_ms Timeout of each command (a line of N commands waits up to N times as long)
+ * @return ESP_OK if all commands passed
+ */
+esp_err_t esp_modem_at_batch(esp_modem_dce_t *dce, const char *const *cmds, size_t count, esp_err_t *results, uint32_t timeout_ms);
+
+/**
+ * @brief Negotiates the highest baud rate supported by both the modem and the UART
+ *
+ * The modem is looked up at the current rate, or at any of the candidates (if a negotiated rate has been persisted),
+ * then the candidates are tried from the highest one and verified, falling back to the previous rate on error.
+ *
+ * @param dce Modem DCE handle
+ * @param rates Candidate baud rates, e.g. 3000000, 921600, 460800
+ * @param count Number of the candidate rates
+ * @param persist true to store the negotiated rate to the modem profile (AT&W)
+ * @param[in,out] baud Current baud rate, updated with the negotiated one
+ * @return ESP_OK if the modem is in sync at the (possibly unchanged) baud rate, ESP_FAIL or ESP_ERR_TIMEOUT otherwise
+ */
+esp_err_t esp_modem_negotiate_baud(esp_modem_dce_t *dce, const int *rates, size_t count, bool persist, int *baud);
+
 /**
  * @brief Sets the APN and configures it into the modem's PDP context
  *
@@ -161,6 +218,22 @@ esp_err_t esp_modem_set_apn(esp_modem_dce_t *dce, const char *apn);
  * @return ESP_OK on success, ESP_FAIL on failure
  */
 esp_err_t esp_modem_set_urc(esp_modem_dce_t *dce, esp_err_t(*got_line_cb)(uint8_t *data, size_t len));
+
+/**
+ * @brief Adds a handler of the URC lines starting with the given prefix
+ *
+ * Each complete URC line (e.g. "+CMTI: \"SM\",3") is dispatched to the handler of its longest
+ * matching prefix just once. While a command is in progress, the URC lines are not passed to the command,
+ * unless they reply to it (e.g. "+CREG: 0,1" to "AT+CREG?").
+ *
+ * @param dce Modem DCE handle
+ * @param prefix URC prefix, e.g. "+CMTI", "RING", "NO CARRIER"
+ * @param handler Function called with each complete URC line, NULL removes the current handler
+ * @param ctx User context passed to the handler
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on invalid arguments
+ */
+esp_err_t esp_modem_add_urc_handler(esp_modem_dce_t *dce, const char *prefix,
+                                    void(*handler)(uint8_t *line, size_t len, void *ctx), void *ctx);
 #endif
 
 esp_err_t esp_modem_sqn_gm02s_connect(esp_modem_dce_t *dce, const esp_modem_PdpContext_t *pdp_context);
@@ -177,6 +250,18 @@ esp_err_t esp_modem_sqn_gm02s_connect(esp_modem_dce_t *dce, const esp_modem_PdpC
 esp_err_t esp_modem_pause_net(esp_modem_dce_t *dce, bool pause);
 
 esp_modem_dce_mode_t esp_modem_get_mode(esp_modem_dce_t *dce);
+
+/**
+ * @brief Reads the statistics of the modem (transferred bytes, AT command latencies, buffer usage, CMUX recoveries)
+ *
+ * The counters are cheap to update, so they're always enabled. Statistics per AT command are available in C++ API,
+ * see DCE::get_stats()
+ *
+ * @param dce Modem DCE handle
+ * @param stats Statistics to fill
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on invalid arguments
+ */
+esp_err_t esp_modem_get_stats(esp_modem_dce_t *dce, esp_modem_stats_t *stats);
 /**
  * @}
  */
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #define ESP_MODEM_VFS_DEFAULT_UART_CONFIG(name)  {  \
         .dev_name = (name), \
         .uart = {               \
@@ -34,6 +36,19 @@ struct esp_modem_vfs_uart_creator {
     struct esp_modem_uart_term_config uart;     /*!< UART driver init struct */
 };
 
+/**
+ * @brief Line statistics of a UART, totals since the port was opened
+ */
+struct esp_modem_uart_counters {
+    uint32_t rx;                                /*!< Received bytes */
+    uint32_t tx;                                /*!< Transmitted bytes */
+    uint32_t frame;                             /*!< Framing errors */
+    uint32_t parity;                            /*!< Parity errors */
+    uint32_t overrun;                           /*!< Hardware FIFO overruns */
+    uint32_t buf_overrun;                       /*!< Driver buffer overruns */
+    uint32_t brk;                               /*!< Received breaks */
+};
+
 /**
  * @brief UART init struct for VFS
  */
@@ -59,3 +74,13 @@ bool vfs_create_socket(struct esp_modem_vfs_socket_creator *config, struct esp_m
  * @return true on success
  */
 bool vfs_create_uart(struct esp_modem_vfs_uart_creator *config, struct esp_modem_vfs_term_config *created_config);
+
+/**
+ * @brief Reads the line statistics of a uart VFS (created by vfs_create_uart())
+ *
+ * Rising overrun counters indicate that the baud rate is too high for the host or that hardware flow control is needed
+ * @param config VFS portion of the DTE config
+ * @param counters Counters to fill
+ * @return true on success, false if not supported by the platform or the device
+ */
+bool vfs_uart_get_counters(const struct esp_modem_vfs_term_config *config, struct esp_modem_uart_counters *counters);
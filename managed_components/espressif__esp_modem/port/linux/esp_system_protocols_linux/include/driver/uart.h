@@ -19,3 +19,24 @@ typedef int uart_word_length_t;
 typedef int uart_stop_bits_t;
 typedef int uart_parity_t;
 typedef int uart_sclk_t;
+
+// Same values as the ESP-IDF UART driver, so that the configs could be shared with the target
+#define UART_NUM_0              (0)
+#define UART_NUM_1              (1)
+#define UART_NUM_2              (2)
+
+#define UART_DATA_5_BITS        (0)
+#define UART_DATA_6_BITS        (1)
+#define UART_DATA_7_BITS        (2)
+#define UART_DATA_8_BITS        (3)
+
+#define UART_STOP_BITS_1        (1)
+#define UART_STOP_BITS_1_5      (2)
+#define UART_STOP_BITS_2        (3)
+
+#define UART_PARITY_DISABLE     (0)
+#define UART_PARITY_EVEN        (2)
+#define UART_PARITY_ODD         (3)
+
+#define UART_SCLK_DEFAULT       (0)
+#define UART_SCLK_APB           UART_SCLK_DEFAULT
@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <cstdint>
+
+namespace esp_modem {
+
+/**
+ * @brief Receiver of the readiness notifications of the Reactor
+ */
+class ReactorClient {
+public:
+    virtual ~ReactorClient() = default;
+
+    /**
+     * @brief Called from the reactor thread when the file descriptor becomes readable (or fails)
+     *
+     * The notifications are one-shot (but level triggered), so the client calls Reactor::rearm() to get
+     * notified again, and gets notified at once if it left some data unread.
+     */
+    virtual void on_readable() = 0;
+};
+
+/**
+ * @brief Single thread epoll loop serving all file descriptor terminals on Linux
+ *
+ * The reactor is shared by all clients and exists as long as there's at least one client holding it,
+ * so that a gateway with many modems needs just one thread, which sleeps in epoll_wait() until some
+ * descriptor gets readable (or an eventfd wakes it up to exit).
+ * The clients' callbacks run in the reactor thread, so they must not block.
+ */
+class Reactor {
+public:
+    /**
+     * @brief Returns the shared reactor, creates it (and starts its thread) if there's none
+     */
+    static std::shared_ptr<Reactor> get();
+
+    ~Reactor();
+
+    /**
+     * @brief Starts watching the (non-blocking) descriptor
+     * @return Registration id, 0 if the descriptor cannot be polled
+     */
+    uint64_t add(int fd, ReactorClient *client);
+
+    /**
+     * @brief Stops watching the descriptor, waits for the client's callback to finish if it's running
+     */
+    void remove(uint64_t id, int fd);
+
+    /**
+     * @brief Re-arms the one-shot notification, i.e. the client gets notified if the descriptor
+     * is readable right now or as soon as it gets readable
+     */
+    bool rearm(uint64_t id, int fd);
+
+private:
+    Reactor();
+    void run();
+
+    struct FileDescriptor {
+        int fd;
+        ~FileDescriptor();
+    };
+
+    static const uint64_t wakeup_id = UINT64_MAX;
+    FileDescriptor epoll;
+    FileDescriptor wakeup;                              /*!< eventfd to interrupt epoll_wait() */
+    std::atomic<bool> exiting{false};
+    std::mutex clients_lock;
+    std::condition_variable dispatched;
+    std::unordered_map<uint64_t, ReactorClient *> clients;
+    uint64_t next_id{1};
+    uint64_t current{0};                                /*!< Client being dispatched */
+    std::thread::id reactor_thread;
+    bool *destroyed{nullptr};                           /*!< Set if the reactor gets destroyed from a callback */
+    std::thread thread;                                 /*!< Keep it last, starts after the members are initialized */
+};
+
+} // namespace esp_modem
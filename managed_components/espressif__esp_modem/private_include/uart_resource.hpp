@@ -8,6 +8,7 @@
 
 #include "cxx_include/esp_modem_dte.hpp"
 #include "esp_modem_config.h"
+#include "vfs_resource/vfs_create.hpp"
 
 struct esp_modem_uart_term_config;
 
@@ -24,5 +25,19 @@ struct uart_resource {
     uart_port_t port{};
 };
 
+#if defined(CONFIG_IDF_TARGET_LINUX)
+/**
+ * @brief Changes the baud rate of an open serial port, also to non-standard rates
+ * @return true on success
+ */
+bool uart_set_baud_rate(int fd, int baud);
+
+/**
+ * @brief Reads the line error counters of an open serial port
+ * @return false if the device doesn't provide the counters
+ */
+bool uart_get_counters(int fd, esp_modem_uart_counters *counters);
+#endif
+
 
 }  // namespace esp_modem
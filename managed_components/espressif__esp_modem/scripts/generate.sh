@@ -5,7 +5,8 @@ default_files=("generate/include/cxx_include/esp_modem_command_library.hpp"
                "generate/include/cxx_include/esp_modem_dce_module.hpp"
                "generate/include/cxx_include/esp_modem_dce_generic.hpp"
                "generate/src/esp_modem_modules.cpp"
-               "generate/include/esp_modem_api.h")
+               "generate/include/esp_modem_api.h"
+               "generate/include/cxx17_include/esp_modem_command_table.hpp")
 
 # Set the processing directory (defaults to the script's location/..)
 script_dir="$(dirname "$(realpath "$0")")"
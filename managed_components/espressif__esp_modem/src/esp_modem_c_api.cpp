@@ -553,6 +553,67 @@ extern "C" esp_err_t esp_modem_command(esp_modem_dce_t *dce_wrap, const char *co
     }, timeout_ms));
 }
 
+extern "C" esp_err_t esp_modem_at_batch(esp_modem_dce_t *dce_wrap, const char *const *cmds, size_t count, esp_err_t *results, uint32_t timeout_ms)
+{
+    if (dce_wrap == nullptr || dce_wrap->dce == nullptr || cmds == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::vector<std::string> commands(cmds, cmds + count);
+    std::vector<command_reply> replies;
+    auto ret = command_response_to_esp_err(dce_wrap->dce->at_batch(commands, replies, timeout_ms));
+    if (results != nullptr) {
+        for (size_t i = 0; i < count; ++i) {
+            results[i] = command_response_to_esp_err(replies[i].result);
+        }
+    }
+    return ret;
+}
+
+extern "C" esp_err_t esp_modem_negotiate_baud(esp_modem_dce_t *dce_wrap, const int *rates, size_t count, bool persist, int *baud)
+{
+    if (dce_wrap == nullptr || dce_wrap->dce == nullptr || rates == nullptr || baud == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::vector<int> candidates(rates, rates + count);
+    return command_response_to_esp_err(dce_wrap->dce->negotiate_baud(candidates, *baud, persist));
+}
+
+extern "C" esp_err_t esp_modem_get_stats(esp_modem_dce_t *dce_wrap, esp_modem_stats_t *stats)
+{
+    if (dce_wrap == nullptr || dce_wrap->dce == nullptr || stats == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto s = std::unique_ptr<modem_stats>(new modem_stats());   // rather large to be kept on stack
+    dce_wrap->dce->get_stats(*s);
+    auto &dte = s->dte;
+    stats->command_bytes_in = dte.command.bytes_in;
+    stats->command_bytes_out = dte.command.bytes_out;
+    stats->data_bytes_in = dte.data.bytes_in;
+    stats->data_bytes_out = dte.data.bytes_out;
+    static_assert(sizeof(stats->dlci_bytes_in) / sizeof(uint32_t) == cmux_stats::channels, "CMUX channels mismatch");
+    for (size_t i = 0; i < cmux_stats::channels; ++i) {
+        stats->dlci_bytes_in[i] = dte.cmux.dlci[i].bytes_in;
+        stats->dlci_bytes_out[i] = dte.cmux.dlci[i].bytes_out;
+        stats->dlci_dropped[i] = dte.cmux.dropped[i];
+    }
+    static_assert(sizeof(stats->cmux_recoveries) == sizeof(dte.cmux.recoveries), "CMUX recovery reasons mismatch");
+    memcpy(stats->cmux_recoveries, dte.cmux.recoveries, sizeof(stats->cmux_recoveries));
+    stats->buffer_high_water = dte.buffer_high_water;
+    stats->inflatable_high_water = dte.inflatable_high_water;
+    static_assert(sizeof(stats->terminal_errors) == sizeof(dte.errors), "Terminal errors mismatch");
+    memcpy(stats->terminal_errors, dte.errors, sizeof(stats->terminal_errors));
+    stats->commands = dte.commands;
+    stats->command_timeouts = dte.timeouts;
+    static_assert(sizeof(stats->latency_histogram) == sizeof(dte.latency.count), "Latency buckets mismatch");
+    memcpy(stats->latency_histogram, dte.latency.count, sizeof(stats->latency_histogram));
+    stats->latency_max_ms = dte.latency.max_ms;
+    stats->ppp_packets_in = s->netif.packets_in;
+    stats->ppp_packets_out = s->netif.packets_out;
+    stats->ppp_bytes_in = s->netif.bytes_in;
+    stats->ppp_bytes_out = s->netif.bytes_out;
+    return ESP_OK;
+}
+
 extern "C" esp_err_t esp_modem_set_baud(esp_modem_dce_t *dce_wrap, int baud)
 {
     return command_response_to_esp_err(dce_wrap->dce->set_baud(baud));
@@ -587,6 +648,22 @@ extern "C" esp_err_t esp_modem_set_urc(esp_modem_dce_t *dce_wrap, esp_err_t(*got
     });
     return ESP_OK;
 }
+
+extern "C" esp_err_t esp_modem_add_urc_handler(esp_modem_dce_t *dce_wrap, const char *prefix,
+        void(*handler)(uint8_t *line, size_t len, void *ctx), void *ctx)
+{
+    if (dce_wrap == nullptr || dce_wrap->dce == nullptr || prefix == nullptr || *prefix == '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handler == nullptr) {
+        dce_wrap->dce->remove_urc_handler(prefix);
+        return ESP_OK;
+    }
+    dce_wrap->dce->add_urc_handler(prefix, [handler, ctx](uint8_t *line, size_t len) {
+        handler(line, len, ctx);
+    });
+    return ESP_OK;
+}
 #endif
 
 extern "C" esp_err_t esp_modem_pause_net(esp_modem_dce_t *dce_wrap, bool pause)
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <algorithm>
 #include <cstring>
 #include <unistd.h>
 #include <cxx_include/esp_modem_cmux.hpp>
@@ -28,6 +29,14 @@ using namespace esp_modem;
 #define DEFRAGMENT_CMUX_PAYLOAD
 #endif
 
+#if CONFIG_ESP_MODEM_CMUX_DISPATCH_QUEUE_SIZE > 0
+/**
+ * @brief Define this to pass the payloads to the virtual terminals from their own tasks
+ *        so that a slow reader doesn't hold up the others (nor the CMUX receive path)
+ */
+#define DISPATCH_CMUX_PAYLOAD
+#endif
+
 #define EA 0x01  /* Extension bit      */
 #define CR 0x02  /* Command / Response */
 #define PF 0x10  /* Poll / Final       */
@@ -56,26 +65,120 @@ using namespace esp_modem;
 #define CMD_SNC    0x68  /* Service Negotiation Command              */
 #define CMD_MSC    0x70  /* Modem Status Command                     */
 
+/* V.24 signals of the MSC command */
+#define FC  0x02 /* Flow Control       */
+#define RTC 0x04 /* Ready To Communicate */
+#define RTR 0x08 /* Ready To Receive   */
+#define DV  0x80 /* Data Valid         */
+
 /* Flag sequence field between messages (start of frame) */
 #define SOF_MARKER 0xF9
 
-uint8_t CMux::fcs_crc(const uint8_t frame[6])
+/* Frame size (N1) used unless negotiated, the largest one with 1 byte length */
+#define DEFAULT_FRAME_SIZE 127
+
+#if CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE > DEFAULT_FRAME_SIZE && !defined(ESP_MODEM_CMUX_USE_SHORT_PAYLOADS_ONLY)
+/**
+ * @brief Negotiate larger frames with the PN command (the modem could accept or lower the size)
+ */
+#define NEGOTIATE_FRAME_SIZE
+static const size_t max_frame_size = CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE;
+#else
+static const size_t max_frame_size = std::min(CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE, DEFAULT_FRAME_SIZE);
+#endif
+
+static const uint32_t flow_control_timeout_ms = 5000;  // writers wait for the flow to resume, then give up
+static const uint32_t handshake_timeout_ms = 1000;     // waiting for the device to acknowledge SABM or DISC
+static const uint32_t negotiation_timeout_ms = 300;    // waiting for the PN replies, then using the default frame size
+static const uint32_t tx_queue_timeout_ms = 5000;      // writers wait for the writing thread to take the queued frames, then give up
+static const size_t tx_pending_limit = 4 * (max_frame_size + 7);   // frames queued while another thread writes
+
+/**
+ * @brief Bits of the handshake signal group: acknowledgements of DLCIs first..last
+ */
+static uint32_t ack_bits(size_t first, size_t last)
 {
-    //    #define FCS_GOOD_VALUE 0xCF
-    uint8_t crc = 0xFF; // FCS_INIT_VALUE
+    return ((1 << (last + 1)) - 1) & ~((1 << first) - 1);
+}
 
-    for (int i = 1; i < 4; i++) {
-        crc ^= frame[i];
+/**
+ * @brief Bits of the handshake signal group: PN replies for DLCIs first..last
+ */
+static uint32_t pn_bits(size_t first, size_t last)
+{
+    return ack_bits(first, last) << (MAX_TERMINALS_NUM + 1);
+}
+
+#ifdef DISPATCH_CMUX_PAYLOAD
+static const size_t dispatch_queue_size = CONFIG_ESP_MODEM_CMUX_DISPATCH_QUEUE_SIZE;
+static const size_t dispatch_task_stack_size = 4096;
+
+/**
+ * @brief Payloads queued for the read callback of one virtual terminal, passed by its own task
+ */
+struct CMux::dispatch_queue {
+    static const size_t PENDING = SignalGroup::bit0;        /*!< Payloads are waiting in the queue */
+    static const size_t STOP = SignalGroup::bit1;           /*!< Request to finish the dispatch task */
+    static const size_t EXITED = SignalGroup::bit2;         /*!< The dispatch task has finished */
+    struct payload {
+        uint8_t *block;                                     /*!< Block of the rx_blocks pool */
+        size_t len;
+    };
+    dispatch_queue(CMux *c, int i): cmux(c), terminal(i) {}
+    CMux *cmux;
+    int terminal;                                           /*!< Index of the virtual terminal */
+    Lock lock;                                              /*!< Locks the queued payloads */
+    payload pending[dispatch_queue_size];                   /*!< Ring of the queued payloads */
+    size_t head{0};
+    size_t count{0};
+    bool flow_stopped{false};                               /*!< The device was asked to pause the terminal */
+    SignalGroup signal;                                     /*!< Event group used to control the dispatch task */
+    std::unique_ptr<Task> task;                             /*!< Dispatch task */
+};
+#else
+struct CMux::dispatch_queue {};
+#endif
+
+static_assert(cmux_stats::channels == MAX_TERMINALS_NUM + 1, "Statistics kept for all DLCIs");
+static_assert(2 * (MAX_TERMINALS_NUM + 1) <= 24, "Handshake bits fit into an event group");
+static_assert(cmux_stats::recovery_reasons == static_cast<size_t>(CMux::protocol_mismatch_reason::UNKNOWN) + 1,
+              "Statistics kept for all protocol mismatch reasons");
+
+namespace {
+/**
+ * @brief FCS of all byte values (reversed polynomial x^8 + x^2 + x + 1), generated at compile time
+ */
+struct fcs_table_t {
+    uint8_t value[256];
+};
 
+constexpr fcs_table_t make_fcs_table()
+{
+    fcs_table_t table{};
+    for (int i = 0; i < 256; i++) {
+        uint8_t crc = i;
         for (int j = 0; j < 8; j++) {
-            if (crc & 0x01) {
-                crc = (crc >> 1) ^ 0xe0; // FCS_POLYNOMIAL
-            } else {
-                crc >>= 1;
-            }
+            crc = (crc & 0x01) ? (crc >> 1) ^ 0xe0 : crc >> 1;  // FCS_POLYNOMIAL
         }
+        table.value[i] = crc;
     }
+    return table;
+}
+
+constexpr fcs_table_t fcs_table = make_fcs_table();
+} // namespace
 
+uint8_t CMux::fcs_update(uint8_t crc, uint8_t byte)
+{
+    return fcs_table.value[crc ^ byte];
+}
+
+uint8_t CMux::fcs_crc(const uint8_t frame[6])
+{
+    uint8_t crc = 0xFF; // FCS_INIT_VALUE
+    for (int i = 1; i < 4; i++) {
+        crc = fcs_update(crc, frame[i]);
+    }
     return crc;
 }
 
@@ -85,14 +188,14 @@ void CMux::send_disconnect(size_t i)
         uint8_t frame[] = {
             SOF_MARKER, 0x3, 0xEF, 0x5, 0xC3, 0x1, 0xF2, SOF_MARKER
         };
-        term->write(frame, 8);
+        transmit(frame, 8);
     } else {        // separate virtual terminal
         uint8_t frame[] = {
             SOF_MARKER, 0x3, FT_DISC | PF, 0x1, 0, SOF_MARKER
         };
         frame[1] |= i << 2;
         frame[4] = 0xFF - fcs_crc(frame);
-        term->write(frame, sizeof(frame));
+        transmit(frame, sizeof(frame));
     }
 }
 
@@ -105,7 +208,126 @@ void CMux::send_sabm(size_t i)
     frame[3] = 1;
     frame[4] = 0xFF - fcs_crc(frame);
     frame[5] = SOF_MARKER;
-    term->write(frame, 6);
+    transmit(frame, 6);
+}
+
+void CMux::send_control(const uint8_t *message, size_t len)
+{
+    uint8_t frame[4 + 16 + 2] = { SOF_MARKER, 0x3, FT_UIH };   // control terminal, short messages only
+    if (len > 16) {
+        return;
+    }
+    frame[3] = (len << 1) | EA;
+    memcpy(frame + 4, message, len);
+    frame[4 + len] = 0xFF - fcs_crc(frame);
+    frame[5 + len] = SOF_MARKER;
+    transmit(frame, len + 6);
+}
+
+void CMux::send_pn(size_t i)
+{
+    uint8_t message[] = {
+        (CMD_PN << 1) | CR | EA, (8 << 1) | EA,         // PN command with 8 bytes of parameters
+        0, 0, 7, 10,                                    // DLCI, UIH frames, default priority, T1 (100ms)
+        max_frame_size & 0xFF, max_frame_size >> 8,     // N1
+        3, 0,                                           // N2, window size (unused in basic mode)
+    };
+    message[2] = i;
+    send_control(message, sizeof(message));
+}
+
+void CMux::set_rx_flow(bool on)
+{
+    uint8_t message[] = { static_cast<uint8_t>(((on ? CMD_FCON : CMD_FCOFF) << 1) | CR | EA), EA };
+    send_control(message, sizeof(message));
+}
+
+void CMux::set_rx_flow(int virtual_term, bool on)
+{
+    if (virtual_term < 0 || virtual_term >= static_cast<int>(virtual_terms)) {
+        return;
+    }
+    uint8_t message[] = {
+        (CMD_MSC << 1) | CR | EA, (2 << 1) | EA,        // MSC command with 2 bytes of parameters
+        static_cast<uint8_t>(((virtual_term + 1) << 2) | CR | EA),
+        static_cast<uint8_t>(DV | RTR | RTC | (on ? 0 : FC) | EA)
+    };
+    send_control(message, sizeof(message));
+}
+
+void CMux::set_tx_flow(size_t i, bool on)
+{
+    if (i > virtual_terms) {
+        return;
+    }
+    ESP_LOGD("CMUX", "Flow control of DLCI %d: %s", static_cast<int>(i), on ? "on" : "off");
+    Scoped<Lock> l(tx_lock);
+    tx_flow_off[i] = !on;
+    if (on) {   // wake up the writers
+        tx_flow.set(i == 0 ? ((1 << (MAX_TERMINALS_NUM + 1)) - 2) : 1 << i);
+    }
+}
+
+bool CMux::wait_for_tx_flow(size_t i)
+{
+    auto start = Task::Now();
+    while (true) {
+        {
+            Scoped<Lock> l(tx_lock);
+            if (!tx_flow_off[0] && !tx_flow_off[i]) {
+                return true;
+            }
+            tx_flow.clear(1 << i);
+        }
+        uint32_t elapsed = Task::Now() - start;
+        if (elapsed >= flow_control_timeout_ms || !tx_flow.wait(1 << i, flow_control_timeout_ms - elapsed)) {
+            ESP_LOGW("CMUX", "DLCI %d stopped by flow control for %d ms", static_cast<int>(i), static_cast<int>(flow_control_timeout_ms));
+            return false;
+        }
+    }
+}
+
+void CMux::negotiate_frame_size()
+{
+    for (size_t i = 1; i <= virtual_terms; i++) {
+        send_pn(i);
+    }
+    if (!handshake.wait(pn_bits(1, virtual_terms), negotiation_timeout_ms)) {
+        ESP_LOGW("CMUX", "Frame size not negotiated for all terminals, using the default for the rest");
+    }
+    for (size_t i = 1; i <= virtual_terms; i++) {
+        ESP_LOGD("CMUX", "DLCI %d uses frames of %" PRIsize_t " bytes", static_cast<int>(i), frame_size[i]);
+    }
+}
+
+void CMux::transmit(const uint8_t *frame, size_t len)
+{
+    tx.append(frame, len);
+    tx.flush();
+}
+
+bool CMux::wait_for_tx_room()
+{
+    if (!tx.wait_for_room(tx_pending_limit, tx_queue_timeout_ms)) {
+        ESP_LOGW("CMUX", "Frames not written for %d ms", static_cast<int>(tx_queue_timeout_ms));
+        return false;
+    }
+    return true;
+}
+
+size_t CMux::write_frames(uint8_t *data, size_t len)
+{
+    ESP_LOG_BUFFER_HEXDUMP("Send", data, len, ESP_LOG_VERBOSE);
+    size_t written = 0;
+    while (written < len) {
+        int ret = term->write(data + written, len - written);
+        if (ret <= 0) {
+            ESP_LOGE("CMUX", "Failed to write %" PRIsize_t " bytes of frames", len - written);
+            break;
+        }
+        written += ret;
+    }
+    return written;
 }
 
 
@@ -121,9 +343,12 @@ struct CMux::CMuxFrame {
 
 bool CMux::data_available(uint8_t *data, size_t len)
 {
+    if (data && dlci < cmux_stats::channels) {
+        counters->dlci[dlci].bytes_in.add(len);
+    }
     if (data && (type & FT_UIH) == FT_UIH && len > 0 && dlci > 0) { // valid payload on a virtual term
         int virtual_term = dlci - 1;
-        if (virtual_term < MAX_TERMINALS_NUM) {
+        if (virtual_term < virtual_terms) {
             if (read_cb[virtual_term] == nullptr) {
                 // ignore all virtual terminal's data before we completely establish CMUX
                 ESP_LOG_BUFFER_HEXDUMP("CMUX Rx before init", data, len, ESP_LOG_DEBUG);
@@ -132,45 +357,90 @@ bool CMux::data_available(uint8_t *data, size_t len)
             // Post partial data (or defragment to post on CMUX footer)
 #ifdef DEFRAGMENT_CMUX_PAYLOAD
             if (payload_start == nullptr) {
+                // passed up in place, unless the frame continues in the next read (see park_payload())
                 payload_start = data;
-                total_payload_size = 0;
+                total_payload_size = len;
+            } else {
+                append_payload(data, len);
             }
-            total_payload_size += len;
 #else
-            read_cb[virtual_term](data, len);
+            deliver(virtual_term, data, len);
 #endif
         } else {
             return false;
         }
     } else if (data == nullptr && type == (FT_UA | PF) && len == 0) { // notify the initial SABM command
-        Scoped<Lock> l(lock);
-        sabm_ack = dlci;
+        handshake.set(ack_bits(dlci, dlci));
     } else if (data == nullptr && dlci > 0) {
         int virtual_term = dlci - 1;
-        if (virtual_term < MAX_TERMINALS_NUM) {
+        if (virtual_term < virtual_terms) {
             if (read_cb[virtual_term] == nullptr) {
                 // silently ignore this CMUX frame (not finished entering CMUX, yet)
                 return true;
             }
 #ifdef DEFRAGMENT_CMUX_PAYLOAD
-            read_cb[virtual_term](payload_start, total_payload_size);
+            if (total_payload_size > 0) {
+                deliver(virtual_term, payload_start, total_payload_size);
+            }
 #endif
         } else {
             return false;
         }
     } else if ((type & FT_UIH) == FT_UIH && dlci == 0) { // notify the internal DISC command
+        if (data != nullptr && len > 0 && on_control(data, len)) {
+            return true;
+        }
         if ((data == nullptr) || (len > 0 && (data[0] & 0xE1) == 0xE1)) {
-            // Not a DISC, ignore (MSC frame)
+            // Not a DISC, ignore
             return true;
         }
-        Scoped<Lock> l(lock);
-        sabm_ack = dlci;
+        handshake.set(ack_bits(dlci, dlci));
     } else {
         return false;
     }
     return true;
 }
 
+bool CMux::on_control(uint8_t *data, size_t len)
+{
+    uint8_t message = data[0] & ~CR;
+    bool is_command = data[0] & CR;
+    if (message == ((CMD_PN << 1) | EA) && len >= 10) {
+        // reply to our parameter negotiation (the modem might have lowered the frame size)
+        size_t i = data[2] & 0x3F;
+        size_t size = data[6] | (data[7] << 8);
+        if (i > 0 && i <= virtual_terms) {
+            if (size > 0) {
+                frame_size[i] = std::min(size, max_frame_size);
+            }
+            handshake.set(pn_bits(i, i));
+        }
+        return true;
+    }
+    if (message == ((CMD_NSC << 1) | EA)) {
+        // PN not supported, keep the default frame size
+        handshake.set(pn_bits(1, virtual_terms));
+        return true;
+    }
+    if (message == ((CMD_FCON << 1) | EA) || message == ((CMD_FCOFF << 1) | EA)) {
+        if (is_command) {   // the modem stops (resumes) accepting frames on all DLCIs
+            set_tx_flow(0, message == ((CMD_FCON << 1) | EA));
+            data[0] &= ~CR;
+            send_control(data, std::min<size_t>(len, 2));
+        }
+        return true;
+    }
+    if (message == ((CMD_MSC << 1) | EA)) {
+        if (is_command && len >= 4) {   // the modem stops (resumes) accepting frames on one DLCI
+            set_tx_flow(data[2] >> 2, (data[3] & FC) == 0);
+            data[0] &= ~CR;
+            send_control(data, std::min<size_t>(len, 5));
+        }
+        return true;
+    }
+    return false;
+}
+
 bool CMux::on_init(CMuxFrame &frame)
 {
     if (frame.ptr[0] != SOF_MARKER) {
@@ -236,18 +506,21 @@ bool CMux::on_header(CMuxFrame &frame)
         payload_offset = std::min(frame.len, 5 - frame_header_offset);
         memcpy(frame_header + frame_header_offset, frame.ptr, payload_offset);
         payload_len = frame_header[4] << 7;
+        // FCS covers the second length byte, too (before the frame_header[4] gets overwritten by the FCS)
+        rx_fcs = fcs_update(fcs_crc(frame_header), frame_header[4]);
         frame_header_offset += payload_offset - 1; // rewind frame_header back to hold only 6 bytes size
     } else
 #endif // ! ESP_MODEM_CMUX_USE_SHORT_PAYLOADS_ONLY
     {
         payload_len = 0;
+        rx_fcs = fcs_crc(frame_header);
         frame_header_offset += payload_offset;
     }
     dlci = frame_header[1] >> 2;
     type = frame_header[2];
     // Sanity check for expected values of DLCI and type,
     // since CRC could be evaluated after the frame payload gets received
-    if (dlci > MAX_TERMINALS_NUM || (frame_header[1] & 0x01) == 0 ||
+    if (dlci > virtual_terms || (frame_header[1] & 0x01) == 0 ||
             (((type & FT_UIH) != FT_UIH) &&  type != (FT_UA | PF))) {
         recover_protocol(protocol_mismatch_reason::UNEXPECTED_HEADER);
         return true;
@@ -297,13 +570,12 @@ bool CMux::on_footer(CMuxFrame &frame)
             recover_protocol(protocol_mismatch_reason::MISSED_TRAIL_SOF);
             return true;
         }
-#ifdef ESP_MODEM_CMUX_USE_SHORT_PAYLOADS_ONLY
-        uint8_t crc = 0xFF - fcs_crc(frame_header);
-        if (crc != frame_header[4]) {
+        // FCS of UIH frames covers just the header, the frames with wrong FCS are dropped before
+        // their (defragmented) payload gets passed up
+        if (0xFF - rx_fcs != frame_header[4]) {
             recover_protocol(protocol_mismatch_reason::WRONG_CRC);
             return true;
         }
-#endif
         frame.advance(footer_offset);
         state = cmux_state::INIT;
         frame_header_offset = 0;
@@ -311,127 +583,279 @@ bool CMux::on_footer(CMuxFrame &frame)
             recover_protocol(protocol_mismatch_reason::UNEXPECTED_DATA);
             return true;
         }
+        release_payload();
+    }
+    return true;
+}
+
+void CMux::append_payload(uint8_t *data, size_t len)
+{
+    if (total_payload_size + len > rx_blocks.block_size()) {
+        // longer than any legal frame, pass it up in parts (rely on upper layers to process correctly)
+        ESP_LOGW("CMUX", "Payload longer than %" PRIsize_t " bytes passed up in parts", rx_blocks.block_size());
+        deliver(dlci - 1, payload_start, total_payload_size);
+        release_payload();
+        payload_start = data;   // continues as a new payload
+        total_payload_size = len;
+        return;
+    }
+    memcpy(payload_start + total_payload_size, data, len);
+    total_payload_size += len;
+}
+
+void CMux::park_payload()
+{
+    if (total_payload_size <= rx_blocks.block_size()) {
+        payload_block = acquire_block();
+    }
+    if (payload_block == nullptr) {
+        ESP_LOGW("CMUX", "Failed to keep the partial payload (payload=%" PRIsize_t ")", total_payload_size);
+        deliver(dlci - 1, payload_start, total_payload_size);
         payload_start = nullptr;
         total_payload_size = 0;
+        return;
     }
-    return true;
+    memcpy(payload_block, payload_start, total_payload_size);
+    payload_start = payload_block;
 }
 
-bool CMux::on_cmux_data(uint8_t *data, size_t actual_len)
+void CMux::release_payload()
 {
-    if (!data) {
-#ifdef DEFRAGMENT_CMUX_PAYLOAD
-        auto data_to_read = buffer.size - 128; // keep 128 (max CMUX payload) backup buffer)
-        if (payload_start) {
-            data = payload_start + total_payload_size;
-            auto data_end = buffer.get() + buffer.size;
-            data_to_read = payload_len + 2; // 2 -- CMUX protocol footer
-            if (data + data_to_read >= data_end) {
-                ESP_LOGW("CMUX", "Failed to defragment longer payload (payload=%" PRIsize_t ")", payload_len);
-                // If you experience this error, your device uses longer payloads while
-                // the configured buffer is too small to defragment the payload properly.
-                // To resolve this issue you can:
-                // * Either increase `dte_buffer_size`
-                // * Or disable `ESP_MODEM_CMUX_DEFRAGMENT_PAYLOAD` in menuconfig
-
-                // Attempts to process the data accumulated so far (rely on upper layers to process correctly)
-                data_available(nullptr, 0);
-                if (payload_len > total_payload_size) {
-                    payload_start = nullptr;
-                    total_payload_size = 0;
-                } else {
-                    // cannot continue with this payload, give-up and recover the protocol
-                    recover_protocol(protocol_mismatch_reason::READ_BEHIND_BUFFER);
+    if (payload_block) {
+        release_block(payload_block);
+        payload_block = nullptr;
+    }
+    payload_start = nullptr;
+    total_payload_size = 0;
+}
+
+uint8_t *CMux::acquire_block()
+{
+    Scoped<Lock> l(rx_blocks_lock);
+    return rx_blocks.acquire();
+}
+
+void CMux::release_block(uint8_t *block)
+{
+    Scoped<Lock> l(rx_blocks_lock);
+    rx_blocks.release(block);
+}
+
+void CMux::deliver(int virtual_term, uint8_t *data, size_t len)
+{
+#ifdef DISPATCH_CMUX_PAYLOAD
+    if (dispatch[virtual_term]) {
+        auto &q = *dispatch[virtual_term];
+        if (data == payload_block) {
+            // the reassembled payload is queued as is
+            payload_block = nullptr;
+            enqueue(q, data, len);
+            return;
+        }
+        // the Rx buffer gets reused, so the payload is copied to block(s)
+        for (size_t offset = 0; offset < len; offset += rx_blocks.block_size()) {
+            size_t part = std::min(len - offset, rx_blocks.block_size());
+            uint8_t *block = acquire_block();
+            if (block == nullptr) {
+                ESP_LOGW("CMUX", "No block for the payload of terminal %d, dropping %" PRIsize_t " bytes", virtual_term, len - offset);
+                counters->dropped[virtual_term + 1].add();
+                return;
+            }
+            memcpy(block, data + offset, part);
+            enqueue(q, block, part);
+        }
+        return;
+    }
+#endif
+    read_cb[virtual_term](data, len);
+}
+
+#ifdef DISPATCH_CMUX_PAYLOAD
+void CMux::enqueue(dispatch_queue &q, uint8_t *block, size_t len)
+{
+    bool stop_flow = false;
+    {
+        Scoped<Lock> l(q.lock);
+        if (q.count == dispatch_queue_size) {
+            ESP_LOGW("CMUX", "Dispatch queue of terminal %d is full, dropping %" PRIsize_t " bytes", q.terminal, len);
+            counters->dropped[q.terminal + 1].add();
+            release_block(block);
+            return;
+        }
+        q.pending[(q.head + q.count) % dispatch_queue_size] = { block, len };
+        q.count++;
+        if (!q.flow_stopped && q.count >= dispatch_queue_size - dispatch_queue_size / 4) {
+            stop_flow = q.flow_stopped = true;
+        }
+    }
+    q.signal.set(dispatch_queue::PENDING);
+    if (stop_flow) {
+        // ask the device to pause the terminal until its reader catches up
+        set_rx_flow(q.terminal, false);
+    }
+}
+
+void CMux::dispatch_task(dispatch_queue &q)
+{
+    while (true) {
+        q.signal.wait_any(dispatch_queue::PENDING | dispatch_queue::STOP, portMAX_DELAY);
+        dispatch_queue::payload next;
+        bool resume_flow = false;
+        {
+            Scoped<Lock> l(q.lock);
+            if (q.count == 0) {
+                q.signal.clear(dispatch_queue::PENDING);
+                if (q.signal.is_any(dispatch_queue::STOP)) {
+                    break;
                 }
-                data_to_read = buffer.size;
-                data = buffer.get();
+                continue;
+            }
+            next = q.pending[q.head];
+            q.head = (q.head + 1) % dispatch_queue_size;
+            q.count--;
+            if (q.flow_stopped && q.count <= dispatch_queue_size / 4) {
+                // unless closing (the terminal might be detached already)
+                resume_flow = !q.signal.is_any(dispatch_queue::STOP);
+                q.flow_stopped = false;
             }
-        } else {
-            data = buffer.get();
         }
-        actual_len = term->read(data, data_to_read);
-#else
+        if (resume_flow) {
+            set_rx_flow(q.terminal, true);
+        }
+        if (read_cb[q.terminal]) {
+            read_cb[q.terminal](next.block, next.len);
+        }
+        release_block(next.block);
+    }
+    q.signal.set(dispatch_queue::EXITED);
+}
+#endif
+
+void CMux::start_dispatch()
+{
+#ifdef DISPATCH_CMUX_PAYLOAD
+    for (size_t i = 0; i < virtual_terms; i++) {
+        if (dispatch[i]) {
+            continue;
+        }
+        dispatch[i] = std::make_unique<dispatch_queue>(this, i);
+        size_t priority = dispatch_priority[i] ? dispatch_priority[i] : CONFIG_ESP_MODEM_CMUX_DISPATCH_TASK_PRIORITY;
+        dispatch[i]->task = std::make_unique<Task>(dispatch_task_stack_size, priority, dispatch[i].get(), [](void *p) {
+            auto q = static_cast<dispatch_queue *>(p);
+            q->cmux->dispatch_task(*q);
+#if !defined(CONFIG_IDF_TARGET_LINUX)
+            // FreeRTOS tasks must not return, so wait here to be deleted with the Task object
+            while (true) {
+                Task::Delay(1000);
+            }
+#endif
+        });
+    }
+#endif
+}
+
+void CMux::stop_dispatch()
+{
+#ifdef DISPATCH_CMUX_PAYLOAD
+    for (auto &q : dispatch) {
+        if (q) {
+            q->signal.set(dispatch_queue::STOP);
+            q->signal.wait(dispatch_queue::EXITED, portMAX_DELAY);
+            q.reset();
+        }
+    }
+#endif
+}
+
+CMux::CMux(std::shared_ptr<Terminal> t, unique_buffer &&b, cmux_counters *c, size_t terminals):
+    term(std::move(t)), virtual_terms(std::min(terminals, MAX_TERMINALS_NUM)), payload_start(nullptr),
+    total_payload_size(0), buffer(std::move(b)), counters(c ? c : &own_counters) {}
+
+CMux::~CMux()
+{
+    stop_dispatch();
+}
+
+bool CMux::on_cmux_data(uint8_t *data, size_t actual_len)
+{
+    if (!data) {
         data = buffer.get();
         actual_len = term->read(data, buffer.size);
-#endif
     }
     if (data == nullptr) {
         return false;
     }
     ESP_LOG_BUFFER_HEXDUMP("CMUX Received", data, actual_len, ESP_LOG_VERBOSE);
+    // recover() from other tasks resets the state machine and releases the reassembly block
+    Scoped<Lock> l(lock);
     CMuxFrame frame = { .ptr = data, .len = actual_len };
-    while (frame.len > 0) {
+    bool processed = true;
+    while (processed && frame.len > 0) {
         switch (state) {
         case cmux_state::RECOVER:
-            if (!on_recovery(frame)) {
-                return false;
-            }
+            processed = on_recovery(frame);
             break;
         case cmux_state::INIT:
-            if (!on_init(frame)) {
-                return false;
-            }
+            processed = on_init(frame);
             break;
         case cmux_state::HEADER:
-            if (!on_header(frame)) {
-                return false;
-            }
+            processed = on_header(frame);
             break;
         case cmux_state::PAYLOAD:
-            if (!on_payload(frame)) {
-                return false;
-            }
+            processed = on_payload(frame);
             break;
         case cmux_state::FOOTER:
-            if (!on_footer(frame)) {
-                return false;
-            }
+            processed = on_footer(frame);
             break;
         }
     }
-    return true;
+#ifdef DEFRAGMENT_CMUX_PAYLOAD
+    if (payload_start != nullptr && payload_block == nullptr) {
+        // the frame continues in the next read, which reuses the Rx buffer
+        park_payload();
+    }
+#endif
+    return processed;
 }
 
 bool CMux::deinit()
 {
-    int timeout;
-    sabm_ack = -1;
-    // First disconnect all (2) virtual terminals
-    for (size_t i = 1; i < 3; i++) {
+    // First disconnect all virtual terminals (at once)
+    handshake.clear(ack_bits(0, virtual_terms));
+    for (size_t i = 1; i <= virtual_terms; i++) {
         send_disconnect(i);
-        timeout = 0;
-        while (true) {
-            usleep(10'000);
-            Scoped<Lock> l(lock);
-            if (sabm_ack == i) {
-                sabm_ack = -1;
-                break;
-            }
-            if (timeout++ > 100) {
-                return false;
-            }
-        }
     }
-    sabm_ack = -1;
+    if (!handshake.wait(ack_bits(1, virtual_terms), handshake_timeout_ms)) {
+        return false;
+    }
     // Then disconnect the control terminal
     send_disconnect(0);
-    timeout = 0;
-    while (true) {
-        usleep(10'000);
-        Scoped<Lock> l(lock);
-        if (sabm_ack == 0) {
-            break;
-        }
-        if (timeout++ > 100) {
-            return false;
-        }
+    if (!handshake.wait(ack_bits(0, 0), handshake_timeout_ms)) {
+        return false;
     }
     term->set_read_cb(nullptr);
+    stop_dispatch();
     return true;
 }
 
 bool CMux::init()
 {
+    // payloads spanning several reads are reassembled in blocks of the maximum frame size
+    // (or of the Rx buffer size, the limit of the former in-buffer reassembly, if larger)
+    release_payload();
+#ifdef DISPATCH_CMUX_PAYLOAD
+    // blocks queued and being passed by each terminal, the reassembly one and the one being queued
+    rx_blocks.configure(std::max(max_frame_size, buffer.size), virtual_terms * (dispatch_queue_size + 1) + 2);
+    start_dispatch();
+#elif defined(DEFRAGMENT_CMUX_PAYLOAD)
+    rx_blocks.configure(std::max(max_frame_size, buffer.size), virtual_terms);
+#endif
+    for (auto &size : frame_size) {
+        size = std::min<size_t>(max_frame_size, DEFAULT_FRAME_SIZE);   // unless negotiated
+    }
+    for (auto &off : tx_flow_off) {
+        off = false;
+    }
     frame_header_offset = 0;
     state = cmux_state::INIT;
     term->set_read_cb([this](uint8_t *data, size_t len) {
@@ -439,66 +863,97 @@ bool CMux::init()
         return false;
     });
 
-    sabm_ack = -1;
-    for (size_t i = 0; i < 3; i++) {
-        int timeout = 0;
+    handshake.clear(ack_bits(0, virtual_terms) | pn_bits(1, virtual_terms));
+    send_sabm(0);
+    if (!handshake.wait(ack_bits(0, 0), handshake_timeout_ms)) {
+        return false;
+    }
+#ifdef NEGOTIATE_FRAME_SIZE
+    negotiate_frame_size();     // over the control terminal, before opening the virtual ones
+#endif
+    // Open the virtual terminals at once and collect the acknowledgements,
+    // unless the device needs a pause after opening each of them
+    const bool one_by_one = CONFIG_ESP_MODEM_CMUX_DELAY_AFTER_DLCI_SETUP > 0;
+    for (size_t i = 1; i <= virtual_terms; i++) {
         send_sabm(i);
-        while (true) {
-            usleep(10'000);
-            Scoped<Lock> l(lock);
-            if (sabm_ack == i) {
-                sabm_ack = -1;
-                break;
-            }
-            if (timeout++ > 100) {
+        if (one_by_one) {
+            if (!handshake.wait(ack_bits(i, i), handshake_timeout_ms)) {
                 return false;
             }
+            if (i > 1) {    // wait for each virtual terminal to settle MSC
+                usleep(CONFIG_ESP_MODEM_CMUX_DELAY_AFTER_DLCI_SETUP * 1'000);
+            }
         }
-        if (i > 1) {    // wait for each virtual terminal to settle MSC (no need for control term, DLCI=0)
-            usleep(CONFIG_ESP_MODEM_CMUX_DELAY_AFTER_DLCI_SETUP * 1'000);
-        }
+    }
+    if (!one_by_one && !handshake.wait(ack_bits(1, virtual_terms), handshake_timeout_ms)) {
+        return false;
     }
     return true;
 }
 
 int CMux::write(int virtual_term, uint8_t *data, size_t len)
 {
-    const size_t cmux_max_len = 127;
-    Scoped<Lock> l(lock);
+    if (virtual_term < 0 || virtual_term >= static_cast<int>(virtual_terms) || term == nullptr) {
+        return -1;
+    }
     int i = virtual_term + 1;
-    size_t need_write = len;
-    while (need_write > 0) {
-        size_t batch_len = need_write;
-        if (batch_len > cmux_max_len) {
-            batch_len = cmux_max_len;
+    if (!wait_for_tx_flow(i) || !wait_for_tx_room()) {
+        return 0;
+    }
+    const size_t cmux_max_len = frame_size[i];
+    uint64_t from, to;      // stream positions of our frames
+    {
+        Scoped<Lock> l(tx.lock);
+        from = tx.end();
+        size_t need_write = len;
+        while (need_write > 0) {
+            size_t batch_len = need_write;
+            if (batch_len > cmux_max_len) {
+                batch_len = cmux_max_len;
+            }
+            uint8_t frame[6];
+            size_t header_len = 4;
+            frame[0] = SOF_MARKER;
+            frame[1] = (i << 2) + 1;
+            frame[2] = FT_UIH;
+            uint8_t fcs;
+            if (batch_len > DEFAULT_FRAME_SIZE) {   // 2 byte length
+                frame[3] = (batch_len & 0x7F) << 1;
+                frame[4] = batch_len >> 7;
+                fcs = fcs_update(fcs_crc(frame), frame[4]);
+                header_len = 5;
+            } else {
+                frame[3] = (batch_len << 1) + 1;
+                fcs = fcs_crc(frame);
+            }
+            uint8_t footer[] = { static_cast<uint8_t>(0xFF - fcs), SOF_MARKER };
+
+            tx.append(frame, header_len);
+            tx.append(data, batch_len);
+            tx.append(footer, 2);
+            counters->dlci[i].bytes_out.add(batch_len);
+            need_write -= batch_len;
+            data += batch_len;
         }
-        uint8_t frame[6];
-        frame[0] = SOF_MARKER;
-        frame[1] = (i << 2) + 1;
-        frame[2] = FT_UIH;
-        frame[3] = (batch_len << 1) + 1;
-        frame[4] = 0xFF - fcs_crc(frame);
-        frame[5] = SOF_MARKER;
-
-        term->write(frame, 4);
-        term->write(data, batch_len);
-        term->write(frame + 4, 2);
-        ESP_LOG_BUFFER_HEXDUMP("Send", frame, 4, ESP_LOG_VERBOSE);
-        ESP_LOG_BUFFER_HEXDUMP("Send", data, batch_len, ESP_LOG_VERBOSE);
-        ESP_LOG_BUFFER_HEXDUMP("Send", frame + 4, 2, ESP_LOG_VERBOSE);
-        need_write -= batch_len;
-        data += batch_len;
+        to = tx.end();
     }
-    return len;
+    return tx.flush(from, to) ? len : 0;
 }
 
 void CMux::set_read_cb(int inst, std::function<bool(uint8_t *, size_t)> f)
 {
-    if (inst < MAX_TERMINALS_NUM) {
+    if (inst >= 0 && inst < static_cast<int>(virtual_terms)) {
         read_cb[inst] = std::move(f);
     }
 }
 
+void CMux::set_dispatch_priority(int inst, size_t priority)
+{
+    if (inst >= 0 && inst < static_cast<int>(virtual_terms)) {
+        dispatch_priority[inst] = priority;
+    }
+}
+
 std::pair<std::shared_ptr<Terminal>, unique_buffer> CMux::detach()
 {
     return std::make_pair(std::move(term), std::move(buffer));
@@ -507,8 +962,8 @@ std::pair<std::shared_ptr<Terminal>, unique_buffer> CMux::detach()
 void esp_modem::CMux::recover_protocol(protocol_mismatch_reason reason)
 {
     ESP_LOGW("CMUX", "Restarting CMUX state machine (reason: %d)", static_cast<int>(reason));
-    payload_start = nullptr;
-    total_payload_size = 0;
+    counters->recoveries[static_cast<size_t>(reason)].add();
+    release_payload();
     frame_header_offset = 0;
     state = cmux_state::RECOVER;
 }
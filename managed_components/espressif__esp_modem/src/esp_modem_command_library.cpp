@@ -4,8 +4,13 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <charconv>
 #include <list>
+#include <memory>
+#include <vector>
 #include "esp_log.h"
 #include "cxx_include/esp_modem_dte.hpp"
 #include "cxx_include/esp_modem_dce_module.hpp"
@@ -13,23 +18,167 @@
 #include "cxx_include/esp_modem_command_library_utils.hpp"
 
 #include "cxx17_include/esp_modem_command_library_17.hpp"
+#include "cxx17_include/esp_modem_command_table.hpp"
+#include "cxx17_include/esp_modem_phrase_matcher.hpp"
 
 namespace esp_modem::dce_commands {
 
 static const char *TAG = "command_lib";
 
-command_result generic_command(CommandableIf *t, const std::string &command,
-                               const std::list<std::string_view> &pass_phrase,
-                               const std::list<std::string_view> &fail_phrase,
-                               uint32_t timeout_ms)
+/*
+ * Maximum length of a command formatted in a fixed buffer (longer ones are formatted in std::string)
+ */
+static const size_t command_max_len = 64;
+
+/*
+ * Capacity of the replies of frequently polled commands, captured in fixed buffers
+ */
+static const size_t short_reply_len = 64;
+
+/*
+ * Replies are classified by one scan of a matcher of both pass (tagged 0) and fail phrases (tagged 1),
+ * pass phrases take precedence as the matcher reports the lowest tag found
+ */
+using reply_matcher = phrase_matcher<>;
+static const int pass_tag = 0;
+static const int fail_tag = 1;
+
+static command_result reply_result(int tag)
+{
+    return tag == pass_tag ? command_result::OK : tag == fail_tag ? command_result::FAIL : command_result::TIMEOUT;
+}
+
+/*
+ * Matchers are built once per pass/fail phrase set and kept for the lifetime of the application (the library
+ * commands use just a few sets, like "OK"/"ERROR"), so that issuing a command doesn't rebuild the automaton.
+ * Published entries are never modified, so they're looked up without locking.
+ */
+struct cached_matcher {
+    std::string pass_phrase;
+    std::string fail_phrase;
+    reply_matcher matcher;
+    bool usable;            /*!< false if the phrases exceed the matcher */
+};
+static const size_t matcher_cache_size = 16;
+static std::unique_ptr<cached_matcher> matcher_cache[matcher_cache_size];
+static std::atomic<size_t> matcher_cache_count{0};
+static Lock matcher_cache_lock;
+
+/*
+ * Returns the matcher of the phrases (alternatives separated by '|'),
+ * nullptr if the phrases need to be searched one by one (they exceed the matcher or the cache is full)
+ */
+static const reply_matcher *get_matcher(std::string_view pass_phrase, std::string_view fail_phrase)
+{
+    auto find = [&](size_t from, size_t to) -> const cached_matcher * {
+        for (size_t i = from; i < to; ++i) {
+            if (matcher_cache[i]->pass_phrase == pass_phrase && matcher_cache[i]->fail_phrase == fail_phrase) {
+                return matcher_cache[i].get();
+            }
+        }
+        return nullptr;
+    };
+    size_t count = matcher_cache_count.load(std::memory_order_acquire);
+    auto found = find(0, count);
+    if (found == nullptr) {
+        Scoped<Lock> l(matcher_cache_lock);
+        size_t published = matcher_cache_count.load(std::memory_order_relaxed);
+        found = find(count, published);
+        if (found == nullptr) {
+            if (published == matcher_cache_size) {
+                ESP_LOGD(TAG, "Matcher cache full, searching phrases one by one");
+                return nullptr;
+            }
+            auto entry = std::make_unique<cached_matcher>();
+            entry->pass_phrase = pass_phrase;
+            entry->fail_phrase = fail_phrase;
+            entry->usable = entry->matcher.add_any(pass_phrase, pass_tag) && entry->matcher.add_any(fail_phrase, fail_tag);
+            if (entry->usable) {
+                entry->matcher.build();
+            }
+            found = entry.get();
+            matcher_cache[published] = std::move(entry);
+            matcher_cache_count.store(published + 1, std::memory_order_release);
+        }
+    }
+    return found->usable ? &found->matcher : nullptr;
+}
+
+/*
+ * Classifies the replies of a descriptor's command, with its own matcher if the cache is full
+ * (the phrases of the descriptors are short enough to fit a matcher)
+ */
+class command_matcher {
+public:
+    explicit command_matcher(const command_desc &cmd): matcher(get_matcher(cmd.pass_phrase, cmd.fail_phrase))
+    {
+        if (matcher == nullptr) {
+            own = std::make_unique<reply_matcher>();
+            if (!own->add_any(cmd.pass_phrase, pass_tag) || !own->add_any(cmd.fail_phrase, fail_tag)) {
+                ESP_LOGE(TAG, "Phrases of %.*s exceed the matcher", static_cast<int>(cmd.command.size()), cmd.command.data());
+            }
+            own->build();
+            matcher = own.get();
+        }
+    }
+
+    command_result operator()(std::string_view reply) const
+    {
+        return reply_result(matcher->find(reply));
+    }
+
+private:
+    const reply_matcher *matcher;
+    std::unique_ptr<reply_matcher> own;
+};
+
+/*
+ * Phrases given as lists are joined to alternatives, unless they can't be expressed so
+ * (empty phrases match anything, phrases containing '|'), then they're searched one by one
+ */
+template <typename Phrases>
+static bool join_phrases(fixed_string<command_max_len> &joined, const Phrases &phrases)
+{
+    std::string_view separator;
+    for (auto &it : phrases) {
+        std::string_view phrase(it);
+        if (phrase.empty() || phrase.find('|') != std::string_view::npos) {
+            return false;
+        }
+        joined += separator;
+        joined += phrase;
+        separator = "|";
+    }
+    return joined.ok();
+}
+
+template <typename Phrases>
+static const reply_matcher *get_matcher(const Phrases &pass_phrase, const Phrases &fail_phrase)
 {
-    ESP_LOGD(TAG, "%s command %s\n", __func__, command.c_str());
-    return t->command(command, [&](uint8_t *data, size_t len) {
+    fixed_string<command_max_len> pass;
+    fixed_string<command_max_len> fail;
+    if (!join_phrases(pass, pass_phrase) || !join_phrases(fail, fail_phrase)) {
+        return nullptr;
+    }
+    return get_matcher(pass.view(), fail.view());
+}
+
+template <typename Phrases>
+static command_result generic_command_impl(CommandableIf *t, std::string_view command,
+                                           const Phrases &pass_phrase, const Phrases &fail_phrase, uint32_t timeout_ms)
+{
+    ESP_LOGD(TAG, "%s command %.*s\n", __func__, static_cast<int>(command.size()), command.data());
+    // phrases exceeding the matcher (or empty ones, which match anything) are searched one by one
+    auto matcher = get_matcher(pass_phrase, fail_phrase);
+    auto on_line = [&](uint8_t *data, size_t len) {
         std::string_view response((char *)data, len);
         if (data == nullptr || len == 0 || response.empty()) {
             return command_result::TIMEOUT;
         }
         ESP_LOGD(TAG, "Response: %.*s\n", (int)response.length(), response.data());
+        if (matcher) {
+            return reply_result(matcher->find(response));
+        }
         for (auto &it : pass_phrase)
             if (response.find(it) != std::string::npos) {
                 return command_result::OK;
@@ -39,8 +188,28 @@ command_result generic_command(CommandableIf *t, const std::string &command,
                 return command_result::FAIL;
             }
         return command_result::TIMEOUT;
-    }, timeout_ms);
+    };
+    return t->command_lines(command.data(), command.size(), on_line, timeout_ms, '\n');
+}
+
+command_result generic_command(CommandableIf *t, const std::string &command,
+                               const std::list<std::string_view> &pass_phrase,
+                               const std::list<std::string_view> &fail_phrase,
+                               uint32_t timeout_ms)
+{
+    return generic_command_impl(t, command, pass_phrase, fail_phrase, timeout_ms);
+}
 
+command_result generic_command(CommandableIf *t, const command_desc &cmd)
+{
+    ESP_LOGD(TAG, "%s command %.*s\n", __func__, static_cast<int>(cmd.command.size()), cmd.command.data());
+    command_matcher match(cmd);
+    auto on_line = [&](uint8_t *data, size_t len) {
+        std::string_view response((char *)data, len);
+        ESP_LOGD(TAG, "Response: %.*s\n", (int)response.length(), response.data());
+        return match(response);
+    };
+    return t->command_lines(cmd.command.data(), cmd.command.size(), on_line, cmd.timeout_ms, '\n');
 }
 
 command_result generic_command(CommandableIf *t, const std::string &command,
@@ -48,9 +217,28 @@ command_result generic_command(CommandableIf *t, const std::string &command,
                                const std::string &fail_phrase, uint32_t timeout_ms)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    const auto pass = std::list<std::string_view>({pass_phrase});
-    const auto fail = std::list<std::string_view>({fail_phrase});
-    return generic_command(t, command, pass, fail, timeout_ms);
+    const std::string_view pass[] = {pass_phrase};
+    const std::string_view fail[] = {fail_phrase};
+    return generic_command_impl(t, command, pass, fail, timeout_ms);
+}
+
+/*
+ * Issues the command of the descriptor (a prefix, like "AT+IFC=") followed by comma separated parameters
+ * (integers or strings, which are appended as they are)
+ */
+template <typename... Params>
+static command_result generic_command_params(CommandableIf *t, const command_desc &cmd, Params... params)
+{
+    fixed_string<command_max_len> command;
+    command += cmd.command;
+    std::string_view separator;
+    ((command += separator, command += params, separator = ","), ...);
+    command += "\r";
+    if (!command.ok()) {
+        ESP_LOGE(TAG, "Command %.*s... too long", static_cast<int>(cmd.command.size()), cmd.command.data());
+        return command_result::FAIL;
+    }
+    return generic_command(t, command_desc{command.view(), cmd.pass_phrase, cmd.fail_phrase, cmd.timeout_ms});
 }
 
 /*
@@ -66,6 +254,13 @@ bool set(std::string &dest, std::string_view &src)
     return true;
 }
 
+template <size_t N> bool set(fixed_string<N> &dest, std::string_view &src)
+{
+    // truncated replies are not reported here, they'd just fail to parse
+    dest.assign(src);
+    return true;
+}
+
 /* This is an example of using std::span output in generic_get_string()
 bool set(std::span<char> &dest, std::string_view &src)
 {
@@ -81,33 +276,33 @@ bool set(std::span<char> &dest, std::string_view &src)
 
 } // str_copy
 
-template <typename T> command_result generic_get_string(CommandableIf *t, const std::string &command, T &output, uint32_t timeout_ms)
+template <typename T> command_result generic_get_string(CommandableIf *t, const command_desc &cmd, T &output)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return t->command(command, [&](uint8_t *data, size_t len) {
-        size_t pos = 0;
-        std::string_view response((char *)data, len);
-        while ((pos = response.find('\n')) != std::string::npos) {
-            std::string_view token = response.substr(0, pos);
-            for (auto it = token.end() - 1; it > token.begin(); it--) // strip trailing CR or LF
-                if (*it == '\r' || *it == '\n') {
-                    token.remove_suffix(1);
-                }
-            ESP_LOGV(TAG, "Token: {%.*s}\n", static_cast<int>(token.size()), token.data());
+    command_matcher match(cmd);
+    auto on_line = [&](uint8_t *data, size_t len) {
+        std::string_view token((char *)data, len);
+        while (!token.empty() && (token.back() == '\r' || token.back() == '\n')) { // strip trailing CR or LF
+            token.remove_suffix(1);
+        }
+        ESP_LOGV(TAG, "Token: {%.*s}\n", static_cast<int>(token.size()), token.data());
 
-            if (token.find("OK") != std::string::npos) {
-                return command_result::OK;
-            } else if (token.find("ERROR") != std::string::npos) {
+        auto result = match(token);
+        if (result != command_result::TIMEOUT) {
+            return result;
+        } else if (token.size() > 2) {
+            if (!str_copy::set(output, token)) {
                 return command_result::FAIL;
-            } else if (token.size() > 2) {
-                if (!str_copy::set(output, token)) {
-                    return command_result::FAIL;
-                }
             }
-            response = response.substr(pos + 1);
         }
         return command_result::TIMEOUT;
-    }, timeout_ms);
+    };
+    return t->command_lines(cmd.command.data(), cmd.command.size(), on_line, cmd.timeout_ms, '\n');
+}
+
+template <typename T> command_result generic_get_string(CommandableIf *t, const std::string &command, T &output, uint32_t timeout_ms)
+{
+    return generic_get_string(t, command_desc{command, "OK", "ERROR", timeout_ms}, output);
 }
 
 command_result generic_command_common(CommandableIf *t, const std::string &command, uint32_t timeout_ms)
@@ -119,65 +314,66 @@ command_result generic_command_common(CommandableIf *t, const std::string &comma
 command_result sync(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT\r");
+    return generic_command(t, table::sync);
 }
 
 command_result store_profile(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT&W\r");
+    return generic_command(t, table::store_profile);
 }
 
 command_result power_down(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command(t, "AT+QPOWD=1\r", "POWERED DOWN", "ERROR", 1000);
+    return generic_command(t, table::power_down);
 }
 
 command_result power_down_sim76xx(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CPOF\r", 1000);
+    return generic_command(t, table::power_down_sim76xx);
 }
 
 command_result power_down_sim70xx(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command(t, "AT+CPOWD=1\r", "POWER DOWN", "ERROR", 1000);
+    return generic_command(t, table::power_down_sim70xx);
 }
 
 command_result power_down_sim8xx(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command(t, "AT+CPOWD=1\r", "POWER DOWN", "ERROR", 1000);
+    return generic_command(t, table::power_down_sim8xx);
 }
 
 command_result reset(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command(t,  "AT+CRESET\r", "PB DONE", "ERROR", 60000);
+    return generic_command(t, table::reset);
 }
 
 command_result set_baud(CommandableIf *t, int baud)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t,  "AT+IPR=" + std::to_string(baud) + "\r");
+    return generic_command_params(t, table::set_baud, baud);
 }
 
 command_result hang_up(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "ATH\r", 90000);
+    return generic_command(t, table::hang_up);
 }
 
 command_result get_battery_status(CommandableIf *t, int &voltage, int &bcs, int &bcl)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CBC\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::get_battery_status, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
 
     constexpr std::string_view pattern = "+CBC: ";
     if (out.find(pattern) == std::string_view::npos) {
@@ -209,11 +405,12 @@ command_result get_battery_status(CommandableIf *t, int &voltage, int &bcs, int
 command_result get_battery_status_sim7xxx(CommandableIf *t, int &voltage, int &bcs, int &bcl)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CBC\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::get_battery_status, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
     // Parsing +CBC: <voltage in Volts> V
     constexpr std::string_view pattern = "+CBC: ";
     constexpr int num_pos = pattern.size();
@@ -238,14 +435,14 @@ command_result get_battery_status_sim7xxx(CommandableIf *t, int &voltage, int &b
 command_result set_flow_control(CommandableIf *t, int dce_flow, int dte_flow)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+IFC=" + std::to_string(dce_flow) + "," + std::to_string(dte_flow) + "\r");
+    return generic_command_params(t, table::set_flow_control, dce_flow, dte_flow);
 }
 
 command_result get_operator_name(CommandableIf *t, std::string &operator_name, int &act)
 {
     ESP_LOGV(TAG, "%s", __func__);
     std::string out;
-    auto ret = generic_get_string(t, "AT+COPS?\r", out, 75000);
+    auto ret = generic_get_string(t, table::get_operator_name, out);
     if (ret != command_result::OK) {
         return ret;
     }
@@ -275,10 +472,7 @@ command_result get_operator_name(CommandableIf *t, std::string &operator_name, i
 command_result set_echo(CommandableIf *t, bool on)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    if (on) {
-        return generic_command_common(t, "ATE1\r");
-    }
-    return generic_command_common(t, "ATE0\r");
+    return generic_command_params(t, table::set_echo, on ? 1 : 0);
 }
 
 command_result set_pdp_context(CommandableIf *t, PdpContext &pdp, uint32_t timeout_ms)
@@ -297,61 +491,56 @@ command_result set_pdp_context(CommandableIf *t, PdpContext &pdp)
 command_result set_data_mode(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command(t, "ATD*99#\r", "CONNECT", "ERROR", 5000);
+    return generic_command(t, table::set_data_mode);
 }
 
 command_result set_data_mode_alt(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command(t, "ATD*99##\r", "CONNECT", "ERROR", 5000);
+    return generic_command(t, table::set_data_mode_alt);
 }
 
 command_result resume_data_mode(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command(t, "ATO\r", "CONNECT", "ERROR", 5000);
+    return generic_command(t, table::resume_data_mode);
 }
 
 command_result set_command_mode(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    const auto pass = std::list<std::string_view>({"NO CARRIER", "OK"});
-    const auto fail = std::list<std::string_view>({"ERROR"});
-    return generic_command(t, "+++", pass, fail, 5000);
+    return generic_command(t, table::set_command_mode);
 }
 
 command_result get_imsi(CommandableIf *t, std::string &imsi_number)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_get_string(t, "AT+CIMI\r", imsi_number, 5000);
+    return generic_get_string(t, table::get_imsi, imsi_number);
 }
 
 command_result get_imei(CommandableIf *t, std::string &out)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_get_string(t, "AT+CGSN\r", out, 5000);
+    return generic_get_string(t, table::get_imei, out);
 }
 
 command_result get_module_name(CommandableIf *t, std::string &out)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_get_string(t, "AT+CGMM\r", out, 5000);
+    return generic_get_string(t, table::get_module_name, out);
 }
 
 command_result sms_txt_mode(CommandableIf *t, bool txt = true)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    if (txt) {
-        return generic_command_common(t, "AT+CMGF=1\r");    // Text mode (default)
-    }
-    return generic_command_common(t, "AT+CMGF=0\r");     // PDU mode
+    return generic_command_params(t, table::sms_txt_mode, txt ? 1 : 0);    // Text mode (default) or PDU mode
 }
 
 command_result sms_character_set(CommandableIf *t)
 {
     // Sets the default GSM character set
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CSCS=\"GSM\"\r");
+    return generic_command(t, table::sms_character_set);
 }
 
 command_result send_sms(CommandableIf *t, const std::string &number, const std::string &message)
@@ -375,17 +564,18 @@ command_result send_sms(CommandableIf *t, const std::string &number, const std::
 command_result set_cmux(CommandableIf *t)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CMUX=0\r");
+    return generic_command(t, table::set_cmux);
 }
 
 command_result read_pin(CommandableIf *t, bool &pin_ok)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CPIN?\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::read_pin, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
     if (out.find("+CPIN:") == std::string::npos) {
         return command_result::FAIL;
     }
@@ -403,15 +593,19 @@ command_result read_pin(CommandableIf *t, bool &pin_ok)
 command_result set_pin(CommandableIf *t, const std::string &pin)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string set_pin_command = "AT+CPIN=" + pin + "\r";
-    return generic_command_common(t, set_pin_command);
+    return generic_command_params(t, table::set_pin, std::string_view(pin));
 }
 
 command_result at(CommandableIf *t, const std::string &cmd, std::string &out, int timeout = 500)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string at_command = cmd + "\r";
-    return generic_get_string(t, at_command, out, timeout);
+    fixed_string<command_max_len> at_command;
+    at_command += cmd;
+    at_command += "\r";
+    if (!at_command.ok()) {
+        return generic_get_string(t, cmd + "\r", out, timeout);
+    }
+    return generic_get_string(t, command_desc{at_command.view(), "OK", "ERROR", static_cast<uint32_t>(timeout)}, out);
 }
 
 command_result at_raw(CommandableIf *t, const std::string &cmd, std::string &out, const std::string &pass, const std::string &fail, int timeout = 500)
@@ -430,14 +624,257 @@ command_result at_raw(CommandableIf *t, const std::string &cmd, std::string &out
     }, timeout);
 }
 
+/*
+ * Maximum length of a batched command line, V.250 only guarantees 40 characters,
+ * but all common modules accept at least 256
+ */
+static const size_t batch_max_line = 256;
+
+static std::string_view batch_command_name(std::string_view cmd)
+{
+    return cmd.substr(0, cmd.find_first_of("=?"));
+}
+
+static bool batch_is_basic_command(std::string_view cmd)
+{
+    // basic commands (E0, &W) could be directly followed by another command, extended ones need a semicolon
+    return !cmd.empty() && (std::isalpha(static_cast<unsigned char>(cmd[0])) || cmd[0] == '&');
+}
+
+static command_result batch_line(CommandableIf *t, const std::vector<std::string_view> &commands, size_t first, size_t count,
+                                 std::vector<command_reply> &replies, uint32_t timeout_ms)
+{
+    std::string line = "AT";
+    for (size_t i = first; i < first + count; ++i) {
+        if (i > first && !batch_is_basic_command(commands[i - 1])) {
+            line += ';';
+        }
+        line += commands[i];
+    }
+    line += '\r';
+    ESP_LOGD(TAG, "%s line %s", __func__, line.c_str());
+    for (size_t i = first; i < first + count; ++i) {
+        replies[i].out.clear();
+    }
+    size_t current = first;
+    return t->command_lines(line, [&](uint8_t *data, size_t len) {
+        std::string_view token((char *)data, len);
+        while (!token.empty() && (token.back() == '\r' || token.back() == '\n')) {
+            token.remove_suffix(1);
+        }
+        if (token.empty() || token.rfind("AT", 0) == 0) {
+            return command_result::TIMEOUT;     // skip empty lines and the echo
+        }
+        if (token == "OK") {
+            return command_result::OK;
+        }
+        if (token == "ERROR" || token.rfind("+CME ERROR", 0) == 0 || token.rfind("+CMS ERROR", 0) == 0) {
+            if (count == 1) {
+                replies[first].out = token;
+            }
+            return command_result::FAIL;
+        }
+        // information response: assign to the command with the same prefix, keep the current one otherwise
+        auto colon = token.find(':');
+        if (token[0] == '+' && colon != std::string::npos) {
+            for (size_t i = current; i < first + count; ++i) {
+                if (batch_command_name(commands[i]) == token.substr(0, colon)) {
+                    current = i;
+                    break;
+                }
+            }
+        }
+        auto &out = replies[current].out;
+        if (!out.empty()) {
+            out += '\n';
+        }
+        out += token;
+        return command_result::TIMEOUT;
+    }, timeout_ms * count, '\n');     // the commands of the line are executed one after another
+}
+
+command_result at_batch(CommandableIf *t, const std::vector<std::string> &commands, std::vector<command_reply> &replies, uint32_t timeout_ms)
+{
+    ESP_LOGV(TAG, "%s", __func__);
+    std::vector<std::string_view> cmds;
+    cmds.reserve(commands.size());
+    for (auto &it : commands) {
+        std::string_view cmd(it);
+        if (cmd.size() >= 2 && (cmd[0] == 'A' || cmd[0] == 'a') && (cmd[1] == 'T' || cmd[1] == 't')) {
+            cmd.remove_prefix(2);
+        }
+        while (!cmd.empty() && (cmd.back() == '\r' || cmd.back() == '\n')) {
+            cmd.remove_suffix(1);
+        }
+        cmds.push_back(cmd);
+    }
+    replies.assign(cmds.size(), command_reply{});
+    size_t first = 0;
+    while (first < cmds.size()) {
+        // put as many commands as we can on one line
+        size_t count = 0;
+        size_t line_len = 3;   // "AT" + "\r"
+        while (first + count < cmds.size() && (count == 0 || line_len + 1 + cmds[first + count].size() <= batch_max_line)) {
+            line_len += 1 + cmds[first + count].size();
+            count++;
+        }
+        auto ret = batch_line(t, cmds, first, count, replies, timeout_ms);
+        if (ret == command_result::OK) {
+            for (size_t i = first; i < first + count; ++i) {
+                replies[i].result = command_result::OK;
+            }
+        } else if (ret == command_result::TIMEOUT || count == 1) {
+            replies[first].result = ret;
+            return ret;
+        } else {
+            // the device stops at the first failing command, but doesn't tell which one it was -> one by one
+            ESP_LOGD(TAG, "%s line failed, retrying commands one by one", __func__);
+            for (size_t i = first; i < first + count; ++i) {
+                replies[i].result = batch_line(t, cmds, i, 1, replies, timeout_ms);
+                if (replies[i].result != command_result::OK) {
+                    return replies[i].result;
+                }
+            }
+        }
+        first += count;
+    }
+    return command_result::OK;
+}
+
+/*
+ * Time for the modem to switch the rate after replying to AT+IPR, and the number of AT probes verifying a rate
+ */
+static const uint32_t baud_switch_delay_ms = 100;
+static const int baud_probes = 3;
+
+static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    // CRC-16/CCITT, bitwise, as it's used only for short replies
+    while (len--) {
+        crc ^= static_cast<uint16_t>(*data++) << 8;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/*
+ * CRC of the complete ATI reply, which serves as a test pattern of the link at the current rate
+ */
+static command_result identification_crc(CommandableIf *t, uint16_t &crc)
+{
+    const auto &cmd = table::get_identification;
+    command_matcher match(cmd);
+    crc = 0xFFFF;
+    auto on_line = [&](uint8_t *data, size_t len) {
+        auto result = match(std::string_view((char *)data, len));
+        if (result == command_result::TIMEOUT) {
+            crc = crc16(crc, data, len);
+        }
+        return result;
+    };
+    return t->command_lines(cmd.command.data(), cmd.command.size(), on_line, cmd.timeout_ms, '\n');
+}
+
+static bool probe_sync(CommandableIf *t, int probes)
+{
+    for (int i = 0; i < probes; ++i) {
+        if (sync(t) != command_result::OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool verify_baud(DTE *dte, uint16_t reference)
+{
+    uint16_t crc;
+    return probe_sync(dte, baud_probes) && identification_crc(dte, crc) == command_result::OK && crc == reference;
+}
+
+/*
+ * Returns both sides to the previous rate, the modem might have switched or not, so it's looked up at both rates
+ */
+static bool restore_baud(DTE *dte, int from, int to)
+{
+    for (int attempt = 0; attempt < baud_probes; ++attempt) {
+        dte->set_baud_rate(to);
+        if (sync(dte) == command_result::OK) {
+            set_baud(dte, from);
+            Task::Delay(baud_switch_delay_ms);
+        }
+        dte->set_baud_rate(from);
+        if (sync(dte) == command_result::OK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+command_result negotiate_baud(DTE *dte, const std::vector<int> &rates, int &baud, bool persist)
+{
+    ESP_LOGV(TAG, "%s", __func__);
+    const int initial = baud;
+    // look up the modem at the current rate, then at the candidates (if the modem kept a previously negotiated one)
+    bool found = sync(dte) == command_result::OK;
+    for (auto it = rates.begin(); !found && it != rates.end(); ++it) {
+        if (*it != initial && dte->set_baud_rate(*it) && probe_sync(dte, 1)) {
+            baud = *it;
+            found = true;
+        }
+    }
+    if (!found) {
+        dte->set_baud_rate(initial);
+        return command_result::TIMEOUT;
+    }
+    uint16_t reference;
+    auto ret = identification_crc(dte, reference);
+    if (ret != command_result::OK) {
+        return ret;
+    }
+    std::vector<int> candidates(rates);
+    std::sort(candidates.begin(), candidates.end(), std::greater<int>());
+    for (auto rate : candidates) {
+        if (rate <= baud) {
+            break;
+        }
+        // check that the terminal supports the rate before switching the modem
+        if (!dte->set_baud_rate(rate) || !dte->set_baud_rate(baud)) {
+            dte->set_baud_rate(baud);
+            continue;
+        }
+        if (set_baud(dte, rate) != command_result::OK) {
+            continue;   // not supported by the modem
+        }
+        Task::Delay(baud_switch_delay_ms);
+        dte->set_baud_rate(rate);
+        if (verify_baud(dte, reference)) {
+            ESP_LOGI(TAG, "Baud rate %d -> %d", baud, rate);
+            baud = rate;
+            break;
+        }
+        ESP_LOGW(TAG, "Baud rate %d failed verification, falling back to %d", rate, baud);
+        if (!restore_baud(dte, baud, rate)) {
+            ESP_LOGE(TAG, "Lost sync with the modem at %d", baud);
+            return command_result::FAIL;
+        }
+    }
+    if (persist && baud != initial && store_profile(dte) != command_result::OK) {
+        ESP_LOGW(TAG, "Failed to store baud rate %d", baud);
+    }
+    return command_result::OK;
+}
+
 command_result get_signal_quality(CommandableIf *t, int &rssi, int &ber)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CSQ\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::get_signal_quality, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
 
     constexpr std::string_view pattern = "+CSQ: ";
     constexpr int rssi_pos = pattern.size();
@@ -465,17 +902,18 @@ command_result set_operator(CommandableIf *t, int mode, int format, const std::s
 command_result set_network_attachment_state(CommandableIf *t, int state)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CGATT=" + std::to_string(state) + "\r");
+    return generic_command_params(t, table::set_network_attachment_state, state);
 }
 
 command_result get_network_attachment_state(CommandableIf *t, int &state)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CGATT?\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::get_network_attachment_state, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
     constexpr std::string_view pattern = "+CGATT: ";
     constexpr int pos = pattern.size();
     if (out.find(pattern) == std::string::npos) {
@@ -492,17 +930,18 @@ command_result get_network_attachment_state(CommandableIf *t, int &state)
 command_result set_radio_state(CommandableIf *t, int state)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CFUN=" + std::to_string(state) + "\r", 15000);
+    return generic_command_params(t, table::set_radio_state, state);
 }
 
 command_result get_radio_state(CommandableIf *t, int &state)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CFUN?\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::get_radio_state, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
     constexpr std::string_view pattern = "+CFUN: ";
     constexpr int pos = pattern.size();
     if (out.find(pattern) == std::string::npos) {
@@ -519,13 +958,13 @@ command_result get_radio_state(CommandableIf *t, int &state)
 command_result set_network_mode(CommandableIf *t, int mode)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CNMP=" + std::to_string(mode) + "\r");
+    return generic_command_params(t, table::set_network_mode, mode);
 }
 
 command_result set_preferred_mode(CommandableIf *t, int mode)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CMNB=" + std::to_string(mode) + "\r");
+    return generic_command_params(t, table::set_preferred_mode, mode);
 }
 
 command_result set_network_bands(CommandableIf *t, const std::string &mode, const int *bands, int size)
@@ -563,11 +1002,12 @@ command_result set_network_bands_sim76xx(CommandableIf *t, const std::string &mo
 command_result get_network_system_mode(CommandableIf *t, int &mode)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CNSMOD?\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::get_network_system_mode, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
 
     constexpr std::string_view pattern = "+CNSMOD: ";
     int mode_pos = out.find(",") + 1; // Skip "<n>,"
@@ -585,17 +1025,18 @@ command_result get_network_system_mode(CommandableIf *t, int &mode)
 command_result set_gnss_power_mode(CommandableIf *t, int mode)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CGNSPWR=" + std::to_string(mode) + "\r");
+    return generic_command_params(t, table::set_gnss_power_mode, mode);
 }
 
 command_result get_gnss_power_mode(CommandableIf *t, int &mode)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
-    auto ret = generic_get_string(t, "AT+CGNSPWR?\r", out);
+    fixed_string<short_reply_len> reply;
+    auto ret = generic_get_string(t, table::get_gnss_power_mode, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
     constexpr std::string_view pattern = "+CGNSPWR: ";
     constexpr int pos = pattern.size();
     if (out.find(pattern) == std::string::npos) {
@@ -615,24 +1056,25 @@ command_result config_psm(CommandableIf *t, int enabled, const std::string &TAU,
     if (enabled == true) {
         return generic_command_common(t, "AT+CPSMS=1,,,\"" + TAU + "\"" + ",\"" + activeTime + "\"\r", 5000);
     }
-    return generic_command_common(t, "AT+CPSMS=" + std::to_string(enabled) + "\r", 5000);
+    return generic_command_params(t, table::config_psm, enabled);
 }
 
 command_result config_network_registration_urc(CommandableIf *t, int value)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CEREG=" + std::to_string(value) + "\r", 500);
+    return generic_command_params(t, table::config_network_registration_urc, value);
 }
 
 command_result get_network_registration_state(CommandableIf *t, int &state)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    std::string out;
+    fixed_string<short_reply_len> reply;
 
-    auto ret = generic_get_string(t, "AT+CEREG?\r", out, 500);
+    auto ret = generic_get_string(t, table::get_network_registration_state, reply);
     if (ret != command_result::OK) {
         return ret;
     }
+    std::string_view out = reply.view();
 
     constexpr std::string_view pattern = "+CEREG: ";
 
@@ -678,7 +1120,7 @@ command_result get_network_registration_state(CommandableIf *t, int &state)
 command_result config_mobile_termination_error(CommandableIf *t, int value)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CMEE=" + std::to_string(value) + "\r");
+    return generic_command_params(t, table::config_mobile_termination_error, value);
 }
 command_result config_edrx(CommandableIf *t, int mode, int access_technology, const std::string &edrx_value)
 {
@@ -696,7 +1138,7 @@ command_result config_edrx(CommandableIf *t, int mode, int access_technology, co
 command_result set_gnss_power_mode_sim76xx(CommandableIf *t, int mode)
 {
     ESP_LOGV(TAG, "%s", __func__);
-    return generic_command_common(t, "AT+CGPS=" + std::to_string(mode) + "\r");
+    return generic_command_params(t, table::set_gnss_power_mode_sim76xx, mode);
 }
 
 } // esp_modem::dce_commands
@@ -4,12 +4,12 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <list>
 #include <unistd.h>
 #include <cstring>
 
 #include "cxx_include/esp_modem_dte.hpp"
 #include "cxx_include/esp_modem_dce.hpp"
+#include "cxx17_include/esp_modem_phrase_matcher.hpp"
 #include "esp_log.h"
 
 namespace esp_modem {
@@ -18,28 +18,36 @@ namespace transitions {
 
 static bool exit_data(DTE &dte, ModuleIf &device, Netif &netif)
 {
+    // any of the disconnection messages, built just once
+    static const auto disconnected = [] {
+        phrase_matcher<> matcher;
+        matcher.add("NO CARRIER", 0);
+        matcher.add("DISCONNECTED", 0);
+        matcher.add("OK", 0);
+        matcher.build();
+        return matcher;
+    }();
     auto signal = std::make_shared<SignalGroup>();
     std::weak_ptr<SignalGroup> weak_signal = signal;
-    dte.set_read_cb([&netif, weak_signal](uint8_t *data, size_t len) -> bool {
+    dte.set_read_cb([&netif, weak_signal, scan = phrase_matcher<>::state()](uint8_t *data, size_t len) mutable -> bool {
         // post the transitioning data to the network layers if it contains PPP SOF marker
         if (memchr(data, 0x7E, len))
         {
             ESP_LOG_BUFFER_HEXDUMP("esp-modem: debug_data (PPP)", data, len, ESP_LOG_DEBUG);
             netif.receive(data, len);
         }
+        // the scan resumes across fragments, so that the message is found even if split between two reads
+        disconnected.scan(scan, data, len);
         // treat the transitioning data as a textual message if it contains a newline char
         if (memchr(data, '\n', len))
         {
             ESP_LOG_BUFFER_HEXDUMP("esp-modem: debug_data (CMD)", data, len, ESP_LOG_DEBUG);
-            const auto pass = std::list<std::string_view>({"NO CARRIER", "DISCONNECTED", "OK"});
-            std::string_view response((char *) data, len);
-            for (auto &it : pass)
-                if (response.find(it) != std::string::npos) {
-                    if (auto signal = weak_signal.lock()) {
-                        signal->set(1);
-                    }
-                    return true;
+            if (scan.tag != phrase_matcher<>::no_match) {
+                if (auto signal = weak_signal.lock()) {
+                    signal->set(1);
                 }
+                return true;
+            }
         }
         return false;
     });
@@ -5,6 +5,7 @@
  */
 
 #include <cstring>
+#include <algorithm>
 #include "esp_log.h"
 #include "cxx_include/esp_modem_dte.hpp"
 #include "cxx_include/esp_modem_cmux.hpp"
@@ -13,6 +14,8 @@
 using namespace esp_modem;
 
 static const size_t dte_default_buffer_size = 1000;
+static const size_t dte_queue_task_stack_size = 4096;
+static const size_t dte_queue_task_priority = 5;
 
 DTE::DTE(const esp_modem_dte_config *config, std::unique_ptr<Terminal> terminal)
     : buffer(config->dte_buffer_size),
@@ -65,12 +68,15 @@ void DTE::set_command_callbacks()
 {
     primary_term->set_read_cb([this](uint8_t *data, size_t len) {
         Scoped<Lock> l(command_cb.line_lock);
+        if (data) {
+            stats.command.received(len);
+        }
 #ifdef CONFIG_ESP_MODEM_URC_HANDLER
         // Update buffer state when new data arrives
         update_buffer_state(len);
 #endif
 #ifndef CONFIG_ESP_MODEM_URC_HANDLER
-        if (command_cb.got_line == nullptr || command_cb.result != command_result::TIMEOUT) {
+        if (!command_cb.got_line || command_cb.result != command_result::TIMEOUT) {
             return false;   // this line has been processed already (got OK or FAIL previously)
         }
 #endif
@@ -79,21 +85,20 @@ void DTE::set_command_callbacks()
             // we cannot defragment unless we allocate, but
             // we'll try to process the data on the actual buffer
 #ifdef CONFIG_ESP_MODEM_USE_INFLATABLE_BUFFER_IF_NEEDED
-            if (inflatable.consumed != 0) {
-                inflatable.grow(inflatable.consumed + len);
-                std::memcpy(inflatable.current(), data, len);
-                data = inflatable.begin();
+            const size_t consumed = inflatable.size();
+            if (consumed != 0) {
+                inflatable.append(data, len);
+                stats.inflatable_high_water.update(inflatable.size());
+                data = inflatable.linearize();
             }
-            if (command_cb.process_line(data, inflatable.consumed, len, this)) {
+            if (command_cb.process_line(data, consumed, len, this)) {
                 return true;
             }
             // at this point we're sure that the data processing hasn't finished,
-            // and we have to grow the inflatable buffer (if enabled) or give up
-            if (inflatable.consumed == 0) {
-                inflatable.grow(len);
-                std::memcpy(inflatable.begin(), data, len);
+            // and we have to keep the fragment in the inflatable buffer (if enabled) or give up
+            if (consumed == 0) {
+                inflatable.append(data, len);
             }
-            inflatable.consumed += len;
             return false;
 #else
             if (command_cb.process_line(data, 0, len, this)) {
@@ -109,6 +114,8 @@ void DTE::set_command_callbacks()
         if (buffer.size > buffer.consumed) {
             data = buffer.get();
             len = primary_term->read(data + buffer.consumed, buffer.size - buffer.consumed);
+            stats.command.received(len);
+            stats.buffer_high_water.update(buffer.consumed + len);
             if (command_cb.process_line(data, buffer.consumed, len, this)) {
                 return true;
             }
@@ -117,18 +124,17 @@ void DTE::set_command_callbacks()
         }
         // we have used the entire DTE's buffer, need to use the inflatable buffer to continue
 #ifdef CONFIG_ESP_MODEM_USE_INFLATABLE_BUFFER_IF_NEEDED
-        if (inflatable.consumed == 0) {
-            inflatable.grow(buffer.size + len);
-            std::memcpy(inflatable.begin(), buffer.get(), buffer.size);
-            inflatable.consumed = buffer.size;
-        } else {
-            inflatable.grow(inflatable.consumed + len);
+        if (inflatable.empty()) {
+            inflatable.append(buffer.get(), buffer.size);
         }
-        len = primary_term->read(inflatable.current(), len);
-        if (command_cb.process_line(inflatable.begin(), inflatable.consumed, len, this)) {
+        const size_t consumed = inflatable.size();
+        len = primary_term->read(inflatable.prepare(len), len);
+        inflatable.commit(len);
+        stats.command.received(len);
+        stats.inflatable_high_water.update(inflatable.size());
+        if (command_cb.process_line(inflatable.linearize(), consumed, len, this)) {
             return true;
         }
-        inflatable.consumed += len;
         return false;
 #else
         // cannot inflate -> report a failure
@@ -152,26 +158,52 @@ void DTE::set_command_callbacks()
 }
 
 command_result DTE::command(const std::string &command, got_line_cb got_line, uint32_t time_ms, const char separator)
+{
+    return command_impl(command.c_str(), command.length(), got_line ? got_line_ref(got_line) : nullptr, time_ms, separator, false);
+}
+
+command_result DTE::command_lines(const std::string &command, got_line_cb got_line, uint32_t time_ms, const char separator)
+{
+    return command_impl(command.c_str(), command.length(), got_line ? got_line_ref(got_line) : nullptr, time_ms, separator, true);
+}
+
+command_result DTE::command_lines(const char *command, size_t len, got_line_ref got_line, uint32_t time_ms, const char separator)
+{
+    return command_impl(command, len, got_line, time_ms, separator, true);
+}
+
+command_result DTE::command_impl(const char *command, size_t len, got_line_ref got_line, uint32_t time_ms, const char separator, bool by_line)
 {
     Scoped<Lock> l1(internal_lock);
 #ifdef CONFIG_ESP_MODEM_URC_HANDLER
     // Track command start
     buffer_state.command_waiting = true;
     buffer_state.command_start_offset = buffer_state.total_processed;
+    command_cb.command = command;
+    command_cb.command_len = len;
 #endif
-    command_cb.set(got_line, separator);
-    primary_term->write((uint8_t *)command.c_str(), command.length());
-    command_cb.wait_for_line(time_ms);
+    const uint32_t start = Task::Now();
+    if (command_cb.set(got_line, separator, by_line)) {
+        stats.command.sent(primary_term->write((uint8_t *)command, len));
+        command_cb.wait_for_line(time_ms);
+    }   // otherwise the DTE is being destroyed and the command fails without being sent
     command_cb.set(nullptr);
+    stats.add_command(command, len, command_cb.result, Task::Now() - start);
 #ifdef CONFIG_ESP_MODEM_URC_HANDLER
     // Track command end
     buffer_state.command_waiting = false;
+    command_cb.command = nullptr;
 #endif
+    reset_buffer();
+    return command_cb.result;
+}
+
+void DTE::reset_buffer()
+{
     buffer.consumed = 0;
 #ifdef CONFIG_ESP_MODEM_USE_INFLATABLE_BUFFER_IF_NEEDED
-    inflatable.deflate();
+    inflatable.clear();
 #endif
-    return command_cb.result;
 }
 
 command_result DTE::command(const std::string &cmd, got_line_cb got_line, uint32_t time_ms)
@@ -179,6 +211,89 @@ command_result DTE::command(const std::string &cmd, got_line_cb got_line, uint32
     return command(cmd, got_line, time_ms, '\n');
 }
 
+bool DTE::command_async(const std::string &cmd, got_line_cb got_line, uint32_t time_ms, command_done_cb done,
+                        int priority, char separator)
+{
+    Scoped<Lock> l(queue_lock);
+    if (!queue) {
+        queue = std::make_unique<command_queue>();
+        queue->task = std::make_unique<Task>(dte_queue_task_stack_size, dte_queue_task_priority, this, [](void *p) {
+            auto dte = static_cast<DTE *>(p);
+#if !defined(CONFIG_IDF_TARGET_LINUX)
+            auto &signal = dte->queue->signal;  // outlives the task (deleted first with the queue)
+#endif
+            dte->queue_task();
+#if !defined(CONFIG_IDF_TARGET_LINUX)
+            // FreeRTOS tasks must not return, so block here to be deleted with the Task object
+            while (true) {
+                signal.wait_any(command_queue::PARKED, portMAX_DELAY);
+            }
+#endif
+        });
+    }
+    if (queue->signal.is_any(command_queue::STOP)) {
+        return false;
+    }
+    queue->pending.emplace(priority, command_queue::entry{cmd, std::move(got_line), std::move(done), time_ms, separator});
+    queue->signal.set(command_queue::PENDING);
+    return true;
+}
+
+void DTE::queue_task()
+{
+    while (true) {
+        queue->signal.wait_any(command_queue::PENDING | command_queue::STOP, portMAX_DELAY);
+        if (queue->signal.is_any(command_queue::STOP)) {
+            break;
+        }
+        command_queue::entry next;
+        {
+            Scoped<Lock> l(queue_lock);
+            if (queue->signal.is_any(command_queue::STOP)) {
+                break;
+            }
+            if (queue->pending.empty()) {
+                queue->signal.clear(command_queue::PENDING);
+                continue;
+            }
+            auto first = queue->pending.begin();
+            next = std::move(first->second);
+            queue->pending.erase(first);
+        }
+        auto result = command(next.command, next.got_line, next.time_ms, next.separator);
+        if (next.done) {
+            next.done(result);
+        }
+    }
+    // the DTE is being destroyed: report all commands which haven't been sent as failed
+    // (outside of the lock, the callbacks may try to queue other commands)
+    decltype(queue->pending) unsent;
+    {
+        Scoped<Lock> l(queue_lock);
+        unsent.swap(queue->pending);
+    }
+    for (auto &it : unsent) {
+        if (it.second.done) {
+            it.second.done(command_result::FAIL);
+        }
+    }
+    queue->signal.set(command_queue::EXITED);
+}
+
+DTE::~DTE()
+{
+    if (queue) {
+        {
+            Scoped<Lock> l(queue_lock);
+            queue->signal.set(command_queue::STOP);
+        }
+        // abort the command in progress (or about to start) rather than waiting for its timeout
+        command_cb.stop();
+        queue->signal.wait(command_queue::EXITED, portMAX_DELAY);
+        queue.reset();
+    }
+}
+
 bool DTE::exit_cmux()
 {
     if (!cmux_term) {
@@ -210,10 +325,14 @@ bool DTE::setup_cmux()
         ESP_LOGE("esp_modem_dte", "Cannot setup_cmux(), cmux_term already exists");
         return false;
     }
-    cmux_term = std::make_shared<CMux>(primary_term, std::move(buffer));
+    cmux_term = std::make_shared<CMux>(primary_term, std::move(buffer), &stats.cmux, CONFIG_ESP_MODEM_CMUX_TERMINALS);
     if (cmux_term == nullptr) {
         return false;
     }
+#if CONFIG_ESP_MODEM_CMUX_DISPATCH_QUEUE_SIZE > 0
+    // the network traffic goes ahead of the command replies
+    cmux_term->set_dispatch_priority(1, CONFIG_ESP_MODEM_CMUX_DISPATCH_TASK_PRIORITY + 1);
+#endif
 
     if (!cmux_term->init()) {
         exit_cmux_internal();
@@ -232,6 +351,23 @@ bool DTE::setup_cmux()
     return true;
 }
 
+std::unique_ptr<Terminal> DTE::create_cmux_terminal(size_t i)
+{
+    if (!cmux_term || i < 2 || i >= cmux_term->terminals_num()) {
+        return nullptr;
+    }
+    return std::make_unique<CMuxInstance>(cmux_term, i);
+}
+
+bool DTE::set_rx_flow(bool on)
+{
+    if (!cmux_term) {
+        return false;
+    }
+    cmux_term->set_rx_flow(on);
+    return true;
+}
+
 bool DTE::set_mode(modem_mode m)
 {
     // transitions (any) -> UNDEF
@@ -317,6 +453,7 @@ void DTE::set_read_cb(std::function<bool(uint8_t *, size_t)> f)
             data = buffer.get();
             len = secondary_term->read(buffer.get(), buffer.size);
         }
+        stats.data.received(len);
         if (on_data) {
             return on_data(data, len);
         }
@@ -324,6 +461,28 @@ void DTE::set_read_cb(std::function<bool(uint8_t *, size_t)> f)
     });
 }
 
+void DTE::set_data_sink(data_sink_cb sink, void *ctx)
+{
+    if (sink == nullptr) {
+        set_command_callbacks();
+        return;
+    }
+    on_data = nullptr;
+    secondary_term->set_read_cb([this, sink, ctx](uint8_t *data, size_t len) {
+        if (!data) {
+            auto read_len = secondary_term->read(buffer.get(), buffer.size);
+            if (read_len <= 0) {
+                return false;
+            }
+            data = buffer.get();
+            len = read_len;
+        }
+        stats.data.received(len);
+        sink(ctx, data, len);
+        return true;
+    });
+}
+
 void DTE::set_error_cb(std::function<void(terminal_error err)> f)
 {
     user_error_cb = std::move(f);
@@ -335,24 +494,31 @@ int DTE::read(uint8_t **d, size_t len)
     auto data_to_read = std::min(len, buffer.size);
     auto data = buffer.get();
     auto actual_len = secondary_term->read(data, data_to_read);
+    stats.data.received(actual_len);
     *d = data;
     return actual_len;
 }
 
 int DTE::write(uint8_t *data, size_t len)
 {
-    return secondary_term->write(data, len);
+    int written = secondary_term->write(data, len);
+    stats.data.sent(written);
+    return written;
 }
 
 int DTE::send(uint8_t *data, size_t len, int term_id)
 {
     Terminal *term = term_id == 0 ? primary_term.get() : secondary_term.get();
-    return term->write(data, len);
+    int written = term->write(data, len);
+    (term_id == 0 ? stats.command : stats.data).sent(written);
+    return written;
 }
 
 int DTE::write(DTE_Command command)
 {
-    return primary_term->write(command.data, command.len);
+    int written = primary_term->write(command.data, command.len);
+    stats.command.sent(written);
+    return written;
 }
 
 void DTE::on_read(got_line_cb on_read_cb)
@@ -369,6 +535,7 @@ void DTE::on_read(got_line_cb on_read_cb)
             data = buffer.get();
             len = primary_term->read(data, buffer.size);
         }
+        stats.command.received(len);
         auto res = on_read_cb(data, len);
         if (res == command_result::OK || res == command_result::FAIL) {
             primary_term->set_read_cb(nullptr);
@@ -382,6 +549,15 @@ bool DTE::command_cb::process_line(uint8_t *data, size_t consumed, size_t len, D
 {
     // returning true indicates that the processing finished and lower layers can destroy the accumulated buffer
 #ifdef CONFIG_ESP_MODEM_URC_HANDLER
+    // lines of by_line commands are routed below, otherwise we dispatch the URC lines here
+    if (!urc_router.empty() && !(by_line && got_line && result == command_result::TIMEOUT)) {
+        if (route_lines(data, consumed, len) && !got_line && !urc_handler && !enhanced_urc_handler && dte) {
+            // no command in progress and no partial line left, so the data could be discarded
+            dte->reset_buffer();
+            return true;
+        }
+    }
+
     // Call enhanced URC handler if registered
     if (enhanced_urc_handler && dte) {
         // Create buffer info for enhanced URC handler
@@ -415,17 +591,50 @@ bool DTE::command_cb::process_line(uint8_t *data, size_t consumed, size_t len, D
     // Fallback to legacy URC handler if enhanced handler not set
     if (urc_handler) {
         bool consume_buffer = urc_handler(data, consumed + len) != command_result::TIMEOUT;
-        if (result != command_result::TIMEOUT || got_line == nullptr) {
+        if (result != command_result::TIMEOUT || !got_line) {
             return consume_buffer;   // this line has been processed already (got OK or FAIL previously)
         }
     }
 #endif
 
     // Continue with normal command processing
-    if (result != command_result::TIMEOUT || got_line == nullptr) {
+    if (result != command_result::TIMEOUT || !got_line) {
         return false;  // Command processing continues
     }
 
+    if (by_line) {
+        if (consumed == 0 || line_start > consumed) {
+            line_start = 0;     // processing a new buffer
+        }
+        // look for separators only in the new data, and pass each complete line once
+        uint8_t *end = data + consumed + len;
+        uint8_t *from = data + consumed;
+        while (auto sep = static_cast<uint8_t *>(memchr(from, separator, end - from))) {
+            uint8_t *line = data + line_start;
+            size_t line_len = sep - line + 1;
+            line_start += line_len;
+            from = sep + 1;
+#ifdef CONFIG_ESP_MODEM_URC_HANDLER
+            if (separator == '\n' && urc_router.dispatch(line, line_len, command, command_len)) {
+                continue;   // unsolicited line, not passed to the command
+            }
+#endif
+            result = got_line(line, line_len);
+            if (result == command_result::OK || result == command_result::FAIL) {
+#ifdef CONFIG_ESP_MODEM_URC_HANDLER
+                // the buffer is reset after the final reply, so the complete lines read with it are routed now
+                while (separator == '\n' && (sep = static_cast<uint8_t *>(memchr(from, '\n', end - from)))) {
+                    urc_router.dispatch(from, sep - from + 1, nullptr, 0);
+                    line_start += sep - from + 1;
+                    from = sep + 1;
+                }
+#endif
+                signal.set(GOT_LINE);
+                return true;
+            }
+        }
+        return false;
+    }
     if (memchr(data + consumed, separator, len)) {
         result = got_line(data, consumed + len);
         if (result == command_result::OK || result == command_result::FAIL) {
@@ -436,6 +645,26 @@ bool DTE::command_cb::process_line(uint8_t *data, size_t consumed, size_t len, D
     return false;
 }
 
+#ifdef CONFIG_ESP_MODEM_URC_HANDLER
+bool DTE::command_cb::route_lines(uint8_t *data, size_t consumed, size_t len)
+{
+    // URC lines are tracked the same way as the lines of by_line commands, so each of them is dispatched once
+    if (consumed == 0 || line_start > consumed) {
+        line_start = 0;
+    }
+    uint8_t *end = data + consumed + len;
+    uint8_t *from = data + consumed;
+    while (auto sep = static_cast<uint8_t *>(memchr(from, '\n', end - from))) {
+        uint8_t *line = data + line_start;
+        size_t line_len = sep - line + 1;
+        line_start += line_len;
+        from = sep + 1;
+        urc_router.dispatch(line, line_len, got_line ? command : nullptr, command_len);
+    }
+    return line_start == consumed + len;
+}
+#endif
+
 bool DTE::recover()
 {
     if (mode == modem_mode::CMUX_MODE || mode == modem_mode::CMUX_MANUAL_MODE || mode == modem_mode::DUAL_MODE) {
@@ -446,6 +675,9 @@ bool DTE::recover()
 
 void DTE::handle_error(terminal_error err)
 {
+    if (static_cast<size_t>(err) < dte_stats::terminal_errors) {
+        stats.errors[static_cast<size_t>(err)].add();
+    }
     if (err == terminal_error::BUFFER_OVERFLOW ||
             err == terminal_error::CHECKSUM_ERROR ||
             err == terminal_error::UNEXPECTED_CONTROL_FLOW) {
@@ -453,19 +685,63 @@ void DTE::handle_error(terminal_error err)
     }
 }
 
-#ifdef CONFIG_ESP_MODEM_USE_INFLATABLE_BUFFER_IF_NEEDED
-void DTE::extra_buffer::grow(size_t need_size)
+void DTE::get_stats(dte_stats &s)
 {
-    if (need_size == 0) {
-        delete buffer;
-        buffer = nullptr;
-    } else if (buffer == nullptr) {
-        buffer = new std::vector<uint8_t>(need_size);
-    } else {
-        buffer->resize(need_size);
+    stats.command.get(s.command);
+    stats.data.get(s.data);
+    s.buffer_high_water = stats.buffer_high_water.get();
+    s.inflatable_high_water = stats.inflatable_high_water.get();
+    for (size_t i = 0; i < dte_stats::terminal_errors; ++i) {
+        s.errors[i] = stats.errors[i].get();
     }
+    stats.cmux.get(s.cmux);
+    Scoped<Lock> l(stats.commands_lock);
+    s.latency = stats.latency;
+    s.commands = stats.sent;
+    s.timeouts = stats.timeouts;
+    s.command_count = stats.command_count;
+    std::copy(stats.per_command, stats.per_command + stats.command_count, s.per_command);
+}
+
+void DTE::stats_counters::add_command(const char *command, size_t len, command_result result, uint32_t ms)
+{
+    // the command name is the text preceding its parameters, e.g. "AT+CPIN" of "AT+CPIN=1234\r"
+    size_t name_len = 0;
+    while (name_len < len && name_len < command_stats::name_len - 1 && strchr("=?\r\n", command[name_len]) == nullptr) {
+        name_len++;
+    }
+    Scoped<Lock> l(commands_lock);
+    command_stats *entry = nullptr;
+    for (size_t i = 0; i < command_count; ++i) {
+        if (strncmp(per_command[i].name, command, name_len) == 0 && per_command[i].name[name_len] == '\0') {
+            entry = &per_command[i];
+            break;
+        }
+    }
+    if (entry == nullptr) {
+        // the last entry is reserved for all the commands which don't fit
+        if (command_count < dte_stats::max_commands - 1) {
+            entry = &per_command[command_count++];
+            memcpy(entry->name, command, name_len);
+        } else {
+            entry = &per_command[dte_stats::max_commands - 1];
+            entry->name[0] = '*';
+            command_count = dte_stats::max_commands;
+        }
+    }
+    sent++;
+    entry->sent++;
+    if (result == command_result::TIMEOUT) {
+        timeouts++;
+        entry->timeouts++;
+        return;
+    }
+    if (result == command_result::FAIL) {
+        entry->failures++;
+    }
+    latency.add(ms);
+    entry->latency.add(ms);
 }
-#endif
 
 /**
  * Implemented here to keep all headers C++11 compliant
@@ -473,7 +749,116 @@ void DTE::extra_buffer::grow(size_t need_size)
 unique_buffer::unique_buffer(size_t size):
     data(std::make_unique<uint8_t[]>(size)), size(size), consumed(0) {}
 
+uint8_t *ring_buffer::prepare(size_t need)
+{
+    if (data == nullptr || len + need > cap) {
+        reserve(std::max(len + need, data ? 2 * cap : cap));
+    }
+    if (len == 0) {
+        head = 0;
+    }
+    size_t tail = head + len;
+    size_t space = tail < cap ? cap - tail : head - (tail - cap);
+    if (space < need) {
+        // enough free space in total, but split around the stored data: move it to the front
+        std::rotate(data.get(), data.get() + head, data.get() + cap);
+        head = 0;
+        tail = len;
+    }
+    return data.get() + tail % cap;
+}
+
+void ring_buffer::commit(size_t n)
+{
+    len += n;
+}
+
+void ring_buffer::append(const uint8_t *src, size_t n)
+{
+    std::memcpy(prepare(n), src, n);
+    commit(n);
+}
+
+void ring_buffer::consume(size_t n)
+{
+    n = std::min(n, len);
+    len -= n;
+    head = len == 0 ? 0 : (head + n) % cap;
+}
+
+std::pair<buffer_view, buffer_view> ring_buffer::readable() const
+{
+    if (data == nullptr) {
+        return { {nullptr, 0}, {nullptr, 0} };
+    }
+    size_t first = std::min(len, cap - head);
+    return { {data.get() + head, first}, {data.get(), len - first} };
+}
+
+uint8_t *ring_buffer::linearize()
+{
+    if (data != nullptr && head + len > cap) {
+        std::rotate(data.get(), data.get() + head, data.get() + cap);
+        head = 0;
+    }
+    return data.get() + head;
+}
+
+void ring_buffer::reserve(size_t new_cap)
+{
+    if (data != nullptr && new_cap <= cap) {
+        return;
+    }
+    new_cap = std::max(new_cap, cap);
+    auto storage = std::make_unique<uint8_t[]>(new_cap);
+    if (data != nullptr) {
+        auto views = readable();
+        std::memcpy(storage.get(), views.first.data, views.first.len);
+        std::memcpy(storage.get() + views.first.len, views.second.data, views.second.len);
+    }
+    data = std::move(storage);
+    cap = new_cap;
+    head = 0;
+}
+
+void block_pool::configure(size_t block_size, size_t max_blocks)
+{
+    if (block_size != size) {
+        blocks.clear();
+        free_blocks.clear();
+    }
+    size = block_size;
+    count = max_blocks;
+    blocks.reserve(count);
+    free_blocks.reserve(count);
+}
+
+uint8_t *block_pool::acquire()
+{
+    if (free_blocks.empty()) {
+        if (blocks.size() >= count) {
+            return nullptr;
+        }
+        blocks.push_back(std::make_unique<uint8_t[]>(size));
+        return blocks.back().get();
+    }
+    auto block = free_blocks.back();
+    free_blocks.pop_back();
+    return block;
+}
+
+void block_pool::release(uint8_t *block)
+{
+    free_blocks.push_back(block);
+}
+
 #ifdef CONFIG_ESP_MODEM_URC_HANDLER
+void DTE::add_urc_handler(const std::string &prefix, UrcRouter::handler_cb handler)
+{
+    Scoped<Lock> l(command_cb.line_lock);
+    command_cb.urc_router.add(prefix, std::move(handler));
+}
+
 void DTE::update_buffer_state(size_t new_data_size)
 {
     buffer_state.total_processed += new_data_size;
@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "cxx_include/esp_modem_flush_queue.hpp"
+
+namespace esp_modem {
+
+void flush_queue::append(const uint8_t *data, size_t len)
+{
+    Scoped<Lock> l(lock);
+    pending.insert(pending.end(), data, data + len);
+}
+
+uint64_t flush_queue::end()
+{
+    Scoped<Lock> l(lock);
+    return taken + pending.size();
+}
+
+bool flush_queue::wait_for_room(size_t limit, uint32_t time_ms)
+{
+    auto start = Task::Now();
+    while (true) {
+        {
+            Scoped<Lock> l(lock);
+            if (!flushing || pending.size() < limit) {
+                return true;
+            }
+            room.clear(1);
+        }
+        uint32_t elapsed = Task::Now() - start;
+        if (elapsed >= time_ms || !room.wait(1, time_ms - elapsed)) {
+            return false;
+        }
+    }
+}
+
+bool flush_queue::flush(uint64_t from, uint64_t to)
+{
+    bool ok = true;
+    {
+        Scoped<Lock> l(lock);
+        if (lost) {
+            lost = false;
+            ok = false;
+        }
+        if (flushing) {
+            return ok;      // the passing thread takes our data, too
+        }
+        flushing = true;
+    }
+    while (true) {
+        uint64_t batch_start;
+        {
+            Scoped<Lock> l(lock);
+            out.clear();
+            if (pending.empty()) {
+                flushing = false;
+                room.set(1);
+                return ok;
+            }
+            std::swap(pending, out);
+            batch_start = taken;
+            taken += out.size();
+        }
+        room.set(1);        // the threads waiting for the queue to shrink can go on
+        size_t passed = output(out.data(), out.size());
+        if (passed < out.size()) {
+            uint64_t lost_from = batch_start + passed;
+            uint64_t lost_to = batch_start + out.size();
+            if (lost_from < to && lost_to > from) {
+                ok = false;
+            }
+            if (lost_from < from || lost_to > to) {
+                Scoped<Lock> l(lock);
+                lost = true;
+            }
+        }
+    }
+}
+
+} // namespace esp_modem
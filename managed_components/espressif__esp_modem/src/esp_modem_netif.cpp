@@ -30,10 +30,9 @@ void Netif::on_ppp_changed(void *arg, esp_event_base_t event_base,
 esp_err_t Netif::esp_modem_dte_transmit(void *h, void *buffer, size_t len)
 {
     auto *ppp = static_cast<Netif *>(h);
-    if (ppp->signal.is_any(PPP_STARTED)) {
-        if (ppp->ppp_dte && ppp->ppp_dte->write((uint8_t *) buffer, len) > 0) {
-            return ESP_OK;
-        }
+    if (ppp->is_running() && ppp->ppp_dte && ppp->ppp_dte->write((uint8_t *) buffer, len) > 0) {
+        ppp->count_sent(len);
+        return ESP_OK;
     }
     return ESP_FAIL;
 }
@@ -66,7 +65,22 @@ esp_err_t Netif::esp_modem_post_attach(esp_netif_t *esp_netif, void *args)
 
 void Netif::receive(uint8_t *data, size_t len)
 {
-    esp_netif_receive(driver.base.netif, data, len, nullptr);
+#if CONFIG_ESP_MODEM_PPP_RX_BATCH_SIZE > 0
+    rx_batch.receive(data, len, count_received(data, len) > 0);
+#else
+    count_received(data, len);
+    on_frames(this, data, len);
+#endif
+}
+
+void Netif::on_frames(void *ctx, uint8_t *data, size_t len)
+{
+    esp_netif_receive(static_cast<Netif *>(ctx)->driver.base.netif, data, len, nullptr);
+}
+
+void Netif::on_data(void *ctx, uint8_t *data, size_t len)
+{
+    static_cast<Netif *>(ctx)->receive(data, len);
 }
 
 Netif::Netif(std::shared_ptr<DTE> e, esp_netif_t *ppp_netif) :
@@ -88,12 +102,9 @@ Netif::Netif(std::shared_ptr<DTE> e, esp_netif_t *ppp_netif) :
 
 void Netif::start()
 {
-    ppp_dte->set_read_cb([this](uint8_t *data, size_t len) -> bool {
-        receive(data, len);
-        return true;
-    });
-    if (!signal.is_any(PPP_STARTED)) {
-        signal.set(PPP_STARTED);
+    ppp_dte->set_data_sink(on_data, this);
+    if (!is_running()) {
+        set_running(true);
         esp_netif_action_start(driver.base.netif, nullptr, 0, nullptr);
     }
 }
@@ -101,28 +112,30 @@ void Netif::start()
 void Netif::stop()
 {
     esp_netif_action_stop(driver.base.netif, nullptr, 0, nullptr);
-    signal.clear(PPP_STARTED);
+    set_running(false);
+    // the next session starts with a new frame
+    rx_in_frame = false;
+#if CONFIG_ESP_MODEM_PPP_RX_BATCH_SIZE > 0
+    rx_batch.clear();
+#endif
 }
 
 void Netif::resume()
 {
-    ppp_dte->set_read_cb([this](uint8_t *data, size_t len) -> bool {
-        receive(data, len);
-        return true;
-    });
-    signal.set(PPP_STARTED);
+    ppp_dte->set_data_sink(on_data, this);
+    set_running(true);
 }
 
 void Netif::pause()
 {
-    signal.clear(PPP_STARTED);
+    set_running(false);
 }
 
 Netif::~Netif()
 {
-    if (signal.is_any(PPP_STARTED)) {
+    if (is_running()) {
         esp_netif_action_stop(driver.base.netif, nullptr, 0, nullptr);
-        signal.clear(PPP_STARTED);
+        set_running(false);
         signal.wait(PPP_EXIT, 30000);
     }
 #ifdef CONFIG_ESP_MODEM_USE_PPP_MODE
@@ -18,7 +18,9 @@ void Netif::on_ppp_changed(void *arg, esp_event_base_t event_base,
 esp_err_t Netif::esp_modem_dte_transmit(void *h, void *buffer, size_t len)
 {
     auto *this_netif = static_cast<Netif *>(h);
-    this_netif->ppp_dte->write((uint8_t *) buffer, len);
+    if (this_netif->is_running() && this_netif->ppp_dte->write((uint8_t *) buffer, len) > 0) {
+        this_netif->count_sent(len);
+    }
     return len;
 }
 
@@ -29,7 +31,22 @@ esp_err_t Netif::esp_modem_post_attach(esp_netif_t *esp_netif, void *args)
 
 void Netif::receive(uint8_t *data, size_t len)
 {
-    esp_netif_receive(driver.base.netif, data, len);
+#if CONFIG_ESP_MODEM_PPP_RX_BATCH_SIZE > 0
+    rx_batch.receive(data, len, count_received(data, len) > 0);
+#else
+    count_received(data, len);
+    on_frames(this, data, len);
+#endif
+}
+
+void Netif::on_frames(void *ctx, uint8_t *data, size_t len)
+{
+    esp_netif_receive(static_cast<Netif *>(ctx)->driver.base.netif, data, len);
+}
+
+void Netif::on_data(void *ctx, uint8_t *data, size_t len)
+{
+    static_cast<Netif *>(ctx)->receive(data, len);
 }
 
 Netif::Netif(std::shared_ptr<DTE> e, esp_netif_t *ppp_netif) :
@@ -41,18 +58,20 @@ Netif::Netif(std::shared_ptr<DTE> e, esp_netif_t *ppp_netif) :
 
 void Netif::start()
 {
-    ppp_dte->set_read_cb([this](uint8_t *data, size_t len) -> bool {
-        receive(data, len);
-        return true;
-    });
+    ppp_dte->set_data_sink(on_data, this);
     driver.base.netif->transmit = esp_modem_dte_transmit;
     driver.base.netif->ctx = (void *)this;
-    signal.set(PPP_STARTED);
+    set_running(true);
 }
 
 void Netif::stop()
 {
-    signal.clear(PPP_STARTED);
+    set_running(false);
+    // the next session starts with a new frame
+    rx_in_frame = false;
+#if CONFIG_ESP_MODEM_PPP_RX_BATCH_SIZE > 0
+    rx_batch.clear();
+#endif
 }
 
 Netif::~Netif() = default;
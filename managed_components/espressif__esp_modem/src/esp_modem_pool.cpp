@@ -0,0 +1,155 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include "esp_log.h"
+#include "cxx_include/esp_modem_pool.hpp"
+
+static const char *TAG = "modem_pool";
+
+namespace esp_modem {
+
+size_t ModemPool::add(std::unique_ptr<DCE> dce)
+{
+    ESP_MODEM_THROW_IF_FALSE(dce != nullptr, "Invalid argument: DCE cannot be null");
+    auto m = std::make_unique<member>();
+    m->index = modems.size();
+    m->dce = std::move(dce);
+    m->health = modem_health{true, 99, 99, -1, 0, 0, 0};
+    modems.push_back(std::move(m));
+    return modems.size() - 1;
+}
+
+size_t ModemPool::add(dce_factory::Factory &factory, const dce_factory::config *dce_cfg, std::shared_ptr<DTE> dte, esp_netif_t *netif)
+{
+    return add(factory.build_unique(dce_cfg, std::move(dte), netif));
+}
+
+size_t ModemPool::check_health()
+{
+    size_t healthy = 0;
+    for (auto &m : modems) {
+        int rssi = 99, ber = 99, registration = -1;
+        bool ok;
+        {
+            Scoped<Lock> busy(m->busy);
+            ok = m->dce->sync() == command_result::OK;
+            if (ok && m->dce->get_signal_quality(rssi, ber) != command_result::OK) {
+                rssi = ber = 99;
+            }
+            if (ok && m->dce->get_network_registration_state(registration) != command_result::OK) {
+                registration = -1;
+            }
+        }
+        if (ok && cfg.require_registration) {
+            ok = registration == 1 || registration == 5;    // registered, home network or roaming
+        }
+        Scoped<Lock> l(lock);
+        m->health.rssi = rssi;
+        m->health.ber = ber;
+        m->health.registration = registration;
+        m->health.healthy = ok;
+        if (ok) {
+            m->health.failures = 0;
+            healthy++;
+        } else {
+            ESP_LOGW(TAG, "Modem %d is not healthy", static_cast<int>(m->index));
+        }
+    }
+    return healthy;
+}
+
+modem_health ModemPool::health(size_t index)
+{
+    Scoped<Lock> l(lock);
+    return modems.at(index)->health;
+}
+
+/**
+ * @brief The least loaded modem wins, ties are broken by better signal and then by fewer jobs done
+ * (so that the sequential jobs rotate over the modems)
+ */
+static bool preferred(const modem_health &a, const modem_health &b)
+{
+    if (a.load != b.load) {
+        return a.load < b.load;
+    }
+    int rssi_a = a.rssi == 99 ? -1 : a.rssi;
+    int rssi_b = b.rssi == 99 ? -1 : b.rssi;
+    if (rssi_a != rssi_b) {
+        return rssi_a > rssi_b;
+    }
+    return a.jobs < b.jobs;
+}
+
+ModemPool::member *ModemPool::acquire(std::vector<member *> &tried)
+{
+    Scoped<Lock> l(lock);
+    member *best = nullptr;
+    for (auto &m : modems) {
+        if (!m->health.healthy || std::find(tried.begin(), tried.end(), m.get()) != tried.end()) {
+            continue;
+        }
+        if (best == nullptr || preferred(m->health, best->health)) {
+            best = m.get();
+        }
+    }
+    if (best) {
+        best->health.load++;
+        tried.push_back(best);
+    }
+    return best;
+}
+
+void ModemPool::release(member *m, command_result result)
+{
+    Scoped<Lock> l(lock);
+    m->health.load--;
+    m->health.jobs++;
+    if (result == command_result::OK) {
+        m->health.failures = 0;
+        return;
+    }
+    if (++m->health.failures >= cfg.max_failures && m->health.healthy) {
+        ESP_LOGW(TAG, "Modem %d failed %d jobs in a row, taking it out of rotation", static_cast<int>(m->index), static_cast<int>(m->health.failures));
+        m->health.healthy = false;
+    }
+}
+
+command_result ModemPool::run(const job_cb &job, size_t *used)
+{
+    command_result result = command_result::FAIL;
+    std::vector<member *> tried;
+    tried.reserve(cfg.attempts);
+    for (size_t attempt = 0; attempt < cfg.attempts; ++attempt) {
+        auto m = acquire(tried);
+        if (m == nullptr) {
+            break;
+        }
+        {
+            Scoped<Lock> busy(m->busy);
+            result = job(*m->dce);
+        }
+        release(m, result);
+        if (used) {
+            *used = m->index;
+        }
+        if (result == command_result::OK) {
+            break;
+        }
+        ESP_LOGD(TAG, "Job failed on modem %d", static_cast<int>(m->index));
+    }
+    return result;
+}
+
+command_result ModemPool::send_sms(const std::string &number, const std::string &message, size_t *used)
+{
+    return run([&number, &message](DCE & dce) {
+        return dce.send_sms(number, message);
+    }, used);
+}
+
+} // namespace esp_modem
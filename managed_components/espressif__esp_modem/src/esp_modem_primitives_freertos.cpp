@@ -53,7 +53,8 @@ void SignalGroup::clear(uint32_t bits)
 bool SignalGroup::wait(uint32_t flags, uint32_t time_ms)
 {
     EventBits_t bits = xEventGroupWaitBits(event_group, flags, pdTRUE, pdTRUE, pdMS_TO_TICKS(time_ms));
-    return bits & flags;
+    // on timeout the bits set so far are returned, waiting succeeds only if all of them were set
+    return (bits & flags) == flags;
 }
 
 bool SignalGroup::is_any(uint32_t flags)
@@ -103,4 +104,9 @@ void Task::Delay(uint32_t ms)
     vTaskDelay(pdMS_TO_TICKS(ms));
 }
 
+uint32_t Task::Now()
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
 } // namespace esp_modem
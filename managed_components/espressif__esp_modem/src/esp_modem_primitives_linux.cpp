@@ -86,4 +86,10 @@ void Task::Delay(uint32_t ms)
     usleep(ms * 1000);
 }
 
+uint32_t Task::Now()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
 } // namespace esp_modem
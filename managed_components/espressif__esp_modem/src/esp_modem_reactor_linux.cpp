@@ -0,0 +1,152 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "esp_log.h"
+#include "fd_reactor.hpp"
+
+static const char *TAG = "fd_reactor";
+
+namespace esp_modem {
+
+std::shared_ptr<Reactor> Reactor::get()
+{
+    static std::mutex instance_lock;
+    static std::weak_ptr<Reactor> instance;
+    std::lock_guard<std::mutex> l(instance_lock);
+    auto reactor = instance.lock();
+    if (!reactor) {
+        reactor.reset(new Reactor());
+        instance = reactor;
+    }
+    return reactor;
+}
+
+Reactor::FileDescriptor::~FileDescriptor()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+Reactor::Reactor():
+    epoll{epoll_create1(EPOLL_CLOEXEC)},
+    wakeup{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+    thread(&Reactor::run, this)
+{}
+
+Reactor::~Reactor()
+{
+    exiting = true;
+    uint64_t one = 1;
+    if (::write(wakeup.fd, &one, sizeof(one)) < 0) {
+        ESP_LOGE(TAG, "Cannot wake up the reactor: %d", errno);
+    }
+    if (thread.get_id() == std::this_thread::get_id()) {
+        // the last client released the reactor from its callback: the thread cannot join itself,
+        // so it's detached and returns from run() without touching the destroyed members
+        *destroyed = true;
+        thread.detach();
+        return;
+    }
+    thread.join();
+}
+
+uint64_t Reactor::add(int fd, ReactorClient *client)
+{
+    std::lock_guard<std::mutex> l(clients_lock);
+    auto id = next_id++;
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = id;
+    if (epoll_ctl(epoll.fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        ESP_LOGE(TAG, "Cannot poll fd %d: %d", fd, errno);
+        return 0;
+    }
+    clients[id] = client;
+    return id;
+}
+
+void Reactor::remove(uint64_t id, int fd)
+{
+    epoll_ctl(epoll.fd, EPOLL_CTL_DEL, fd, nullptr);
+    std::unique_lock<std::mutex> l(clients_lock);
+    clients.erase(id);
+    if (reactor_thread != std::this_thread::get_id()) {
+        dispatched.wait(l, [this, id] { return current != id; });
+    }
+}
+
+bool Reactor::rearm(uint64_t id, int fd)
+{
+    // epoll_ctl() is thread safe, no need to lock (and so it's safe to call from any callback)
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = id;
+    return epoll_ctl(epoll.fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void Reactor::run()
+{
+    bool is_destroyed = false;
+    {
+        std::lock_guard<std::mutex> l(clients_lock);
+        reactor_thread = std::this_thread::get_id();
+        destroyed = &is_destroyed;
+    }
+    if (epoll.fd < 0 || wakeup.fd < 0) {
+        ESP_LOGE(TAG, "Cannot create the reactor descriptors");
+        return;
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = wakeup_id;
+    epoll_ctl(epoll.fd, EPOLL_CTL_ADD, wakeup.fd, &ev);
+
+    const int max_events = 16;
+    struct epoll_event events[max_events];
+    while (!exiting) {
+        int n = epoll_wait(epoll.fd, events, max_events, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "epoll_wait() failed: %d", errno);
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            auto id = events[i].data.u64;
+            if (id == wakeup_id) {
+                continue;   // just checks the exit flag
+            }
+            ReactorClient *client;
+            {
+                // the client might have been removed after epoll_wait() returned
+                std::lock_guard<std::mutex> l(clients_lock);
+                auto it = clients.find(id);
+                if (it == clients.end()) {
+                    continue;
+                }
+                client = it->second;
+                current = id;
+            }
+            client->on_readable();
+            if (is_destroyed) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> l(clients_lock);
+                current = 0;
+            }
+            dispatched.notify_all();
+        }
+    }
+}
+
+} // namespace esp_modem
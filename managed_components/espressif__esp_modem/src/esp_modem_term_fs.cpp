@@ -5,11 +5,16 @@
  */
 
 #include <optional>
+#include <atomic>
 #include <unistd.h>
 #include "cxx_include/esp_modem_dte.hpp"
 #include "esp_log.h"
 #include "esp_modem_config.h"
 #include "exception_stub.hpp"
+#include "uart_resource.hpp"
+#if defined(CONFIG_IDF_TARGET_LINUX)
+#include "fd_reactor.hpp"
+#endif
 
 static const char *TAG = "fs_terminal";
 
@@ -32,6 +37,60 @@ struct File {
     struct esp_modem_vfs_resource *resource;
 };
 
+#if defined(CONFIG_IDF_TARGET_LINUX)
+/**
+ * @brief On Linux, the terminals don't have their own tasks, but they're all served by one epoll reactor
+ */
+class FdTerminal : public Terminal, private ReactorClient {
+public:
+    explicit FdTerminal(const esp_modem_dte_config *config);
+
+    ~FdTerminal() override;
+
+    void start() override
+    {
+        running = true;
+        reactor->rearm(id, f.fd);
+    }
+
+    void stop() override
+    {
+        running = false;
+    }
+
+    int write(uint8_t *data, size_t len) override;
+
+    int read(uint8_t *data, size_t len) override;
+
+    void set_read_cb(std::function<bool(uint8_t *data, size_t len)> cb) override
+    {
+        {
+            Scoped<Lock> l(on_read_lock);
+            on_read = std::move(cb);
+        }
+        params_changed = true;
+        reactor->rearm(id, f.fd);   // delivers the data which might have been waiting for the callback
+    }
+
+    bool set_baud_rate(int baud) override
+    {
+        return uart_set_baud_rate(f.fd, baud);     // fails on non serial fds (e.g. sockets)
+    }
+
+private:
+    void on_readable() override;
+
+    File f;
+    std::shared_ptr<Reactor> reactor;
+    uint64_t id;
+    std::atomic<bool> running{false};
+    std::atomic<bool> params_changed{false};
+    std::atomic<bool> progress{false};                  /*!< The callback has read some data */
+    std::atomic<bool> parked{false};                    /*!< Not re-armed, as the callback left the data unread */
+    Lock on_read_lock;
+    std::function<bool(uint8_t *data, size_t len)> on_read_priv;   /*!< Callback copy used by the reactor thread */
+};
+#else
 class FdTerminal : public Terminal {
 public:
     explicit FdTerminal(const esp_modem_dte_config *config);
@@ -70,6 +129,7 @@ private:
     SignalGroup signal;
     Task task_handle;
 };
+#endif // CONFIG_IDF_TARGET_LINUX
 
 std::unique_ptr<Terminal> create_vfs_terminal(const esp_modem_dte_config *config)
 {
@@ -80,6 +140,43 @@ std::unique_ptr<Terminal> create_vfs_terminal(const esp_modem_dte_config *config
     )
 }
 
+#if defined(CONFIG_IDF_TARGET_LINUX)
+FdTerminal::FdTerminal(const esp_modem_dte_config *config) :
+    f(config), reactor(Reactor::get()), id(reactor->add(f.fd, this))
+{
+    ESP_MODEM_THROW_IF_FALSE(id != 0, "Cannot poll the fd");
+}
+
+void FdTerminal::on_readable()
+{
+    // one callback per notification, so that a single flooding modem doesn't starve the others;
+    // re-armed if the callback has read something (and gets notified again if it left some data).
+    // If it hasn't (e.g. the DTE waits for no reply), the notification is parked, otherwise the level
+    // triggered descriptor would spin the reactor, and the next write (of a command) re-arms it
+    parked = true;
+    if (!running) {
+        return;
+    }
+    if (params_changed.exchange(false)) {
+        Scoped<Lock> l(on_read_lock);
+        on_read_priv = on_read;
+    }
+    if (!on_read_priv) {
+        return;
+    }
+    progress = false;
+    on_read_priv(nullptr, 0);
+    if (progress && parked.exchange(false)) {
+        reactor->rearm(id, f.fd);
+    }
+}
+
+FdTerminal::~FdTerminal()
+{
+    running = false;
+    reactor->remove(id, f.fd);
+}
+#else
 FdTerminal::FdTerminal(const esp_modem_dte_config *config) :
     f(config), signal(),
     task_handle(config->task_stack_size, config->task_priority, this, [](void *p)
@@ -130,6 +227,13 @@ void FdTerminal::task()
     }
 }
 
+FdTerminal::~FdTerminal()
+{
+    FdTerminal::stop();
+    signal.set(TASK_STOP);  // releases the task if it hasn't seen the start yet (otherwise the join never returns)
+}
+#endif // CONFIG_IDF_TARGET_LINUX
+
 int FdTerminal::read(uint8_t *data, size_t len)
 {
     int size = ::read(f.fd, data, len);
@@ -139,7 +243,11 @@ int FdTerminal::read(uint8_t *data, size_t len)
         }
         return 0;
     }
-
+#if defined(CONFIG_IDF_TARGET_LINUX)
+    if (size > 0) {
+        progress = true;
+    }
+#endif
     return size;
 }
 
@@ -150,12 +258,12 @@ int FdTerminal::write(uint8_t *data, size_t len)
         ESP_LOGE(TAG, "Error occurred during read: %d", errno);
         return 0;
     }
+#if defined(CONFIG_IDF_TARGET_LINUX)
+    if (parked.exchange(false)) {
+        reactor->rearm(id, f.fd);
+    }
+#endif
     return size;
 }
 
-FdTerminal::~FdTerminal()
-{
-    FdTerminal::stop();
-}
-
 } // namespace esp_modem
@@ -0,0 +1,144 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstring>
+#include "cxx_include/esp_modem_trace.hpp"
+#include "cxx_include/esp_modem_exception.hpp"
+
+#if defined(CONFIG_IDF_TARGET_LINUX)
+#include <chrono>
+#else
+#include "esp_timer.h"
+#endif
+
+namespace esp_modem {
+
+static const uint8_t trace_header[] = { 'E', 'M', 'T', 'R', 1 };
+
+static uint64_t now_us()
+{
+#if defined(CONFIG_IDF_TARGET_LINUX)
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static size_t put_varint(uint8_t *out, uint64_t value)
+{
+    size_t i = 0;
+    while (value >= 0x80) {
+        out[i++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[i++] = static_cast<uint8_t>(value);
+    return i;
+}
+
+static bool get_varint(const uint8_t *data, size_t len, size_t &pos, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < len; shift += 7) {
+        uint8_t byte = data[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TraceReader::TraceReader(const uint8_t *trace, size_t len): trace(trace), len(len), pos(0)
+{
+    if (trace != nullptr && len >= sizeof(trace_header) && memcmp(trace, trace_header, sizeof(trace_header)) == 0) {
+        pos = sizeof(trace_header);
+    }
+}
+
+bool TraceReader::next(trace_record &record)
+{
+    uint64_t delta, header;
+    if (pos == 0 || !get_varint(trace, len, pos, delta) || !get_varint(trace, len, pos, header)) {
+        return false;
+    }
+    uint64_t payload_len = header >> 1;
+    if (payload_len > len - pos) {
+        return false;
+    }
+    time_us += delta;
+    record.time_us = time_us;
+    record.sent = header & 1;
+    record.data = trace + pos;
+    record.len = payload_len;
+    pos += payload_len;
+    return true;
+}
+
+RecordingTerminal::RecordingTerminal(std::unique_ptr<Terminal> t, sink_cb s):
+    term(std::move(t)), sink(std::move(s)), last_us(now_us()),
+    records([this](uint8_t *data, size_t len) {
+        // called without the lock (the sink might block on a file or call back into the DTE),
+        // but from one thread at a time, so that the records keep their order
+        sink(data, len);
+        return len;
+    })
+{
+    ESP_MODEM_THROW_IF_FALSE(term != nullptr && sink != nullptr, "Invalid argument: terminal and sink cannot be null");
+    term->set_error_cb([this](terminal_error err) {
+        if (on_error) {
+            on_error(err);
+        }
+    });
+    sink(trace_header, sizeof(trace_header));
+}
+
+void RecordingTerminal::record(bool sent, const uint8_t *data, size_t len)
+{
+    uint8_t header[20];
+    {
+        Scoped<Lock> l(records.lock);
+        auto now = now_us();
+        size_t header_len = put_varint(header, now - last_us);
+        header_len += put_varint(header + header_len, (static_cast<uint64_t>(len) << 1) | (sent ? 1 : 0));
+        last_us = now;
+        records.append(header, header_len);
+        records.append(data, len);
+    }
+    records.flush();
+}
+
+int RecordingTerminal::write(uint8_t *data, size_t len)
+{
+    record(true, data, len);
+    return term->write(data, len);
+}
+
+int RecordingTerminal::read(uint8_t *data, size_t len)
+{
+    int actual = term->read(data, len);
+    if (actual > 0) {
+        record(false, data, actual);
+    }
+    return actual;
+}
+
+void RecordingTerminal::set_read_cb(std::function<bool(uint8_t *data, size_t len)> f)
+{
+    if (f == nullptr) {
+        term->set_read_cb(nullptr);
+        on_read = nullptr;
+        return;
+    }
+    on_read = std::move(f);
+    term->set_read_cb([this](uint8_t *data, size_t len) {
+        if (data) {     // otherwise the data get recorded when read
+            record(false, data, len);
+        }
+        return on_read(data, len);
+    });
+}
+
+} // namespace esp_modem
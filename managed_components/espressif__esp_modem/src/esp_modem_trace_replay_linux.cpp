@@ -0,0 +1,167 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <chrono>
+#include "esp_log.h"
+#include "cxx_include/esp_modem_trace.hpp"
+
+static const char *TAG = "trace_replay";
+static const uint32_t write_timeout_ms = 1000;     // waiting for the DTE to write, the replay goes on afterwards
+
+namespace esp_modem {
+
+ReplayTerminal::ReplayTerminal(std::vector<uint8_t> t, bool rt): trace(std::move(t)), real_time(rt)
+{
+    ESP_MODEM_THROW_IF_FALSE(valid(), "Invalid argument: not a trace");
+}
+
+/*
+ * Set by the replay thread, so that the terminal destroyed from its read callback tells the thread to return
+ * without touching the terminal
+ */
+static thread_local bool *replay_destroyed = nullptr;
+
+ReplayTerminal::~ReplayTerminal()
+{
+    ReplayTerminal::stop();
+    for (auto t : { &thread, &retired }) {
+        if (!t->joinable()) {
+            continue;
+        }
+        if (t->get_id() == std::this_thread::get_id()) {
+            *replay_destroyed = true;   // destroyed from the read callback, the thread returns once it returns
+            t->detach();
+        } else {
+            t->join();
+        }
+    }
+}
+
+void ReplayTerminal::start()
+{
+    std::unique_lock<std::mutex> l(m);
+    if (running && !finished) {
+        return;
+    }
+    // replays from the beginning after stop() or the end of the replay
+    running = true;
+    finished = false;
+    written = 0;
+    pending.clear();
+    auto previous = std::move(thread);
+    thread = std::thread(&ReplayTerminal::replay, this, ++generation);
+    l.unlock();
+    if (previous.joinable()) {
+        if (previous.get_id() == std::this_thread::get_id()) {
+            // started again from the read callback, the thread exits once the callback returns
+            if (retired.joinable()) {
+                retired.join();
+            }
+            retired = std::move(previous);
+        } else {
+            previous.join();
+        }
+    }
+}
+
+void ReplayTerminal::stop()
+{
+    {
+        std::lock_guard<std::mutex> l(m);
+        running = false;
+    }
+    notify.notify_all();
+    // stopped from the read callback, the thread exits once the callback returns (joined by start() or the destructor)
+    if (thread.joinable() && thread.get_id() != std::this_thread::get_id()) {
+        thread.join();
+    }
+}
+
+bool ReplayTerminal::wait_for_end(uint32_t time_ms)
+{
+    std::unique_lock<std::mutex> l(m);
+    return notify.wait_for(l, std::chrono::milliseconds(time_ms), [this] { return finished; });
+}
+
+int ReplayTerminal::write(uint8_t *data, size_t len)
+{
+    {
+        std::lock_guard<std::mutex> l(m);
+        written += len;
+    }
+    notify.notify_all();
+    return len;
+}
+
+int ReplayTerminal::read(uint8_t *data, size_t len)
+{
+    std::lock_guard<std::mutex> l(m);
+    auto actual = std::min(len, pending.size());
+    std::copy(pending.begin(), pending.begin() + actual, data);
+    pending.erase(pending.begin(), pending.begin() + actual);
+    return actual;
+}
+
+void ReplayTerminal::set_read_cb(std::function<bool(uint8_t *data, size_t len)> f)
+{
+    std::lock_guard<std::mutex> l(m);
+    on_read = std::move(f);
+}
+
+void ReplayTerminal::replay(unsigned run)
+{
+    bool destroyed = false;
+    replay_destroyed = &destroyed;
+    // a replay stopped from its callback and started again right away leaves the old thread running
+    auto stopped = [this, run] { return !running || generation != run; };
+    TraceReader reader(trace.data(), trace.size());
+    trace_record record;
+    size_t expected_written = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    while (reader.next(record)) {
+        std::unique_lock<std::mutex> l(m);
+        if (real_time) {
+            auto due = start_time + std::chrono::microseconds(record.time_us);
+            notify.wait_until(l, due, stopped);
+        }
+        if (stopped()) {
+            return;
+        }
+        if (record.sent) {
+            // the following replies make sense only after the DTE has sent this
+            expected_written += record.len;
+            if (!notify.wait_for(l, std::chrono::milliseconds(write_timeout_ms),
+            [this, &stopped, expected_written] { return stopped() || written >= expected_written; })) {
+                ESP_LOGW(TAG, "The DTE hasn't sent the recorded data (%d of %d bytes), going on", static_cast<int>(written), static_cast<int>(expected_written));
+            }
+            if (stopped()) {
+                return;
+            }
+            continue;
+        }
+        pending.insert(pending.end(), record.data, record.data + record.len);
+        auto available = pending.size();
+        auto cb = on_read;
+        l.unlock();
+        if (cb) {
+            cb(nullptr, available);
+            if (destroyed) {
+                return;
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> l(m);
+        if (stopped()) {
+            return;
+        }
+        finished = true;
+    }
+    notify.notify_all();
+}
+
+} // namespace esp_modem
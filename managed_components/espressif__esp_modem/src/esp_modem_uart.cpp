@@ -67,6 +67,13 @@ public:
         on_read = std::move(f);
     }
 
+    bool set_baud_rate(int baud) override
+    {
+        // let the pending data go out at the current rate
+        uart_wait_tx_done(uart.port, pdMS_TO_TICKS(100));
+        return uart_set_baudrate(uart.port, baud) == ESP_OK;
+    }
+
 private:
     static void s_task(void *task_param)
     {
@@ -1,47 +1,126 @@
 /*
- * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <termios.h>
+#include <asm/termbits.h>       // termios2 (arbitrary baud rates), cannot be mixed with <termios.h>
 #include <sys/ioctl.h>
+#include <linux/serial.h>
 #include "esp_log.h"
 #include "cxx_include/esp_modem_dte.hpp"
 #include "esp_modem_config.h"
 #include "uart_resource.hpp"
+#include "vfs_resource/vfs_create.hpp"
 
 namespace esp_modem {
 
 constexpr const char *TAG = "uart_resource";
 
+static tcflag_t data_bits_flags(uart_word_length_t data_bits)
+{
+    switch (data_bits) {
+    case UART_DATA_5_BITS:
+        return CS5;
+    case UART_DATA_6_BITS:
+        return CS6;
+    case UART_DATA_7_BITS:
+        return CS7;
+    default:
+        return CS8;
+    }
+}
+
+static tcflag_t parity_flags(uart_parity_t parity)
+{
+    switch (parity) {
+    case UART_PARITY_EVEN:
+        return PARENB;
+    case UART_PARITY_ODD:
+        return PARENB | PARODD;
+    default:
+        return 0;
+    }
+}
+
+static void set_speed(struct termios2 &tty, int baud)
+{
+    // BOTHER takes the rate from c_ispeed/c_ospeed, so also the non-standard rates (e.g. 3000000) work
+    tty.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tty.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tty.c_ispeed = baud;
+    tty.c_ospeed = baud;
+}
+
 uart_resource::uart_resource(const esp_modem_uart_term_config *config, QueueHandle_t *event_queue, int fd): port(-1)
 {
     ESP_LOGD(TAG, "Creating uart resource" );
-    struct termios tty = {};
-    ESP_MODEM_THROW_IF_FALSE(tcgetattr(fd, &tty) == 0, "Failed to tcgetattr()");
-
-    tty.c_cflag &= ~PARENB;
-    tty.c_cflag &= ~CSTOPB;
-    tty.c_cflag &= ~CSIZE; // Clear all the size bits, then use one of the statements below
-    tty.c_cflag |= CS8; // 8 bits per byte (most common)
-    tty.c_cflag &= ~CRTSCTS; // Disable RTS/CTS hardware flow control (most common)
+    struct termios2 tty = {};
+    ESP_MODEM_THROW_IF_FALSE(ioctl(fd, TCGETS2, &tty) == 0, "Failed to get the terminal attributes");
+
+    // Zero initialized config keeps the defaults: 115200 8N1, no flow control
+    bool defaults = config->baud_rate <= 0;
+    tty.c_cflag &= ~(PARENB | PARODD | CSTOPB | CSIZE | CRTSCTS);
+    tty.c_cflag |= defaults ? CS8 : data_bits_flags(config->data_bits);
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+    if (!defaults) {
+        tty.c_cflag |= parity_flags(config->parity);
+        if (config->stop_bits == UART_STOP_BITS_1_5) {
+            ESP_LOGW(TAG, "1.5 stop bits not supported, using 2");
+        }
+        if (config->stop_bits == UART_STOP_BITS_1_5 || config->stop_bits == UART_STOP_BITS_2) {
+            tty.c_cflag |= CSTOPB;
+        }
+        if (config->flow_control == ESP_MODEM_FLOW_CONTROL_HW) {
+            tty.c_cflag |= CRTSCTS;
+        } else if (config->flow_control == ESP_MODEM_FLOW_CONTROL_SW) {
+            tty.c_iflag |= IXON | IXOFF;
+        }
+    }
     tty.c_cflag |= CREAD | CLOCAL; // Turn on READ & ignore ctrl lines (CLOCAL = 1)
     tty.c_lflag &= ~ICANON;
     tty.c_lflag &= ~ECHO; // Disable echo
     tty.c_lflag &= ~ISIG; // Disable interpretation of INTR, QUIT and SUSP
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY); // Turn off s/w flow ctrl
     tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL); // Disable any special handling of received bytes
     tty.c_oflag &= ~OPOST; // Prevent special interpretation of output bytes (e.g. newline chars)
     tty.c_oflag &= ~ONLCR; // Prevent conversion of newline to carriage return/line feed
     tty.c_cc[VTIME] = 0;
     tty.c_cc[VMIN] = 0;
-    cfsetispeed(&tty, B115200);
-    cfsetospeed(&tty, B115200);
-    cfsetspeed(&tty, B115200);
-    ioctl(fd, TCSETS, &tty);
+    set_speed(tty, defaults ? 115200 : config->baud_rate);
+    ESP_MODEM_THROW_IF_FALSE(ioctl(fd, TCSETS2, &tty) == 0, "Failed to set the terminal attributes");
 }
 
 uart_resource::~uart_resource() = default;
 
+bool uart_set_baud_rate(int fd, int baud)
+{
+    struct termios2 tty = {};
+    if (baud <= 0 || ioctl(fd, TCGETS2, &tty) != 0) {
+        return false;
+    }
+    set_speed(tty, baud);
+    // TCSETSW drains the output first, so that nothing queued is sent at the new rate
+    if (ioctl(fd, TCSETSW2, &tty) != 0) {
+        ESP_LOGE(TAG, "Failed to set baud rate %d", baud);
+        return false;
+    }
+    return true;
+}
+
+bool uart_get_counters(int fd, esp_modem_uart_counters *counters)
+{
+    struct serial_icounter_struct icount = {};
+    if (counters == nullptr || ioctl(fd, TIOCGICOUNT, &icount) != 0) {
+        return false;   // not a serial port (e.g. pty, usb-cdc)
+    }
+    counters->rx = icount.rx;
+    counters->tx = icount.tx;
+    counters->frame = icount.frame;
+    counters->parity = icount.parity;
+    counters->overrun = icount.overrun;
+    counters->buf_overrun = icount.buf_overrun;
+    counters->brk = icount.brk;
+    return true;
+}
+
 } // namespace esp_modem
@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include "cxx_include/esp_modem_urc_router.hpp"
+
+namespace esp_modem {
+
+uint16_t UrcRouter::child(uint16_t parent, char c) const
+{
+    for (auto i = trie[parent].first_child; i != none; i = trie[i].next_sibling) {
+        if (trie[i].c == c) {
+            return i;
+        }
+    }
+    return none;
+}
+
+void UrcRouter::insert(const std::string &prefix, int handler)
+{
+    uint16_t parent = 0;
+    for (auto c : prefix) {
+        auto next = child(parent, c);
+        if (next == none) {
+            next = static_cast<uint16_t>(trie.size());
+            trie.push_back(node{c, none, trie[parent].first_child, -1});
+            trie[parent].first_child = next;
+        }
+        parent = next;
+    }
+    trie[parent].handler = handler;
+}
+
+void UrcRouter::add(const std::string &prefix, handler_cb handler)
+{
+    if (prefix.empty()) {
+        return;
+    }
+    auto it = std::find_if(handlers.begin(), handlers.end(), [&prefix](const entry & e) {
+        return e.prefix == prefix;
+    });
+    if (handler) {
+        if (it != handlers.end()) {
+            it->handler = std::move(handler);
+            return;
+        }
+        handlers.push_back(entry{prefix, std::move(handler)});
+        insert(prefix, static_cast<int>(handlers.size() - 1));
+        return;
+    }
+    if (it == handlers.end()) {
+        return;
+    }
+    // removal is rare, so we just rebuild the trie with the remaining handlers
+    handlers.erase(it);
+    trie.resize(1);
+    trie[0].first_child = none;
+    for (size_t i = 0; i < handlers.size(); ++i) {
+        insert(handlers[i].prefix, static_cast<int>(i));
+    }
+}
+
+bool UrcRouter::solicited(const std::string &prefix, const char *command, size_t command_len) const
+{
+    if (command == nullptr) {
+        return false;
+    }
+    // "+CREG: " is solicited by "AT+CREG?", so compare just the name
+    auto name_len = prefix.find(':');
+    auto name_end = name_len == std::string::npos ? prefix.end() : prefix.begin() + name_len;
+    if (name_end == prefix.begin()) {
+        return false;
+    }
+    return std::search(command, command + command_len, prefix.begin(), name_end) != command + command_len;
+}
+
+bool UrcRouter::dispatch(uint8_t *line, size_t len, const char *command, size_t command_len) const
+{
+    size_t start = 0;
+    while (start < len && (line[start] == '\r' || line[start] == '\n')) {
+        start++;
+    }
+    uint16_t node = 0;
+    int found = -1;
+    for (size_t i = start; i < len; ++i) {
+        node = child(node, static_cast<char>(line[i]));
+        if (node == none) {
+            break;
+        }
+        if (trie[node].handler >= 0) {
+            found = trie[node].handler;     // keep looking for a longer prefix
+        }
+    }
+    if (found < 0 || solicited(handlers[found].prefix, command, command_len)) {
+        return false;
+    }
+    handlers[found].handler(line, len);
+    return true;
+}
+
+} // namespace esp_modem
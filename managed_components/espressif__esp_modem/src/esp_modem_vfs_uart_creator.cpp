@@ -54,3 +54,15 @@ bool vfs_create_uart(struct esp_modem_vfs_uart_creator *config, struct esp_modem
 
     return true;
 }
+
+bool vfs_uart_get_counters(const struct esp_modem_vfs_term_config *config, struct esp_modem_uart_counters *counters)
+{
+    if (config == nullptr || config->fd < 0) {
+        return false;
+    }
+#if defined(CONFIG_IDF_TARGET_LINUX)
+    return esp_modem::uart_get_counters(config->fd, counters);
+#else
+    return false;
+#endif
+}
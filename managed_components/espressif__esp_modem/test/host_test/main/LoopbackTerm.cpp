@@ -8,6 +8,21 @@
 #include <cstring>
 #include "LoopbackTerm.h"
 
+/**
+ * @brief FCS of the CMUX frame header (address, control and length)
+ */
+static uint8_t cmux_fcs(const uint8_t *frame, size_t header_len)
+{
+    uint8_t crc = 0xFF;
+    for (size_t i = 1; i < header_len; i++) {
+        crc ^= frame[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x01) ? (crc >> 1) ^ 0xe0 : crc >> 1;
+        }
+    }
+    return 0xFF - crc;
+}
+
 void LoopbackTerm::start()
 {
     status = status_t::STARTED;
@@ -18,6 +33,45 @@ void LoopbackTerm::stop()
     status = status_t::STOPPED;
 }
 
+std::string LoopbackTerm::at_response(const std::string &command)
+{
+    std::string response;
+    if (command == "+++") {
+        response = "NO CARRIER\r\n";
+    } else if (command == "ATE1\r" || command == "ATE0\r") {
+        response = "OK\r\n ";
+    } else if (command == "ATO\r") {
+        response = "ERROR\r\n";
+    } else if (command.find("ATD") != std::string::npos) {
+        response = "CONNECT\n";
+    } else if (command.find("AT+CSQ\r") != std::string::npos) {
+        response = "+CSQ: 123,456\n\r\nOK\r\n";
+    } else if (command.find("AT+CGMM\r") != std::string::npos) {
+        response = "0G Dummy Model\n\r\nOK\r\n";
+    } else if (command.find("AT+COPS?\r") != std::string::npos) {
+        response = "+COPS: 0,0,\"OperatorName\",5\n\r\nOK\r\n";
+    } else if (command.find("AT+CBC\r") != std::string::npos) {
+        response = is_bg96 ? "+CBC: 1,20,123456\r\r\n\r\nOK\r\n\n\r\n" :
+                   "+CBC: 123.456V\r\r\n\r\nOK\r\n\n\r\n";
+    } else if (command.find("AT+CPIN=1234\r") != std::string::npos) {
+        response = "OK\r\n";
+        pin_ok = true;
+    } else if (command.find("AT+CPIN?\r") != std::string::npos) {
+        response = pin_ok ? "+CPIN: READY\r\nOK\r\n" : "+CPIN: SIM PIN\r\nOK\r\n";
+    } else if (command.find("AT") != std::string::npos) {
+        if (command.length() > 4) {
+            response = command;
+            response[0] = 'O';
+            response[1] = 'K';
+            response[2] = '\r';
+            response[3] = '\n';
+        } else {
+            response = "OK\r\n";
+        }
+    }
+    return response;
+}
+
 int LoopbackTerm::write(uint8_t *data, size_t len)
 {
     if (inject_by) {    // injection test: ignore what we write, but respond with injected data
@@ -27,42 +81,7 @@ int LoopbackTerm::write(uint8_t *data, size_t len)
         return len;
     }
     if (len > 2 && (data[len - 1] == '\r' || data[len - 1] == '+') ) { // Simple AT responder
-        std::string command((char *)data, len);
-        std::string response;
-        if (command == "+++") {
-            response = "NO CARRIER\r\n";
-        } else if (command == "ATE1\r" || command == "ATE0\r") {
-            response = "OK\r\n ";
-        } else if (command == "ATO\r") {
-            response = "ERROR\r\n";
-        } else if (command.find("ATD") != std::string::npos) {
-            response = "CONNECT\n";
-        } else if (command.find("AT+CSQ\r") != std::string::npos) {
-            response = "+CSQ: 123,456\n\r\nOK\r\n";
-        } else if (command.find("AT+CGMM\r") != std::string::npos) {
-            response = "0G Dummy Model\n\r\nOK\r\n";
-        } else if (command.find("AT+COPS?\r") != std::string::npos) {
-            response = "+COPS: 0,0,\"OperatorName\",5\n\r\nOK\r\n";
-        } else if (command.find("AT+CBC\r") != std::string::npos) {
-            response = is_bg96 ? "+CBC: 1,20,123456\r\r\n\r\nOK\r\n\n\r\n" :
-                       "+CBC: 123.456V\r\r\n\r\nOK\r\n\n\r\n";
-        } else if (command.find("AT+CPIN=1234\r") != std::string::npos) {
-            response = "OK\r\n";
-            pin_ok = true;
-        } else if (command.find("AT+CPIN?\r") != std::string::npos) {
-            response = pin_ok ? "+CPIN: READY\r\nOK\r\n" : "+CPIN: SIM PIN\r\nOK\r\n";
-        } else if (command.find("AT") != std::string::npos) {
-            if (command.length() > 4) {
-                response = command;
-                response[0] = 'O';
-                response[1] = 'K';
-                response[2] = '\r';
-                response[3] = '\n';
-            } else {
-                response = "OK\r\n";
-            }
-
-        }
+        std::string response = at_response(std::string((char *)data, len));
         if (!response.empty()) {
             data_len = response.length();
             loopback_data.resize(data_len);
@@ -73,15 +92,47 @@ int LoopbackTerm::write(uint8_t *data, size_t len)
         }
     }
     if (len > 2 && data[0] == 0xf9) { // Simple CMUX responder
-        // turn the request into a reply -> implements CMUX loopback
-        // Note: This simple CMUX responder only updates CMUX headers and replaces payload.
-        // It means that all responses (that we test) must be shorter or equal to the requests
-        // For example ATD (dial command): sizeof("ATD*99#") >= sizeof("CONNECT");
-        if (data[2] == 0x3f || data[2] == 0x53) {  // SABM command
-            data[2] = 0x73;
-        } else if (data[2] == 0xef) { // Generic request
-            data[2] = 0xff;         // generic reply
+        // turn the requests into replies -> implements CMUX loopback
+        // Note: Frames are written whole (possibly several of them back to back), AT commands
+        // in their payloads get answered by the AT responder, other payloads are looped back
+        std::vector<uint8_t> reply;
+        size_t pos = 0;
+        while (pos + 6 <= len && data[pos] == 0xf9) {
+            uint8_t *frame = data + pos;
+            size_t header_len = (frame[3] & 1) ? 4 : 5;
+            size_t payload_len = (frame[3] >> 1) + (header_len == 5 ? frame[4] << 7 : 0);
+            if (pos + header_len + payload_len + 2 > len) {
+                break;
+            }
+            std::string payload((char *)frame + header_len, payload_len);
+            std::string response;
+            if (payload_len > 2 && (payload.back() == '\r' || payload.back() == '+')) {
+                response = at_response(payload);
+            }
+            if (response.empty()) {
+                response = payload;
+            }
+            uint8_t header[5] = { 0xf9, frame[1], frame[2], 0, 0 };
+            if (header[2] == 0x3f || header[2] == 0x53) {  // SABM command
+                header[2] = 0x73;
+            } else if (header[2] == 0xef) { // Generic request
+                header[2] = 0xff;         // generic reply
+            }
+            header_len = response.size() < 128 ? 4 : 5;
+            header[3] = (response.size() & 0x7f) << 1 | (header_len == 4 ? 1 : 0);
+            header[4] = response.size() >> 7;
+            reply.insert(reply.end(), header, header + header_len);
+            reply.insert(reply.end(), response.begin(), response.end());
+            reply.push_back(cmux_fcs(header, header_len));
+            reply.push_back(0xf9);
+            pos += header_len + payload_len + 2;
         }
+        loopback_data.resize(data_len + reply.size());
+        memcpy(&loopback_data[data_len], reply.data(), reply.size());
+        data_len += reply.size();
+        signal.clear(1);
+        auto ret = std::async(on_read, nullptr, data_len);
+        return len;
     }
     loopback_data.resize(data_len + len);
     memcpy(&loopback_data[data_len], data, len);
@@ -120,6 +171,8 @@ LoopbackTerm::LoopbackTerm(): loopback_data(), data_len(0), pin_ok(false), is_bg
 
 int LoopbackTerm::inject(uint8_t *data, size_t len, size_t injected_by, size_t delay_before, size_t delay_after)
 {
+    // the DTE might be still reading the previously injected data
+    Scoped<Lock> lock(on_read_guard);
     if (data == nullptr) {
         inject_by = 0;
         return 0;
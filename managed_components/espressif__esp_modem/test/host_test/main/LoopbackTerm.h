@@ -39,6 +39,7 @@ private:
         STOPPED
     };
     void batch_read();
+    std::string at_response(const std::string &command);
     std::function<bool(uint8_t *data, size_t len)> user_on_read;
     status_t status;
     SignalGroup signal;
@@ -6,9 +6,26 @@
 #define CATCH_CONFIG_MAIN // This tells the catch header to generate a main
 #include <memory>
 #include <future>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#include <unistd.h>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_session.hpp>
 #include "cxx_include/esp_modem_api.hpp"
+#include "cxx_include/esp_modem_cmux.hpp"
+#include "cxx_include/esp_modem_netif.hpp"
+#include "cxx_include/esp_modem_pool.hpp"
+#include "cxx_include/esp_modem_trace.hpp"
+#include "cxx17_include/esp_modem_command_table.hpp"
+#include "cxx17_include/esp_modem_phrase_matcher.hpp"
+#include "esp_modem_config.h"
+#include "vfs_resource/vfs_create.hpp"
 #include "LoopbackTerm.h"
 #include <iostream>
 
@@ -235,7 +252,7 @@ TEST_CASE("Test CMUX protocol by injecting payloads", "[esp_modem]")
     CHECK(dce->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
     const auto test_command = "Test\n";
     // 1 byte payload size
-    uint8_t test_payload[] = {0xf9, 0x09, 0xff, 0x0b, 0x54, 0x65, 0x73, 0x74, 0x0a, 0xbb, 0xf9 };
+    uint8_t test_payload[] = {0xf9, 0x09, 0xff, 0x0b, 0x54, 0x65, 0x73, 0x74, 0x0a, 0x29, 0xf9 };
     loopback->inject(&test_payload[0], sizeof(test_payload), 1);
     auto ret = dce->command(test_command, [&](uint8_t *data, size_t len) {
         std::string response((char *) data, len);
@@ -249,7 +266,7 @@ TEST_CASE("Test CMUX protocol by injecting payloads", "[esp_modem]")
     long_payload[5]   = 0x7e;   // payload to validate
     long_payload[449] = 0x7e;
     long_payload[450] = '\n';
-    long_payload[451] = 0x53;   // footer
+    long_payload[451] = 0xc6;   // footer (FCS over both length bytes)
     long_payload[452] = 0xf9;
     for (int i = 0; i < 5; ++i) {
         // inject the whole payload (i=0) and then per 1,2,3,4 bytes (i)
@@ -262,6 +279,8 @@ TEST_CASE("Test CMUX protocol by injecting payloads", "[esp_modem]")
         }, 1000);
         CHECK(ret == command_result::OK);
     }
+    // the footer might be still processed by the injecting thread
+    loopback->inject(nullptr, 0, 0);
 }
 
 TEST_CASE("Command and Data mode transitions", "[esp_modem][transitions]")
@@ -349,6 +368,1713 @@ TEST_CASE("CMUX manual mode transitions", "[esp_modem][transitions]")
 
 }
 
+TEST_CASE("DTE passes reply lines incrementally", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>(true);
+    auto loopback = term.get();
+    auto dte = std::make_shared<DTE>(std::move(term));
+
+    std::string reply;
+    for (int i = 0; i < 40; ++i) {
+        reply += "+CMGL: " + std::to_string(i) + ",\"REC READ\"\r\n";
+    }
+    reply += "OK\r\n";
+    // inject the reply in small fragments, every byte has to be processed only once
+    loopback->inject((uint8_t *)reply.data(), reply.size(), 5, 0, 0);
+    size_t processed = 0;
+    int lines = 0;
+    auto ret = dte->command_lines("AT+CMGL\r", [&](uint8_t *data, size_t len) {
+        std::string_view line((char *)data, len);
+        CHECK(line.back() == '\n');
+        processed += len;
+        lines++;
+        return line.find("OK") != std::string::npos ? command_result::OK : command_result::TIMEOUT;
+    }, 1000, '\n');
+    CHECK(ret == command_result::OK);
+    CHECK(lines == 41);
+    CHECK(processed == reply.size());
+    loopback->inject(nullptr, 0, 0);
+}
+
+TEST_CASE("Batched AT commands", "[esp_modem]")
+{
+    // Replies to the command lines in order, records the sent lines
+    class ScriptedCommandable : public CommandableIf {
+    public:
+        std::vector<std::string> replies;
+        std::vector<std::string> lines;
+        std::vector<uint32_t> timeouts;
+        command_result command(const std::string &cmd, got_line_cb got_line, uint32_t time_ms, const char separator) override
+        {
+            lines.push_back(cmd);
+            timeouts.push_back(time_ms);
+            std::string reply = replies.at(lines.size() - 1);
+            return got_line((uint8_t *)reply.data(), reply.size());
+        }
+        command_result command(const std::string &cmd, got_line_cb got_line, uint32_t time_ms) override
+        {
+            return command(cmd, got_line, time_ms, '\n');
+        }
+        int write(uint8_t *data, size_t len) override
+        {
+            return len;
+        }
+        void on_read(got_line_cb on_data) override {}
+    };
+
+    std::vector<command_reply> replies;
+    ScriptedCommandable ok;
+    ok.replies = { "\r\n+CPMS: 0,30,0,30,0,30\r\n\r\n+CSQ: 20,99\r\n\r\nOK\r\n" };
+    CHECK(dce_commands::at_batch(&ok, {"ATE0", "AT+CMGF=1", "AT+CPMS=\"SM\",\"SM\",\"SM\"", "AT+CSQ", "AT+CNMI=2,1"}, replies, 1000) == command_result::OK);
+    CHECK(ok.lines.size() == 1);
+    CHECK(ok.lines[0] == "ATE0+CMGF=1;+CPMS=\"SM\",\"SM\",\"SM\";+CSQ;+CNMI=2,1\r");
+    CHECK(ok.timeouts[0] == 5 * 1000);     // the timeout applies to each command of the line
+    REQUIRE(replies.size() == 5);
+    for (auto &it : replies) {
+        CHECK(it.result == command_result::OK);
+    }
+    CHECK(replies[2].out == "+CPMS: 0,30,0,30,0,30");
+    CHECK(replies[3].out == "+CSQ: 20,99");
+    CHECK(replies[4].out.empty());
+
+    // the line fails -> commands are repeated one by one to find the failing one
+    ScriptedCommandable fail;
+    fail.replies = { "ERROR\r\n", "OK\r\n", "+CME ERROR: 10\r\n" };
+    CHECK(dce_commands::at_batch(&fail, {"AT+CMGF=1", "AT+CPMS=\"SM\"", "AT+CNMI=2,1"}, replies, 1000) == command_result::FAIL);
+    CHECK(fail.lines.size() == 3);
+    CHECK(fail.lines[1] == "AT+CMGF=1\r");
+    CHECK(fail.lines[2] == "AT+CPMS=\"SM\"\r");
+    CHECK(fail.timeouts[1] == 1000);
+    CHECK(replies[0].result == command_result::OK);
+    CHECK(replies[1].result == command_result::FAIL);
+    CHECK(replies[1].out == "+CME ERROR: 10");
+    CHECK(replies[2].result == command_result::TIMEOUT);
+
+    // long batches are split to more lines
+    ScriptedCommandable split;
+    split.replies = { "OK\r\n", "OK\r\n" };
+    std::vector<std::string> many(20, "AT+CGDCONT=1,\"IP\",\"apn\"");
+    CHECK(dce_commands::at_batch(&split, many, replies, 1000) == command_result::OK);
+    CHECK(split.lines.size() == 2);
+    CHECK(split.lines[0].size() <= 256);
+}
+
+TEST_CASE("AT command table", "[esp_modem]")
+{
+    static_assert(dce_commands::table::reset.timeout_ms == 60000);
+
+    // Replies the same line (OK by default) to all commands, records the sent ones
+    class RecordingCommandable : public CommandableIf {
+    public:
+        std::vector<std::string> lines;
+        std::string reply = "OK\r\n";
+        command_result command(const std::string &cmd, got_line_cb got_line, uint32_t time_ms, const char separator) override
+        {
+            lines.push_back(cmd);
+            return got_line((uint8_t *)reply.data(), reply.size());
+        }
+        command_result command(const std::string &cmd, got_line_cb got_line, uint32_t time_ms) override
+        {
+            return command(cmd, got_line, time_ms, '\n');
+        }
+        int write(uint8_t *data, size_t len) override
+        {
+            return len;
+        }
+        void on_read(got_line_cb on_data) override {}
+    };
+
+    RecordingCommandable dce;
+    CHECK(dce_commands::sync(&dce) == command_result::OK);
+    CHECK(dce_commands::set_echo(&dce, false) == command_result::OK);
+    CHECK(dce_commands::set_flow_control(&dce, 2, 2) == command_result::OK);
+    CHECK(dce_commands::set_pin(&dce, "1234") == command_result::OK);
+    CHECK(dce_commands::set_command_mode(&dce) == command_result::OK);
+    CHECK(dce.lines == std::vector<std::string>({"AT\r", "ATE0\r", "AT+IFC=2,2\r", "AT+CPIN=1234\r", "+++"}));
+    // parameters which don't fit the command buffer are not sent
+    CHECK(dce_commands::set_pin(&dce, std::string(100, '1')) == command_result::FAIL);
+    CHECK(dce.lines.size() == 5);
+
+    // replies are classified by the alternative pass and fail phrases of the descriptors
+    dce.reply = "NO CARRIER\r\n";
+    CHECK(dce_commands::set_command_mode(&dce) == command_result::OK);
+    dce.reply = "ERROR\r\n";
+    CHECK(dce_commands::sync(&dce) == command_result::FAIL);
+    dce.reply = "+CSQ: 20,99\r\n";
+    CHECK(dce_commands::sync(&dce) == command_result::TIMEOUT);
+    dce.reply = "OK\r\n";
+
+    // matchers are kept per phrase set, the sets beyond the cache capacity are searched one by one
+    for (int i = 0; i < 40; ++i) {
+        auto tail = std::to_string(i % 20);
+        CHECK(dce_commands::generic_command(&dce, "AT\r", "OK", "ERROR" + tail, 500) == command_result::OK);
+        CHECK(dce_commands::generic_command(&dce, "AT\r", "PASS" + tail, "O", 500) == command_result::FAIL);
+        CHECK(dce_commands::generic_command(&dce, "AT\r", "PASS" + tail, "FAIL" + tail, 500) == command_result::TIMEOUT);
+    }
+    // descriptors not cached get a matcher of their own
+    dce.reply = "POWERED DOWN\r\n";
+    CHECK(dce_commands::power_down(&dce) == command_result::OK);
+    dce.reply = "ERROR\r\n";
+    CHECK(dce_commands::power_down(&dce) == command_result::FAIL);
+}
+
+TEST_CASE("Multi-pattern phrase matcher", "[esp_modem]")
+{
+    phrase_matcher<> matcher;
+    CHECK(matcher.add_any("NO CARRIER|OK", 0));
+    CHECK(matcher.add("ERROR", 1));
+    CHECK(matcher.add("+CME ERROR", 1));
+    CHECK(matcher.add("CARRIER", 2));
+    CHECK_FALSE(matcher.add("", 3));
+    matcher.build();
+
+    CHECK(matcher.find("\r\nOK\r\n") == 0);
+    CHECK(matcher.find("\r\n+CME ERROR: 10\r\n") == 1);
+    CHECK(matcher.find("CARRIER LOST") == 2);
+    CHECK(matcher.find("+CSQ: 21,99\r\n") == phrase_matcher<>::no_match);
+    // lowest tag wins regardless of the position (also phrases being suffixes of others)
+    CHECK(matcher.find("ERROR then NO CARRIER") == 0);
+    CHECK(matcher.find("NO CARRIE") == phrase_matcher<>::no_match);
+    // longer texts skipped a word at a time, also with phrases at the end
+    CHECK(matcher.find(std::string(100, 'x') + "OK") == 0);
+    CHECK(matcher.find(std::string(101, 'x') + "ERRO") == phrase_matcher<>::no_match);
+
+    // the scan resumes with the next fragment, at any split position
+    const std::string reply = "+COPS: 0,0,\"Some operator\",7\r\n\r\nNO CARRIER\r\n";
+    for (size_t split = 0; split <= reply.size(); ++split) {
+        phrase_matcher<>::state s;
+        matcher.scan(s, (const uint8_t *)reply.data(), split);
+        CHECK(matcher.scan(s, (const uint8_t *)reply.data() + split, reply.size() - split) == 0);
+    }
+
+    // many phrases are still classified in one pass
+    phrase_matcher<255> many;
+    for (int i = 0; i < 40; ++i) {
+        CHECK(many.add("+U" + std::to_string(i) + ":", i));
+    }
+    many.build();
+    CHECK(many.find("\r\n+U37: 1\r\n+U12: 0\r\n") == 12);
+    CHECK(many.find("+U4") == phrase_matcher<>::no_match);
+
+    // classifies replies by the phrases of the command descriptors
+    const auto &cmd = dce_commands::table::set_command_mode;
+    phrase_matcher<> command_matcher;
+    CHECK(command_matcher.add_any(cmd.pass_phrase, 0));
+    CHECK(command_matcher.add_any(cmd.fail_phrase, 1));
+    command_matcher.build();
+    CHECK(command_matcher.find("OK\r\n") == 0);
+    CHECK(command_matcher.find("NO CARRIER\r\n") == 0);
+    CHECK(command_matcher.find("ERROR\r\n") == 1);
+    CHECK(command_matcher.find("ERROR OK\r\n") == 0);
+    CHECK(command_matcher.find("CONNECT\r\n") == phrase_matcher<>::no_match);
+    CHECK(command_matcher.find("") == phrase_matcher<>::no_match);
+}
+
+#ifdef CONFIG_ESP_MODEM_URC_HANDLER
+TEST_CASE("URC router", "[esp_modem]")
+{
+    // Delivers data in small fragments to be read by the DTE, replies to commands synchronously (from write())
+    class FragmentTerm : public Terminal {
+    public:
+        std::map<std::string, std::string> replies;
+        void start() override {}
+        void stop() override {}
+        void push(const std::string &data, size_t fragment)
+        {
+            for (size_t pos = 0; pos < data.size(); pos += fragment) {
+                pending = data.substr(pos, fragment);
+                on_read(nullptr, pending.size());
+            }
+        }
+        size_t fragment{3};
+        int write(uint8_t *data, size_t len) override
+        {
+            push(replies[std::string((char *)data, len)], fragment);
+            return len;
+        }
+        int read(uint8_t *data, size_t len) override
+        {
+            len = std::min(len, pending.size());
+            memcpy(data, pending.data(), len);
+            pending.erase(0, len);
+            return len;
+        }
+    private:
+        std::string pending;
+    };
+
+    auto term = std::make_unique<FragmentTerm>();
+    auto fragments = term.get();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    std::map<std::string, std::vector<std::string>> urcs;
+    for (auto prefix : {"+CMTI", "+CREG", "RING", "+CGEV", "NO CARRIER"}) {
+        dte->add_urc_handler(prefix, [&urcs, prefix](uint8_t *line, size_t len) {
+            urcs[prefix].emplace_back((char *)line, len);
+        });
+    }
+
+    // idle URCs are dispatched once, also when split between fragments
+    fragments->push("\r\nRING\r\n\r\n+CGEV: ME PDN DEACT 1\r\n", 4);
+    fragments->push("\r\n+CRE", 5);
+    fragments->push("G: 0,5\r\n", 5);
+    CHECK(urcs["RING"] == std::vector<std::string>({"RING\r\n"}));
+    CHECK(urcs["+CGEV"] == std::vector<std::string>({"+CGEV: ME PDN DEACT 1\r\n"}));
+    CHECK(urcs["+CREG"] == std::vector<std::string>({"+CREG: 0,5\r\n"}));
+
+    // URCs interleaved with replies are not passed to the command, unless the command solicited them
+    fragments->replies["AT+CREG?\r"] = "\r\n+CMTI: \"SM\",3\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n";
+    fragments->replies["AT+CSQ\r"] = "\r\n+CSQ: 21,99\r\n\r\nNO CARRIER\r\n\r\nOK\r\n";
+    std::string reply;
+    auto collect = [&reply](uint8_t *data, size_t len) {
+        reply.append((char *)data, len);
+        return reply.find("OK\r\n") != std::string::npos ? command_result::OK : command_result::TIMEOUT;
+    };
+    CHECK(dte->command_lines("AT+CREG?\r", collect, 500, '\n') == command_result::OK);
+    CHECK(reply == "\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+    CHECK(urcs["+CMTI"] == std::vector<std::string>({"+CMTI: \"SM\",3\r\n"}));
+    CHECK(urcs["+CREG"].size() == 1);
+    reply.clear();
+    CHECK(dte->command_lines("AT+CSQ\r", collect, 500, '\n') == command_result::OK);
+    CHECK(reply == "\r\n+CSQ: 21,99\r\n\r\n\r\nOK\r\n");
+    CHECK(urcs["NO CARRIER"].size() == 1);
+
+    // URCs read together with the final reply are routed, too
+    fragments->fragment = 64;
+    fragments->replies["AT+CMGF=1\r"] = "\r\nOK\r\n\r\n+CMTI: \"SM\",5\r\n\r\nRING\r\n";
+    reply.clear();
+    CHECK(dte->command_lines("AT+CMGF=1\r", collect, 500, '\n') == command_result::OK);
+    CHECK(reply == "\r\nOK\r\n");
+    REQUIRE(urcs["+CMTI"].size() == 2);
+    CHECK(urcs["+CMTI"][1] == "+CMTI: \"SM\",5\r\n");
+    CHECK(urcs["RING"].size() == 2);
+    fragments->fragment = 3;
+
+    // removed handlers are no longer called
+    dte->remove_urc_handler("RING");
+    fragments->push("\r\nRING\r\n\r\nRING\r\n", 6);
+    CHECK(urcs["RING"].size() == 2);
+    fragments->push("\r\n+CMTI: \"SM\",4\r\n", 7);
+    CHECK(urcs["+CMTI"].size() == 3);
+}
+#endif
+
+TEST_CASE("DTE asynchronous command queue", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    CHECK(dte->set_mode(esp_modem::modem_mode::COMMAND_MODE) == true);
+
+    Lock order_lock;
+    std::string order;
+    std::promise<void> all_done;
+    // Replies of the loopback terminal contain the command tail ("AT+XXn" -> "OK\r\nXn"), so we can check
+    // that each command gets its own reply
+    auto submit = [&](char id, int priority, bool last) {
+        return dte->command_async(std::string("AT+XX") + id + "\r", [id](uint8_t *data, size_t len) {
+            std::string response((char *)data, len);
+            return response.find(std::string("X") + id) != std::string::npos ? command_result::OK : command_result::FAIL;
+        }, 1000, [&, id, last](command_result result) {
+            CHECK(result == command_result::OK);
+            Scoped<Lock> l(order_lock);
+            order += id;
+            if (last) {
+                all_done.set_value();
+            }
+        }, priority);
+    };
+    {
+        // keep the DTE busy, so the commands below get queued behind the first one
+        Scoped<DTE> busy(*dte);
+        CHECK(submit('1', 0, false));
+        Task::Delay(50);
+        CHECK(submit('2', 0, false));
+        CHECK(submit('3', 5, false));
+        CHECK(submit('4', 0, true));
+        CHECK(submit('5', 5, false));
+    }
+    // synchronous commands still work in between
+    CHECK(dte->command("AT+XXS\r", [](uint8_t *data, size_t len) {
+        return command_result::OK;
+    }, 1000) == command_result::OK);
+    CHECK(all_done.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    Scoped<Lock> l(order_lock);
+    CHECK(order == "13524");
+}
+
+TEST_CASE("DTE destruction fails the queued commands at once", "[esp_modem]")
+{
+    // counts the commands which reach the terminal
+    class CountingTerm : public LoopbackTerm {
+    public:
+        explicit CountingTerm(std::atomic<int> &count): count(count) {}
+        int write(uint8_t *data, size_t len) override
+        {
+            count += std::string((char *)data, len) == "AT+YY\r";
+            return LoopbackTerm::write(data, len);
+        }
+    private:
+        std::atomic<int> &count;
+    };
+    std::atomic<int> written{0};
+    auto dte = std::make_unique<DTE>(std::make_unique<CountingTerm>(written));
+    CHECK(dte->set_mode(esp_modem::modem_mode::COMMAND_MODE) == true);
+    DTE *raw = dte.get();
+    std::atomic<int> failed{0};
+    std::atomic<int> requeued{0};
+    std::atomic<int> late_failed{0};
+    for (int i = 0; i < 3; ++i) {
+        // the replies never satisfy these commands, so each would wait for its timeout
+        CHECK(dte->command_async("AT+XX\r", [](uint8_t *data, size_t len) {
+            return command_result::TIMEOUT;
+        }, 5000, [&](command_result result) {
+            failed += result == command_result::FAIL;
+            // no new commands are accepted (and the queue isn't locked while reporting)
+            requeued += raw->command_async("AT\r", nullptr, 1000, nullptr);
+            // nor sent synchronously
+            late_failed += raw->command("AT+YY\r", [](uint8_t *data, size_t len) {
+                return command_result::OK;
+            }, 1000) == command_result::FAIL;
+        }));
+    }
+    Task::Delay(100);
+    const uint32_t start = Task::Now();
+    dte.reset();
+    CHECK(Task::Now() - start < 1000);
+    CHECK(failed == 3);
+    CHECK(requeued == 0);
+    CHECK(late_failed == 3);
+    CHECK(written == 0);
+}
+
+TEST_CASE("Ring buffer accumulation", "[esp_modem]")
+{
+    ring_buffer ring(8);
+    CHECK(ring.empty());
+    CHECK(ring.readable().first.len == 0);
+
+    // fill and consume, so that the next writes wrap around the end
+    const uint8_t abcdef[] = {'a', 'b', 'c', 'd', 'e', 'f'};
+    ring.append(abcdef, sizeof(abcdef));
+    ring.consume(4);
+    const uint8_t ghij[] = {'g', 'h', 'i', 'j'};
+    uint8_t *space = ring.prepare(2);
+    CHECK(space != nullptr);
+    memcpy(space, ghij, 2);
+    ring.commit(2);
+    ring.append(ghij + 2, 2);
+    CHECK(ring.size() == 6);
+    CHECK(ring.capacity() == 8);
+    auto views = ring.readable();
+    CHECK(std::string((char *)views.first.data, views.first.len) + std::string((char *)views.second.data, views.second.len) == "efghij");
+
+    // linearize in place
+    uint8_t *data = ring.linearize();
+    CHECK(std::string((char *)data, ring.size()) == "efghij");
+    CHECK(ring.readable().second.len == 0);
+    CHECK(ring.capacity() == 8);
+
+    // grows only when needed and keeps the storage after clear()
+    std::string long_reply(100, 'x');
+    ring.append((uint8_t *)long_reply.data(), long_reply.size());
+    CHECK(ring.size() == 106);
+    CHECK(std::string((char *)ring.linearize(), ring.size()) == "efghij" + long_reply);
+    auto capacity = ring.capacity();
+    ring.clear();
+    CHECK(ring.empty());
+    ring.append((uint8_t *)long_reply.data(), long_reply.size());
+    CHECK(ring.capacity() == capacity);
+}
+
+/*
+ * Counts heap allocations of the whole test binary, to check that frequently issued commands don't allocate
+ */
+static std::atomic<size_t> heap_allocations{0};
+
+void *operator new(size_t size)
+{
+    heap_allocations++;
+    if (void *p = std::malloc(size != 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    heap_allocations++;
+    return std::malloc(size != 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+TEST_CASE("Polled commands don't allocate", "[esp_modem]")
+{
+    // Replies synchronously (from write()) with a static response, so the terminal itself doesn't allocate
+    class ReplyTerm : public Terminal {
+    public:
+        void start() override {}
+        void stop() override {}
+        int write(uint8_t *data, size_t len) override
+        {
+            std::string_view cmd((char *)data, len);
+            const char *reply = cmd == "AT+CSQ\r" ? "\r\n+CSQ: 21,99\r\n\r\nOK\r\n" :
+                                cmd == "AT+CBC\r" ? "\r\n+CBC: 3.950V\r\n\r\nOK\r\n" : "\r\nOK\r\n";
+            size_t reply_len = strlen(reply);
+            memcpy(buffer, reply, reply_len);
+            on_read(buffer, reply_len);
+            return len;
+        }
+        int read(uint8_t *data, size_t len) override
+        {
+            return 0;
+        }
+    private:
+        uint8_t buffer[64] {};
+    };
+
+    auto dte = std::make_shared<DTE>(std::make_unique<ReplyTerm>());
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+    int rssi = 0, ber = 0, voltage = 0, bcs = 0, bcl = 0;
+    std::string out;
+    // first round of commands is not counted (lazy initialization of logging, etc.)
+    CHECK(dce->get_signal_quality(rssi, ber) == command_result::OK);
+
+    const size_t before = heap_allocations;
+    for (int i = 0; i < 10; ++i) {
+        dce->get_signal_quality(rssi, ber);
+        dce->sync();
+        dce->set_baud(115200);
+        dce->at("AT+CREG?", out, 500);
+        dce->get_battery_status(voltage, bcs, bcl);
+    }
+    const size_t allocations = heap_allocations - before;
+    CHECK(allocations == 0);
+    CHECK(rssi == 21);
+    CHECK(ber == 99);
+    CHECK(voltage == 3950);
+
+    // the callbacks are referred to without copying, so temporaries (which would dangle) are refused
+    auto on_line = [](uint8_t *data, size_t len) {
+        return command_result::OK;
+    };
+    static_assert(std::is_constructible<got_line_ref, decltype(on_line) &>::value, "named callbacks are referred to");
+    static_assert(!std::is_constructible<got_line_ref, decltype(on_line)>::value, "temporaries are refused");
+}
+
+TEST_CASE("Baud rate negotiation", "[esp_modem]")
+{
+    // Simulates the modem UART: replies only if both sides run at the same rate
+    class BaudTerm : public Terminal {
+    public:
+        std::set<int> term_rates{115200, 460800, 921600};
+        std::set<int> modem_rates{115200, 460800, 921600, 3000000};
+        int term_rate{115200};
+        int modem_rate{115200};
+        int stored_rate{0};
+        int noisy_rate{0};      // corrupts longer replies at this rate
+        void start() override {}
+        void stop() override {}
+        bool set_baud_rate(int baud) override
+        {
+            if (term_rates.count(baud) == 0) {
+                return false;
+            }
+            term_rate = baud;
+            return true;
+        }
+        int write(uint8_t *data, size_t len) override
+        {
+            if (term_rate != modem_rate) {
+                return len;     // garbage on the modem side, no reply
+            }
+            std::string cmd((char *)data, len);
+            int switch_to = 0;
+            if (cmd == "ATI\r") {
+                reply = "\r\nManufacturer: SIMCOM INCORPORATED\r\nModel: A7670E\r\n\r\nOK\r\n";
+                if (modem_rate == noisy_rate) {
+                    reply[10] ^= 0x20;
+                }
+            } else if (cmd.rfind("AT+IPR=", 0) == 0) {
+                switch_to = std::stoi(cmd.substr(7));
+                reply = modem_rates.count(switch_to) ? "\r\nOK\r\n" : "\r\nERROR\r\n";
+            } else if (cmd == "AT&W\r") {
+                stored_rate = modem_rate;
+                reply = "\r\nOK\r\n";
+            } else {
+                reply = "\r\nOK\r\n";
+            }
+            on_read(nullptr, reply.size());
+            if (switch_to && modem_rates.count(switch_to)) {
+                modem_rate = switch_to;     // after replying at the old rate
+            }
+            return len;
+        }
+        int read(uint8_t *data, size_t len) override
+        {
+            len = std::min(len, reply.size());
+            memcpy(data, reply.data(), len);
+            reply.erase(0, len);
+            return len;
+        }
+    private:
+        std::string reply;
+    };
+
+    auto term = std::make_unique<BaudTerm>();
+    auto uart = term.get();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    const std::vector<int> rates{460800, 3000000, 921600};
+
+    // the highest rate supported by both sides (3M is not supported by the terminal)
+    int baud = 115200;
+    CHECK(dce_commands::negotiate_baud(dte.get(), rates, baud, true) == command_result::OK);
+    CHECK(baud == 921600);
+    CHECK(uart->term_rate == 921600);
+    CHECK(uart->modem_rate == 921600);
+    CHECK(uart->stored_rate == 921600);
+
+    // the modem kept the negotiated rate, but we restarted at the default one
+    uart->term_rate = baud = 115200;
+    uart->stored_rate = 0;
+    CHECK(dce_commands::negotiate_baud(dte.get(), rates, baud, true) == command_result::OK);
+    CHECK(baud == 921600);
+    CHECK(uart->term_rate == 921600);
+
+    // a rate which doesn't pass the verification falls back to the next lower one
+    uart->term_rate = uart->modem_rate = baud = 115200;
+    uart->stored_rate = 0;
+    uart->noisy_rate = 921600;
+    CHECK(dce_commands::negotiate_baud(dte.get(), rates, baud, false) == command_result::OK);
+    CHECK(baud == 460800);
+    CHECK(uart->term_rate == 460800);
+    CHECK(uart->modem_rate == 460800);
+    CHECK(uart->stored_rate == 0);
+}
+
+TEST_CASE("Linux UART line settings", "[esp_modem]")
+{
+    // pseudo terminal stands for the serial port, it keeps the rate, stop bits and flow control
+    // (but forces 8N1 and has no error counters)
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    REQUIRE(master >= 0);
+    REQUIRE(grantpt(master) == 0);
+    REQUIRE(unlockpt(master) == 0);
+
+    struct esp_modem_vfs_uart_creator uart_config = ESP_MODEM_VFS_DEFAULT_UART_CONFIG(ptsname(master));
+    uart_config.uart.baud_rate = 3000000;
+    uart_config.uart.stop_bits = UART_STOP_BITS_2;
+    uart_config.uart.flow_control = ESP_MODEM_FLOW_CONTROL_HW;
+    esp_modem_dte_config_t dte_config = ESP_MODEM_DTE_DEFAULT_CONFIG();
+    REQUIRE(vfs_create_uart(&uart_config, &dte_config.vfs_config));
+
+    // non-standard rates are set directly (BOTHER)
+    struct termios2 tty = {};
+    REQUIRE(ioctl(dte_config.vfs_config.fd, TCGETS2, &tty) == 0);
+    CHECK((tty.c_cflag & CBAUD) == BOTHER);
+    CHECK(tty.c_ospeed == 3000000);
+    CHECK((tty.c_cflag & CSTOPB) == CSTOPB);
+    CHECK((tty.c_cflag & CRTSCTS) == CRTSCTS);
+    CHECK((tty.c_lflag & ICANON) == 0);
+
+    // the terminal switches the rate for negotiate_baud()
+    auto dte = create_vfs_dte(&dte_config);
+    REQUIRE(dte != nullptr);
+    CHECK(dte->set_baud_rate(460800));
+    REQUIRE(ioctl(dte_config.vfs_config.fd, TCGETS2, &tty) == 0);
+    CHECK(tty.c_ospeed == 460800);
+    CHECK((tty.c_cflag & CRTSCTS) == CRTSCTS);
+
+    struct esp_modem_uart_counters counters = {};
+    CHECK(vfs_uart_get_counters(&dte_config.vfs_config, &counters) == false);
+    dte.reset();
+    close(master);
+
+    // zero initialized config keeps the default 115200 8N1 without flow control
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    REQUIRE(master >= 0);
+    REQUIRE(grantpt(master) == 0);
+    REQUIRE(unlockpt(master) == 0);
+    struct esp_modem_vfs_uart_creator zero_config = {};
+    zero_config.dev_name = ptsname(master);
+    REQUIRE(vfs_create_uart(&zero_config, &dte_config.vfs_config));
+    REQUIRE(ioctl(dte_config.vfs_config.fd, TCGETS2, &tty) == 0);
+    CHECK(tty.c_ospeed == 115200);
+    CHECK((tty.c_cflag & (CSTOPB | CRTSCTS)) == 0);
+    dte_config.vfs_config.deleter(dte_config.vfs_config.fd, dte_config.vfs_config.resource);
+    close(master);
+}
+
+TEST_CASE("DTE and CMUX statistics", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+
+    int rssi, ber;
+    bool pin_ok;
+    CHECK(dce->get_signal_quality(rssi, ber) == command_result::OK);
+    CHECK(dce->get_signal_quality(rssi, ber) == command_result::OK);
+    CHECK(dce->set_pin("1234") == command_result::OK);
+    CHECK(dce->read_pin(pin_ok) == command_result::OK);
+    // echoed back, but never accepted
+    CHECK(dce->command("hello\n", [](uint8_t *data, size_t len) {
+        return command_result::TIMEOUT;
+    }, 10) == command_result::TIMEOUT);
+
+    auto stats = std::make_unique<modem_stats>();
+    dce->get_stats(*stats);
+    auto &s = stats->dte;
+    CHECK(s.commands == 5);
+    CHECK(s.timeouts == 1);
+    CHECK(s.command.bytes_out == strlen("AT+CSQ\r") * 2 + strlen("AT+CPIN=1234\r") + strlen("AT+CPIN?\r") + strlen("hello\n"));
+    CHECK(s.command.bytes_in >= strlen("+CSQ: 123,456\n\r\nOK\r\n") * 2);
+    CHECK(s.buffer_high_water >= strlen("+CSQ: 123,456\n\r\nOK\r\n"));
+    CHECK(s.data.bytes_out == 0);
+    size_t replied = 0;
+    for (auto count : s.latency.count) {
+        replied += count;
+    }
+    CHECK(replied == 4);
+
+    // commands are told apart by the text preceding the parameters
+    auto find = [&s](const char *name) -> const command_stats * {
+        for (size_t i = 0; i < s.command_count; ++i)
+        {
+            if (strcmp(s.per_command[i].name, name) == 0) {
+                return &s.per_command[i];
+            }
+        }
+        return nullptr;
+    };
+    CHECK(s.command_count == 3);
+    REQUIRE(find("AT+CSQ") != nullptr);
+    CHECK(find("AT+CSQ")->sent == 2);
+    REQUIRE(find("AT+CPIN") != nullptr);
+    CHECK(find("AT+CPIN")->sent == 2);
+    CHECK(find("AT+CPIN")->timeouts == 0);
+    REQUIRE(find("hello") != nullptr);
+    CHECK(find("hello")->timeouts == 1);
+    CHECK(stats->netif.packets_in == 0);
+
+    // payload bytes per DLCI and protocol recoveries are kept across CMUX sessions
+    CHECK(dce->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+    dce->get_stats(*stats);
+    auto dlci_out = s.cmux.dlci[2].bytes_out;
+    auto dlci_in = s.cmux.dlci[2].bytes_in;
+    auto commands = s.commands;
+    CHECK(dce->command("Test\n", [](uint8_t *data, size_t len) {
+        return command_result::OK;
+    }, 1000) == command_result::OK);
+    CHECK(dte->recover());
+    dce->get_stats(*stats);
+    CHECK(s.cmux.dlci[2].bytes_out - dlci_out == strlen("Test\n"));
+    CHECK(s.cmux.dlci[2].bytes_in - dlci_in == strlen("Test\n"));
+    CHECK(s.cmux.recoveries[static_cast<size_t>(CMux::protocol_mismatch_reason::UNKNOWN)] == 1);
+    CHECK(s.commands - commands == 1);
+    CHECK(dce->set_mode(esp_modem::modem_mode::COMMAND_MODE) == true);
+
+    // commands beyond the capacity are accounted together
+    dce->get_stats(*stats);
+    auto tracked = s.command_count;
+    for (int i = 0; i < 20; ++i) {
+        dte->command("AT+X" + std::to_string(i) + "\r", [](uint8_t *data, size_t len) {
+            return command_result::OK;
+        }, 1000);
+    }
+    dce->get_stats(*stats);
+    CHECK(s.command_count == static_cast<size_t>(dte_stats::max_commands));
+    CHECK(strcmp(s.per_command[dte_stats::max_commands - 1].name, "*") == 0);
+    CHECK(s.per_command[dte_stats::max_commands - 1].sent == 20 - (dte_stats::max_commands - 1 - tracked));
+}
+
+TEST_CASE("Data mode sink", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    struct sink_ctx {
+        std::string received;
+        SignalGroup signal;
+    } ctx;
+    dte->set_data_sink([](void *c, uint8_t *data, size_t len) {
+        auto *ctx = static_cast<sink_ctx *>(c);
+        ctx->received.append(reinterpret_cast<char *>(data), len);
+        ctx->signal.set(1);
+    }, &ctx);
+
+    const std::string payload = "~\x01\x02payload~";
+    CHECK(dte->write((uint8_t *)payload.data(), payload.size()) == static_cast<int>(payload.size()));
+    CHECK(ctx.signal.wait(1, 1000));
+    CHECK(ctx.received == payload);
+    dte_stats s{};
+    dte->get_stats(s);
+    CHECK(s.data.bytes_in == payload.size());
+
+    // removing the sink restores the command processing
+    dte->set_data_sink(nullptr, nullptr);
+    CHECK(dte->command("AT\r", [](uint8_t *data, size_t len) {
+        std::string response((char *) data, len);
+        return response.find("OK") != std::string::npos ? command_result::OK : command_result::TIMEOUT;
+    }, 1000) == command_result::OK);
+}
+
+TEST_CASE("PPP receive batches the chunks of a frame", "[esp_modem]")
+{
+    struct sink_ctx {
+        std::vector<std::string> passed;
+        std::vector<const uint8_t *> pointers;
+    } ctx;
+    ppp_rx_batch batch(64, [](void *c, uint8_t *data, size_t len) {
+        auto *ctx = static_cast<sink_ctx *>(c);
+        ctx->passed.emplace_back(reinterpret_cast<char *>(data), len);
+        ctx->pointers.push_back(data);
+    }, &ctx);
+    bool in_frame = false;
+    auto receive = [&batch, &in_frame](std::string chunk) {
+        auto ends = ppp_frames_ended((uint8_t *)chunk.data(), chunk.size(), in_frame) > 0;
+        batch.receive((uint8_t *)chunk.data(), chunk.size(), ends);
+    };
+
+    // chunks of one frame are passed at once, when the closing flag arrives
+    receive("~\xff\x03");
+    receive("abc");
+    CHECK(ctx.passed.empty());
+    receive("def~");
+    REQUIRE(ctx.passed.size() == 1);
+    CHECK(ctx.passed[0] == "~\xff\x03" "abcdef~");
+    CHECK(batch.size() == 0);
+
+    // a chunk completing frames is passed in place (the start of the next frame with it)
+    std::string frames = "~frame1~frame2~fra";
+    CHECK(ppp_frames_ended((uint8_t *)frames.data(), frames.size(), in_frame) == 2);
+    CHECK(in_frame);
+    batch.receive((uint8_t *)frames.data(), frames.size(), true);
+    REQUIRE(ctx.passed.size() == 2);
+    CHECK(ctx.passed[1] == frames);
+    CHECK(ctx.pointers[1] == (const uint8_t *)frames.data());
+
+    // the closing flag at the start of a chunk ends the frame of the previous chunks
+    receive("me3");
+    receive("~");
+    REQUIRE(ctx.passed.size() == 3);
+    CHECK(ctx.passed[2] == "me3~");
+
+    // an opening flag alone doesn't end a frame
+    receive("~");
+    receive("~ab");
+    CHECK(ctx.passed.size() == 3);
+    CHECK(batch.size() == 4);
+
+    // frames longer than the batch are passed in parts
+    receive(std::string(40, 'x'));
+    CHECK(ctx.passed.size() == 3);
+    receive(std::string(40, 'y'));
+    REQUIRE(ctx.passed.size() == 4);
+    CHECK(ctx.passed[3] == "~~ab" + std::string(40, 'x'));
+    receive(std::string(100, 'z'));
+    REQUIRE(ctx.passed.size() == 6);
+    CHECK(ctx.passed[4] == std::string(40, 'y'));
+    CHECK(ctx.passed[5] == std::string(100, 'z'));
+    receive("~");
+    REQUIRE(ctx.passed.size() == 7);
+    CHECK(ctx.passed[6] == "~");
+
+    size_t total = 0;
+    for (const auto &p : ctx.passed) {
+        total += p.size();
+    }
+    CHECK(total == 3 + 3 + 4 + frames.size() + 3 + 1 + 1 + 3 + 40 + 40 + 100 + 1);
+
+    // the unfinished frame of a stopped session is dropped
+    receive("~\xff\x03" "ab");
+    CHECK(batch.size() == 5);
+    batch.clear();
+    in_frame = false;
+    receive("~\xff\x03" "cd~");
+    REQUIRE(ctx.passed.size() == 8);
+    CHECK(ctx.passed[7] == "~\xff\x03" "cd~");
+}
+
+TEST_CASE("Linux terminals are served by one reactor thread", "[esp_modem]")
+{
+    auto thread_count = []() {
+        size_t count = 0;
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("Threads:", 0) == 0) {
+                count = std::stoul(line.substr(8));
+            }
+        }
+        return count;
+    };
+    struct modem {
+        int master;
+        std::shared_ptr<DTE> dte;
+        std::string received;
+        SignalGroup signal;
+    };
+    const size_t modems = 8;
+    auto threads_before = thread_count();
+    std::vector<std::unique_ptr<modem>> pool;
+    for (size_t i = 0; i < modems; ++i) {
+        auto m = std::make_unique<modem>();
+        m->master = posix_openpt(O_RDWR | O_NOCTTY);
+        REQUIRE(m->master >= 0);
+        REQUIRE(grantpt(m->master) == 0);
+        REQUIRE(unlockpt(m->master) == 0);
+        struct esp_modem_vfs_uart_creator uart_config = ESP_MODEM_VFS_DEFAULT_UART_CONFIG(ptsname(m->master));
+        esp_modem_dte_config_t dte_config = ESP_MODEM_DTE_DEFAULT_CONFIG();
+        REQUIRE(vfs_create_uart(&uart_config, &dte_config.vfs_config));
+        m->dte = create_vfs_dte(&dte_config);
+        REQUIRE(m->dte != nullptr);
+        auto *raw = m.get();
+        m->dte->set_read_cb([raw](uint8_t *data, size_t len) {
+            raw->received.append(reinterpret_cast<char *>(data), len);
+            raw->signal.set(1);
+            return true;
+        });
+        pool.push_back(std::move(m));
+    }
+    CHECK(thread_count() == threads_before + 1);
+
+    // payloads longer than the DTE buffer are read in several notifications
+    const std::string payload(2000, 'x');
+    for (auto &m : pool) {
+        CHECK(write(m->master, payload.data(), payload.size()) == static_cast<ssize_t>(payload.size()));
+    }
+    for (auto &m : pool) {
+        for (int i = 0; i < 100 && m->received.size() < payload.size(); ++i) {
+            m->signal.wait(1, 100);
+        }
+        CHECK(m->received == payload);
+    }
+
+    // data the DTE leaves unread (no command is waiting for it) isn't lost, but gets read after the next command,
+    // with URC handling enabled the DTE reads all data at once and passes it to the URC handler
+    {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        REQUIRE(master >= 0);
+        REQUIRE(grantpt(master) == 0);
+        REQUIRE(unlockpt(master) == 0);
+        struct esp_modem_vfs_uart_creator uart_config = ESP_MODEM_VFS_DEFAULT_UART_CONFIG(ptsname(master));
+        esp_modem_dte_config_t dte_config = ESP_MODEM_DTE_DEFAULT_CONFIG();
+        REQUIRE(vfs_create_uart(&uart_config, &dte_config.vfs_config));
+        auto dte = create_vfs_dte(&dte_config);
+        REQUIRE(dte != nullptr);
+#ifdef CONFIG_ESP_MODEM_URC_HANDLER
+        SignalGroup urc_signal;
+        std::atomic<int> urcs{0};
+        dte->set_urc_cb([&](uint8_t *data, size_t len) {
+            std::string_view urc(reinterpret_cast<char *>(data), len);
+            if (urc.find("+CREG:") == std::string_view::npos) {
+                return command_result::TIMEOUT;
+            }
+            ++urcs;
+            urc_signal.set(1);
+            return command_result::OK;
+        });
+        // the fd is served again after each URC read
+        for (int i = 1; i <= 2; ++i) {
+            const std::string urc = "\r\n+CREG: " + std::to_string(i) + "\r\n";
+            CHECK(write(master, urc.data(), urc.size()) == static_cast<ssize_t>(urc.size()));
+            CHECK(urc_signal.wait(1, 1000));
+            CHECK(urcs == i);
+        }
+#else
+        const std::string early_reply = "\r\nOK\r\n";
+        CHECK(write(master, early_reply.data(), early_reply.size()) == static_cast<ssize_t>(early_reply.size()));
+        usleep(100 * 1000);
+        auto ret = dte->command("AT\r", [](uint8_t *data, size_t len) {
+            std::string_view response(reinterpret_cast<char *>(data), len);
+            return response.find("OK") != std::string_view::npos ? command_result::OK : command_result::TIMEOUT;
+        }, 1000);
+        CHECK(ret == command_result::OK);
+#endif
+        dte.reset();
+        close(master);
+    }
+
+    // the reactor thread exits with the last terminal
+    for (auto &m : pool) {
+        m->dte.reset();
+        close(m->master);
+    }
+    CHECK(thread_count() == threads_before);
+}
+
+TEST_CASE("Modem pool dispatches to the least loaded healthy modem", "[esp_modem]")
+{
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    dce_factory::Factory factory(dce_factory::ModemType::SIM7600);
+    ModemPool::config pool_config;
+    pool_config.max_failures = 2;
+    ModemPool pool(pool_config);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(pool.add(factory, &dce_config, std::make_shared<DTE>(std::make_unique<LoopbackTerm>()), &netif) == static_cast<size_t>(i));
+    }
+    CHECK(pool.size() == 3);
+    CHECK(pool.check_health() == 3);
+    CHECK(pool.health(0).rssi == 123);
+
+    // concurrent jobs are spread over all modems
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    std::set<DCE *> used_modems;
+    Lock used_lock;
+    auto job = [&](DCE & dce) {
+        int now = ++running;
+        int max = max_running;
+        while (now > max && !max_running.compare_exchange_weak(max, now)) {
+        }
+        {
+            Scoped<Lock> l(used_lock);
+            used_modems.insert(&dce);
+        }
+        Task::Delay(200);
+        --running;
+        return command_result::OK;
+    };
+    std::vector<std::future<command_result>> results;
+    for (int i = 0; i < 3; ++i) {
+        results.push_back(std::async(std::launch::async, [&pool, &job] { return pool.run(job); }));
+    }
+    for (auto &r : results) {
+        CHECK(r.get() == command_result::OK);
+    }
+    CHECK(max_running == 3);
+    CHECK(used_modems.size() == 3);
+
+    // failing jobs are retried on another modem, the failing modem leaves the rotation
+    DCE *bad = &pool.at(1);
+    auto fails_on_bad = [bad](DCE & dce) {
+        return &dce == bad ? command_result::FAIL : command_result::OK;
+    };
+    size_t used = 0;
+    for (int i = 0; i < 6; ++i) {
+        CHECK(pool.run(fails_on_bad, &used) == command_result::OK);
+        CHECK(used != 1);
+    }
+    CHECK(pool.health(1).healthy == false);
+    CHECK(pool.health(1).failures == 2);
+    CHECK(pool.health(0).healthy == true);
+
+    // a health check brings it back, as the modem responds
+    CHECK(pool.check_health() == 3);
+    CHECK(pool.health(1).healthy == true);
+    CHECK(pool.health(1).failures == 0);
+
+    // nothing to run on when all modems fail
+    auto always_fails = [](DCE & dce) {
+        return command_result::FAIL;
+    };
+    for (int i = 0; i < 4; ++i) {
+        CHECK(pool.run(always_fails) == command_result::FAIL);
+    }
+    CHECK(pool.run(job) == command_result::FAIL);
+}
+
+TEST_CASE("Record and replay terminal traffic", "[esp_modem]")
+{
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    std::vector<uint8_t> trace;
+    {
+        auto term = std::make_unique<RecordingTerminal>(std::make_unique<LoopbackTerm>(), [&trace](const uint8_t *data, size_t len) {
+            trace.insert(trace.end(), data, data + len);
+        });
+        auto dte = std::make_shared<DTE>(std::move(term));
+        auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+        REQUIRE(dce != nullptr);
+        int rssi, ber;
+        CHECK(dce->get_signal_quality(rssi, ber) == command_result::OK);
+        CHECK(dce->set_pin("1234") == command_result::OK);
+    }
+
+    // the commands are followed by their replies
+    TraceReader reader(trace.data(), trace.size());
+    REQUIRE(reader.valid());
+    std::vector<std::pair<bool, std::string>> records;
+    trace_record record;
+    uint64_t last_us = 0;
+    while (reader.next(record)) {
+        CHECK(record.time_us >= last_us);
+        last_us = record.time_us;
+        records.emplace_back(record.sent, std::string((const char *)record.data, record.len));
+    }
+    REQUIRE(records.size() >= 4);
+    CHECK(records[0] == std::make_pair(true, std::string("AT+CSQ\r")));
+    CHECK(records[1].first == false);
+    CHECK(records[1].second.find("+CSQ: 123,456") != std::string::npos);
+    CHECK(records.back().first == false);
+
+    // replayed session gives the same results, even with the real modem gone
+    auto replay = std::make_unique<ReplayTerminal>(trace);
+    auto replay_term = replay.get();
+    auto dte = std::make_shared<DTE>(std::move(replay));
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+    replay_term->start();
+    int rssi = 0, ber = 0;
+    CHECK(dce->get_signal_quality(rssi, ber) == command_result::OK);
+    CHECK(rssi == 123);
+    CHECK(ber == 456);
+    CHECK(dce->set_pin("1234") == command_result::OK);
+    CHECK(replay_term->wait_for_end(1000));
+
+    // a replay stopped from its read callback starts again from the beginning
+    {
+        ReplayTerminal again(trace);
+        std::string received;
+        std::atomic<int> callbacks{0};
+        again.set_read_cb([&](uint8_t *data, size_t len) {
+            std::vector<uint8_t> buffer(len);
+            received.append(reinterpret_cast<char *>(buffer.data()), again.read(buffer.data(), len));
+            if (++callbacks == 1) {
+                again.stop();
+            }
+            return true;
+        });
+        again.start();
+        CHECK(again.write(reinterpret_cast<uint8_t *>(records[0].second.data()), records[0].second.size()) == static_cast<int>(records[0].second.size()));
+        for (int i = 0; i < 100 && callbacks == 0; ++i) {
+            usleep(10 * 1000);
+        }
+        REQUIRE(callbacks == 1);
+        again.start();
+        std::string replies;
+        for (auto &r : records) {
+            if (r.first) {
+                again.write(reinterpret_cast<uint8_t *>(r.second.data()), r.second.size());
+            } else {
+                replies += r.second;
+            }
+        }
+        CHECK(again.wait_for_end(1000));
+        CHECK(received == records[1].second + replies);
+
+        // a finished replay starts again, too
+        received.clear();
+        again.start();
+        for (auto &r : records) {
+            if (r.first) {
+                again.write(reinterpret_cast<uint8_t *>(r.second.data()), r.second.size());
+            }
+        }
+        CHECK(again.wait_for_end(1000));
+        CHECK(received == replies);
+    }
+
+    // the terminal could be destroyed right after stopping it from the read callback, or from the callback itself
+    for (bool from_callback : { false, true }) {
+        auto doomed = std::make_unique<ReplayTerminal>(trace);
+        std::atomic<bool> stopped{false};
+        doomed->set_read_cb([&](uint8_t *data, size_t len) {
+            if (from_callback) {
+                doomed.reset();
+            } else {
+                doomed->stop();
+            }
+            stopped = true;
+            return true;
+        });
+        doomed->start();
+        CHECK(doomed->write(reinterpret_cast<uint8_t *>(records[0].second.data()), records[0].second.size()) == static_cast<int>(records[0].second.size()));
+        for (int i = 0; i < 100 && !stopped; ++i) {
+            usleep(10 * 1000);
+        }
+        CHECK(stopped);
+        doomed.reset();
+    }
+
+    std::vector<uint8_t> broken = { 'E', 'M', 'T', 'X', 1 };
+    CHECK(TraceReader(broken.data(), broken.size()).valid() == false);
+}
+
+#ifdef CONFIG_ESP_MODEM_CMUX_DEFRAGMENT_PAYLOAD
+// without defragmenting, the payload is passed up before its FCS arrives
+TEST_CASE("CMUX frames with wrong FCS are dropped", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>();
+    auto loopback = term.get();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+    CHECK(dce->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+
+    // corrupted frame (FCS 0x28 instead of 0x29) followed by the correct one
+    uint8_t payload[] = {0xf9, 0x09, 0xff, 0x0b, 'B', 'a', 'd', '!', '\n', 0x28, 0xf9,
+                         0xf9, 0x09, 0xff, 0x0b, 'T', 'e', 's', 't', '\n', 0x29, 0xf9
+                        };
+    for (size_t inject_by : { sizeof(payload), static_cast<size_t>(1) }) {
+        dte_stats before{};
+        dte->get_stats(before);
+        loopback->inject(&payload[0], sizeof(payload), inject_by);
+        std::string received;
+        auto ret = dce->command("Test\n", [&](uint8_t *data, size_t len) {
+            received.append((char *) data, len);
+            return received.find("Test\n") != std::string::npos ? command_result::OK : command_result::TIMEOUT;
+        }, 1000);
+        CHECK(ret == command_result::OK);
+        CHECK(received == "Test\n");
+        dte_stats after{};
+        dte->get_stats(after);
+        auto wrong_crc = static_cast<size_t>(CMux::protocol_mismatch_reason::WRONG_CRC);
+        CHECK(after.cmux.recoveries[wrong_crc] - before.cmux.recoveries[wrong_crc] == 1);
+    }
+    loopback->inject(nullptr, 0, 0);
+}
+#endif
+
+TEST_CASE("CMUX frames are written at once", "[esp_modem]")
+{
+    std::vector<uint8_t> trace;
+    auto term = std::make_unique<RecordingTerminal>(std::make_unique<LoopbackTerm>(), [&trace](const uint8_t *data, size_t len) {
+        trace.insert(trace.end(), data, data + len);
+    });
+    auto dte = std::make_shared<DTE>(std::move(term));
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+    CHECK(dce->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+
+    // 300 bytes of payload don't fit into one frame (unless negotiated larger), but still go in one terminal write
+    std::string command(299, 'x');
+    command += '\n';
+    size_t trace_start = trace.size();
+    auto ret = dce->command(command, [&](uint8_t *data, size_t len) {
+        return len > 0 && data[len - 1] == '\n' ? command_result::OK : command_result::TIMEOUT;
+    }, 1000);
+    CHECK(ret == command_result::OK);
+
+    TraceReader reader(trace.data(), trace.size());
+    REQUIRE(reader.valid());
+    std::vector<std::vector<uint8_t>> writes;
+    trace_record record;
+    while (reader.next(record)) {
+        if (record.sent && record.data >= trace.data() + trace_start) {
+            writes.emplace_back(record.data, record.data + record.len);
+        }
+    }
+    REQUIRE(writes.size() == 1);
+    auto &frames = writes[0];
+    const size_t frame_size = CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE;
+    size_t frame_count = 0;
+    size_t payload = 0;
+    for (size_t i = 0; i + 6 <= frames.size(); frame_count++) {
+        CHECK(frames[i] == 0xf9);
+        size_t len = frames[i + 3] >> 1;
+        size_t header_len = 4;
+        if ((frames[i + 3] & 1) == 0) {
+            len += frames[i + 4] << 7;
+            header_len = 5;
+        }
+        payload += len;
+        i += header_len + len + 2;
+        CHECK(frames[i - 1] == 0xf9);
+    }
+    CHECK(payload == command.size());
+    CHECK(frame_count == (command.size() + frame_size - 1) / frame_size);
+
+    // the writer gets to know that its frames haven't been written
+    class FailingTerm : public LoopbackTerm {
+    public:
+        std::atomic<bool> fail{false};
+        int write(uint8_t *data, size_t len) override
+        {
+            return fail ? -1 : LoopbackTerm::write(data, len);
+        }
+    };
+    auto failing = std::make_shared<FailingTerm>();
+    auto cmux = std::make_shared<CMux>(failing, unique_buffer(256));
+    REQUIRE(cmux->init() == true);
+    uint8_t at[] = "AT\r";
+    failing->fail = true;
+    CHECK(cmux->write(0, at, sizeof(at) - 1) == 0);
+    failing->fail = false;
+    CHECK(cmux->write(0, at, sizeof(at) - 1) == sizeof(at) - 1);
+    CHECK(cmux->deinit() == true);
+}
+
+TEST_CASE("Flush queue reports data lost by another thread", "[esp_modem]")
+{
+    // the first batch is passed slowly, the second one fails
+    SignalGroup signal;
+    const uint32_t passing = 1, release = 2;
+    std::atomic<int> batches{0};
+    std::vector<uint8_t> passed;
+    flush_queue queue([&](uint8_t *data, size_t len) -> size_t {
+        if (batches++ == 0) {
+            signal.set(passing);
+            signal.wait(release, 1000);
+            passed.insert(passed.end(), data, data + len);
+            return len;
+        }
+        return 0;
+    });
+    const uint8_t first[] = "first", second[] = "second";
+    auto passer = std::async(std::launch::async, [&] {
+        queue.append(first, sizeof(first));
+        return queue.flush(0, queue.end());
+    });
+    REQUIRE(signal.wait(passing, 1000));
+    uint64_t from = queue.end();
+    queue.append(second, sizeof(second));
+    // taken (and lost) by the passing thread, which doesn't fail itself
+    CHECK(queue.flush(from, queue.end()) == true);
+    signal.set(release);
+    CHECK(passer.get() == true);
+    CHECK(batches == 2);
+    CHECK(passed.size() == sizeof(first));
+    // the loss is reported by the next flush, just once
+    CHECK(queue.flush() == false);
+    CHECK(queue.flush() == true);
+}
+
+#if CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE > 127
+TEST_CASE("CMUX negotiates large frames", "[esp_modem]")
+{
+    std::vector<uint8_t> trace;
+    auto term = std::make_unique<RecordingTerminal>(std::make_unique<LoopbackTerm>(), [&trace](const uint8_t *data, size_t len) {
+        trace.insert(trace.end(), data, data + len);
+    });
+    auto dte = std::make_shared<DTE>(std::move(term));
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+    CHECK(dce->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+
+    // the loopback accepts whatever we propose: a PN command for each virtual terminal
+    std::string command(std::min(CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE, 300) - 1, 'x');
+    command += '\n';
+    size_t trace_start = trace.size();
+    auto ret = dce->command(command, [&](uint8_t *data, size_t len) {
+        return len > 0 && data[len - 1] == '\n' ? command_result::OK : command_result::TIMEOUT;
+    }, 1000);
+    CHECK(ret == command_result::OK);
+
+    TraceReader reader(trace.data(), trace.size());
+    REQUIRE(reader.valid());
+    std::set<int> negotiated;
+    std::vector<uint8_t> frame;
+    trace_record record;
+    while (reader.next(record)) {
+        if (!record.sent) {
+            continue;
+        }
+        if (record.len == 16 && record.data[1] == 0x03 && record.data[4] == 0x83) { // PN on DLCI 0
+            negotiated.insert(record.data[6]);
+            CHECK((record.data[10] | record.data[11] << 8) == CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE);
+        }
+        if (record.data >= trace.data() + trace_start) {
+            frame.assign(record.data, record.data + record.len);
+        }
+    }
+    REQUIRE(negotiated.size() == CONFIG_ESP_MODEM_CMUX_TERMINALS);
+    CHECK(*negotiated.begin() == 1);
+    CHECK(*negotiated.rbegin() == CONFIG_ESP_MODEM_CMUX_TERMINALS);
+
+    // the whole command in one frame with 2 bytes length
+    REQUIRE(frame.size() == command.size() + 7);
+    CHECK(frame[0] == 0xf9);
+    CHECK(((frame[3] >> 1) | frame[4] << 7) == command.size());
+    CHECK((frame[3] & 1) == 0);
+    CHECK(frame.back() == 0xf9);
+}
+#endif
+
+
+#if CONFIG_ESP_MODEM_CMUX_TERMINALS > 2
+TEST_CASE("Additional CMUX virtual terminals", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+    CHECK(dte->create_cmux_terminal(2) == nullptr);     // not in CMUX mode
+    CHECK(dce->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+    CHECK(dte->create_cmux_terminal(1) == nullptr);     // used by the DTE
+    CHECK(dte->create_cmux_terminal(CONFIG_ESP_MODEM_CMUX_TERMINALS) == nullptr);
+
+    // a separate DTE on each additional virtual terminal, all of them talk at once
+    std::vector<std::shared_ptr<DTE>> channels;
+    for (size_t i = 2; i < CONFIG_ESP_MODEM_CMUX_TERMINALS; i++) {
+        auto channel_term = dte->create_cmux_terminal(i);
+        REQUIRE(channel_term != nullptr);
+        channels.push_back(std::make_shared<DTE>(std::move(channel_term)));
+    }
+    dte_stats before{};
+    dte->get_stats(before);
+    auto talk = [](DTE * channel, const std::string & text) {
+        std::string received;
+        auto ret = channel->command(text, [&](uint8_t *data, size_t len) {
+            received.append((char *) data, len);
+            return received.find(text) != std::string::npos ? command_result::OK : command_result::TIMEOUT;
+        }, 1000);
+        return ret == command_result::OK && received == text;
+    };
+    std::vector<std::future<bool>> results;
+    for (size_t i = 0; i < channels.size(); i++) {
+        results.push_back(std::async(std::launch::async, talk, channels[i].get(), "Channel " + std::to_string(i + 2) + "\n"));
+    }
+    results.push_back(std::async(std::launch::async, talk, dte.get(), std::string("Commands\n")));
+    for (auto &result : results) {
+        CHECK(result.get());
+    }
+    dte_stats after{};
+    dte->get_stats(after);
+    for (size_t dlci = 3; dlci <= CONFIG_ESP_MODEM_CMUX_TERMINALS; dlci++) {
+        CHECK(after.cmux.dlci[dlci].bytes_out - before.cmux.dlci[dlci].bytes_out == strlen("Channel 2\n"));
+        CHECK(after.cmux.dlci[dlci].bytes_in - before.cmux.dlci[dlci].bytes_in == strlen("Channel 2\n"));
+    }
+
+    // the additional terminals stop working with the CMUX mode
+    CHECK(dce->set_mode(esp_modem::modem_mode::COMMAND_MODE) == true);
+    CHECK(channels[0]->command("Channel 2\n", [&](uint8_t *data, size_t len) {
+        return command_result::OK;
+    }, 100) != command_result::OK);
+}
+#endif
+
+TEST_CASE("CMUX flow control", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>();
+    auto dte = std::make_shared<DTE>(std::move(term));
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG("APN");
+    esp_netif_t netif{};
+    auto dce = create_SIM7600_dce(&dce_config, dte, &netif);
+    REQUIRE(dce != nullptr);
+    CHECK(dte->set_rx_flow(false) == false);    // not in CMUX mode
+    CHECK(dce->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+
+    // the loopback returns our FCoff, as if the modem stopped accepting frames
+    CHECK(dte->set_rx_flow(false) == true);
+    dte_stats before{};
+    dte->get_stats(before);
+    auto result = std::async(std::launch::async, [&]() {
+        std::string received;
+        return dce->command("Test\n", [&](uint8_t *data, size_t len) {
+            received.append((char *) data, len);
+            return received.find("Test\n") != std::string::npos ? command_result::OK : command_result::TIMEOUT;
+        }, 2000);
+    });
+    CHECK(result.wait_for(std::chrono::milliseconds(200)) == std::future_status::timeout);
+    dte_stats stopped{};
+    dte->get_stats(stopped);
+    CHECK(stopped.cmux.dlci[2].bytes_out == before.cmux.dlci[2].bytes_out);
+
+    // the write waiting for the flow goes on after FCon
+    CHECK(dte->set_rx_flow(true) == true);
+    CHECK(result.get() == command_result::OK);
+    dte_stats after{};
+    dte->get_stats(after);
+    CHECK(after.cmux.dlci[2].bytes_out - before.cmux.dlci[2].bytes_out == strlen("Test\n"));
+}
+
+TEST_CASE("CMUX handshakes take just the round trips", "[esp_modem]")
+{
+    auto term = std::make_unique<LoopbackTerm>();
+    auto dte = std::make_shared<DTE>(std::move(term));
+
+    // the loopback answers at once, so entering and leaving should take no time
+    // (used to be 10ms per DLCI and direction at least)
+    auto start = std::chrono::steady_clock::now();
+    CHECK(dte->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+    CHECK(dte->set_mode(esp_modem::modem_mode::COMMAND_MODE) == true);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(elapsed < std::chrono::milliseconds(50));
+
+    // and it still works afterwards
+    CHECK(dte->set_mode(esp_modem::modem_mode::CMUX_MODE) == true);
+    std::string received;
+    CHECK(dte->command("Test\n", [&](uint8_t *data, size_t len) {
+        received.append((char *) data, len);
+        return received.find("Test\n") != std::string::npos ? command_result::OK : command_result::TIMEOUT;
+    }, 1000) == command_result::OK);
+    CHECK(dte->set_mode(esp_modem::modem_mode::COMMAND_MODE) == true);
+}
+
+/**
+ * Loopback terminal, which doesn't answer the CMUX frames selected by the filter (as if the device ignored them)
+ */
+class IgnoringTerm : public LoopbackTerm {
+public:
+    explicit IgnoringTerm(std::function<bool(const uint8_t *frame, size_t len)> ignore): ignore(std::move(ignore)) {}
+
+    int write(uint8_t *data, size_t len) override
+    {
+        std::vector<uint8_t> answered;
+        size_t pos = 0;
+        while (pos + 6 <= len && data[pos] == 0xf9) {
+            size_t header_len = (data[pos + 3] & 1) ? 4 : 5;
+            size_t frame_len = header_len + (data[pos + 3] >> 1) + (header_len == 5 ? data[pos + 4] << 7 : 0) + 2;
+            if (pos + frame_len > len) {
+                break;
+            }
+            if (!ignore(data + pos, frame_len)) {
+                answered.insert(answered.end(), data + pos, data + pos + frame_len);
+            }
+            pos += frame_len;
+        }
+        if (pos == 0) {
+            return LoopbackTerm::write(data, len);      // no CMUX frames
+        }
+        if (!answered.empty()) {
+            LoopbackTerm::write(answered.data(), answered.size());
+        }
+        return len;
+    }
+
+private:
+    std::function<bool(const uint8_t *frame, size_t len)> ignore;
+};
+
+TEST_CASE("CMUX handshakes need all DLCIs to acknowledge", "[esp_modem]")
+{
+    // the device doesn't acknowledge SABM (then DISC) of the second virtual terminal
+    const uint8_t sabm = 0x3f;
+    const uint8_t disc = 0x53;
+    std::atomic<uint8_t> ignored{sabm};
+    auto term = std::make_shared<IgnoringTerm>([&ignored](const uint8_t *frame, size_t len) {
+        return (frame[1] >> 2) == 2 && frame[2] == ignored;
+    });
+    auto cmux = std::make_shared<CMux>(term, unique_buffer(256));
+    CHECK(cmux->init() == false);
+    ignored = disc;
+    CHECK(cmux->init() == true);
+    CHECK(cmux->deinit() == false);
+    ignored = 0;
+    CHECK(cmux->deinit() == true);
+}
+
+#if CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE > 127
+TEST_CASE("CMUX keeps the default frame size of DLCIs not answering PN", "[esp_modem]")
+{
+    // the device doesn't answer the PN of the second virtual terminal, records the payload sizes per DLCI
+    Lock sizes_lock;
+    std::map<int, std::vector<size_t>> sizes;
+    auto term = std::make_shared<IgnoringTerm>([&](const uint8_t *frame, size_t len) {
+        int dlci = frame[1] >> 2;
+        if (dlci == 0) {
+            return frame[4] == 0x83 && frame[6] == 2;   // PN for DLCI 2
+        }
+        if (frame[2] == 0xef) {
+            Scoped<Lock> l(sizes_lock);
+            sizes[dlci].push_back(len - ((frame[3] & 1) ? 6 : 7));
+        }
+        return false;
+    });
+    auto cmux = std::make_shared<CMux>(term, unique_buffer(256));
+    REQUIRE(cmux->init() == true);
+
+    std::vector<uint8_t> payload(300, 'x');
+    CHECK(cmux->write(0, payload.data(), payload.size()) == static_cast<int>(payload.size()));
+    CHECK(cmux->write(1, payload.data(), payload.size()) == static_cast<int>(payload.size()));
+    CHECK(cmux->deinit() == true);
+    {
+        Scoped<Lock> l(sizes_lock);
+        CHECK(sizes[1] == std::vector<size_t>({300}));
+        CHECK(sizes[2] == std::vector<size_t>({127, 127, 46}));
+    }
+}
+#endif
+
+#if defined(CONFIG_ESP_MODEM_CMUX_DEFRAGMENT_PAYLOAD) || CONFIG_ESP_MODEM_CMUX_DISPATCH_QUEUE_SIZE > 0
+/**
+ * Appends a UIH frame with the payload as sent by the device
+ */
+static void add_frame(std::vector<uint8_t> &frames, uint8_t dlci, const std::string &payload)
+{
+    uint8_t header[5] = { 0xf9, static_cast<uint8_t>((dlci << 2) | 1), 0xef, 0, 0 };
+    size_t header_len = payload.size() < 128 ? 4 : 5;
+    header[3] = (payload.size() & 0x7f) << 1 | (header_len == 4 ? 1 : 0);
+    header[4] = payload.size() >> 7;
+    uint8_t crc = 0xFF;
+    for (size_t i = 1; i < header_len; i++) {
+        crc ^= header[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x01) ? (crc >> 1) ^ 0xe0 : crc >> 1;
+        }
+    }
+    frames.insert(frames.end(), header, header + header_len);
+    frames.insert(frames.end(), payload.begin(), payload.end());
+    frames.push_back(0xFF - crc);
+    frames.push_back(0xf9);
+}
+#endif
+
+#ifdef CONFIG_ESP_MODEM_CMUX_DEFRAGMENT_PAYLOAD
+TEST_CASE("CMUX payloads are reassembled per frame", "[esp_modem]")
+{
+    auto term = std::make_shared<LoopbackTerm>();
+    auto loopback = term.get();
+    // small Rx buffer, so that the frames span several reads even if injected at once
+    auto cmux = std::make_shared<CMux>(term, unique_buffer(256));
+    REQUIRE(cmux->init() == true);
+    Lock received_lock;
+    std::vector<std::string> received[2];
+    for (int i = 0; i < 2; i++) {
+        cmux->set_read_cb(i, [&, i](uint8_t *data, size_t len) {
+            Scoped<Lock> l(received_lock);
+            received[i].emplace_back((char *)data, len);
+            return true;
+        });
+    }
+    // the longest legal frames on both terminals, followed by a short one
+    const std::string first(CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE, 'a');
+    const std::string second(CONFIG_ESP_MODEM_CMUX_MAX_FRAME_SIZE, 'b');
+    std::vector<uint8_t> frames;
+    add_frame(frames, 1, first);
+    add_frame(frames, 2, second);
+    add_frame(frames, 1, "OK\r\n");
+    cmux_stats before{};
+    cmux->get_stats(before);
+    for (size_t inject_by : { frames.size(), static_cast<size_t>(100), static_cast<size_t>(7) }) {
+        for (auto &r : received) {
+            Scoped<Lock> l(received_lock);
+            r.clear();
+        }
+        loopback->inject(frames.data(), frames.size(), inject_by, 0, 0);
+        uint8_t trigger[] = "AT\r";
+        cmux->write(0, trigger, sizeof(trigger) - 1);
+        for (int i = 0; i < 200; i++) {
+            {
+                Scoped<Lock> l(received_lock);
+                if (received[0].size() + received[1].size() >= 3) {
+                    break;
+                }
+            }
+            usleep(10'000);
+        }
+        Scoped<Lock> l(received_lock);
+        // every payload passed up whole and just once
+        REQUIRE(received[0].size() == 2);
+        REQUIRE(received[1].size() == 1);
+        CHECK(received[0][0] == first);
+        CHECK(received[0][1] == "OK\r\n");
+        CHECK(received[1][0] == second);
+    }
+    cmux_stats after{};
+    cmux->get_stats(after);
+    for (size_t reason = 0; reason < cmux_stats::recovery_reasons; reason++) {
+        CHECK(after.recoveries[reason] == before.recoveries[reason]);
+    }
+    loopback->inject(nullptr, 0, 0);
+    CHECK(cmux->deinit() == true);
+}
+#endif
+
+#if CONFIG_ESP_MODEM_CMUX_DISPATCH_QUEUE_SIZE > 0
+TEST_CASE("CMUX payloads are dispatched per terminal", "[esp_modem]")
+{
+    auto term = std::make_shared<LoopbackTerm>();
+    auto loopback = term.get();
+    auto cmux = std::make_shared<CMux>(term, unique_buffer(256));
+    REQUIRE(cmux->init() == true);
+    // the command terminal's reader is stuck (e.g. parsing a long reply) until released
+    std::atomic<bool> released{false};
+    std::atomic<int> commands{0};
+    std::atomic<int> packets{0};
+    cmux->set_read_cb(0, [&](uint8_t *data, size_t len) {
+        while (!released) {
+            usleep(1'000);
+        }
+        commands++;
+        return true;
+    });
+    cmux->set_read_cb(1, [&](uint8_t *data, size_t len) {
+        packets++;
+        return true;
+    });
+    auto wait_for = [](const std::function<bool()> &condition) {
+        for (int i = 0; i < 200 && !condition(); i++) {
+            usleep(10'000);
+        }
+        return condition();
+    };
+    uint8_t trigger[] = "AT\r";
+
+    // the data terminal doesn't wait for the command terminal
+    std::vector<uint8_t> frames;
+    add_frame(frames, 1, "+CMGL: 1,\"REC UNREAD\"\r\n");
+    for (int i = 0; i < 3; i++) {
+        add_frame(frames, 2, std::string(200, 'p'));
+    }
+    loopback->inject(frames.data(), frames.size(), frames.size(), 0, 0);
+    cmux->write(1, trigger, sizeof(trigger) - 1);
+    CHECK(wait_for([&] { return packets == 3; }));
+    CHECK(commands == 0);
+    released = true;
+    CHECK(wait_for([&] { return commands == 1; }));
+
+    // payloads of a stuck terminal beyond its queue get dropped (and counted)
+    released = false;
+    const int sent = CONFIG_ESP_MODEM_CMUX_DISPATCH_QUEUE_SIZE + 3;
+    frames.clear();
+    for (int i = 0; i < sent; i++) {
+        add_frame(frames, 1, "OK\r\n");
+    }
+    cmux_stats before{};
+    cmux->get_stats(before);
+    loopback->inject(frames.data(), frames.size(), frames.size(), 0, 0);
+    cmux->write(1, trigger, sizeof(trigger) - 1);
+    CHECK(wait_for([&] {
+        cmux_stats s{};
+        cmux->get_stats(s);
+        return s.dropped[1] - before.dropped[1] >= 2;
+    }));
+    released = true;
+    cmux_stats after{};
+    CHECK(wait_for([&] {
+        cmux->get_stats(after);
+        return commands - 1 + static_cast<int>(after.dropped[1] - before.dropped[1]) == sent;
+    }));
+    CHECK(after.dropped[1] - before.dropped[1] <= 3);   // one is being read, the queue is full
+    loopback->inject(nullptr, 0, 0);
+    CHECK(cmux->deinit() == true);
+}
+#endif
+
 #define CATCH_CONFIG_RUNNER
 extern "C" int app_main(void)
 {
@@ -0,0 +1,144 @@
+#include "fleet_mqtt.h"
+#include <string.h>
+
+static size_t encode_remaining_length(uint8_t *out, size_t len)
+{
+    size_t pos = 0;
+    do
+    {
+        uint8_t byte = len % 128;
+        len /= 128;
+        if (len > 0)
+        {
+            byte |= 0x80;
+        }
+        out[pos++] = byte;
+    } while (len > 0);
+    return pos;
+}
+
+static size_t remaining_length_size(size_t len)
+{
+    return len < 128 ? 1 : len < 16384 ? 2 : len < 2097152 ? 3 : 4;
+}
+
+static uint8_t *put_string(uint8_t *p, const char *str, size_t len)
+{
+    *p++ = len >> 8;
+    *p++ = len & 0xFF;
+    memcpy(p, str, len);
+    return p + len;
+}
+
+size_t fleet_mqtt_connect(uint8_t *out, size_t out_len, const char *client_id, uint16_t keepalive_s)
+{
+    size_t id_len = strlen(client_id);
+    size_t remaining = 10 + 2 + id_len; // variable header + client id
+    size_t total = 1 + remaining_length_size(remaining) + remaining;
+    if (total > out_len)
+    {
+        return 0;
+    }
+    uint8_t *p = out;
+    *p++ = FLEET_MQTT_CONNECT;
+    p += encode_remaining_length(p, remaining);
+    p = put_string(p, "MQTT", 4);
+    *p++ = 4;    // protocol level 3.1.1
+    *p++ = 0x02; // clean session
+    *p++ = keepalive_s >> 8;
+    *p++ = keepalive_s & 0xFF;
+    p = put_string(p, client_id, id_len);
+    return p - out;
+}
+
+size_t fleet_mqtt_publish(uint8_t *out, size_t out_len, const char *topic,
+                          const void *payload, size_t payload_len, int qos, uint16_t packet_id)
+{
+    size_t topic_len = strlen(topic);
+    size_t remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + payload_len;
+    size_t total = 1 + remaining_length_size(remaining) + remaining;
+    if (total > out_len)
+    {
+        return 0;
+    }
+    uint8_t *p = out;
+    *p++ = FLEET_MQTT_PUBLISH | (qos > 0 ? 0x02 : 0x00);
+    p += encode_remaining_length(p, remaining);
+    p = put_string(p, topic, topic_len);
+    if (qos > 0)
+    {
+        *p++ = packet_id >> 8;
+        *p++ = packet_id & 0xFF;
+    }
+    memcpy(p, payload, payload_len);
+    return p + payload_len - out;
+}
+
+size_t fleet_mqtt_subscribe(uint8_t *out, size_t out_len, const char *topic, int qos, uint16_t packet_id)
+{
+    size_t topic_len = strlen(topic);
+    size_t remaining = 2 + 2 + topic_len + 1;
+    size_t total = 1 + remaining_length_size(remaining) + remaining;
+    if (total > out_len)
+    {
+        return 0;
+    }
+    uint8_t *p = out;
+    *p++ = FLEET_MQTT_SUBSCRIBE | 0x02; // reserved flags must be 0b0010
+    p += encode_remaining_length(p, remaining);
+    *p++ = packet_id >> 8;
+    *p++ = packet_id & 0xFF;
+    p = put_string(p, topic, topic_len);
+    *p++ = (uint8_t)qos;
+    return p - out;
+}
+
+size_t fleet_mqtt_simple(uint8_t *out, size_t out_len, uint8_t type)
+{
+    if (out_len < 2)
+    {
+        return 0;
+    }
+    out[0] = type;
+    out[1] = 0;
+    return 2;
+}
+
+int fleet_mqtt_parse(const uint8_t *in, size_t in_len, fleet_mqtt_packet_t *packet)
+{
+    if (in_len < 2)
+    {
+        return 0;
+    }
+    size_t remaining = 0;
+    size_t multiplier = 1;
+    size_t pos = 1;
+    for (;;)
+    {
+        if (pos >= in_len)
+        {
+            return 0;
+        }
+        if (pos > 4)
+        {
+            return -1;
+        }
+        uint8_t byte = in[pos++];
+        remaining += (byte & 0x7F) * multiplier;
+        multiplier *= 128;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    if (pos + remaining > in_len)
+    {
+        return 0;
+    }
+    packet->type = in[0] & 0xF0;
+    packet->flags = in[0] & 0x0F;
+    packet->body = in + pos;
+    packet->body_len = remaining;
+    packet->total_len = pos + remaining;
+    return 1;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file fleet_mqtt.h
+ * @brief Minimal MQTT 3.1.1 packet codec used by the fleet simulator
+ *
+ * Only the packets a cold-storage device exchanges with the broker are
+ * supported: CONNECT/CONNACK, PUBLISH/PUBACK (QoS 0 and 1),
+ * SUBSCRIBE, PINGREQ/PINGRESP and DISCONNECT. Encoding never allocates.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLEET_MQTT_CONNECT 0x10
+#define FLEET_MQTT_CONNACK 0x20
+#define FLEET_MQTT_PUBLISH 0x30
+#define FLEET_MQTT_PUBACK 0x40
+#define FLEET_MQTT_SUBSCRIBE 0x80
+#define FLEET_MQTT_SUBACK 0x90
+#define FLEET_MQTT_PINGREQ 0xC0
+#define FLEET_MQTT_PINGRESP 0xD0
+#define FLEET_MQTT_DISCONNECT 0xE0
+
+/**
+ * @brief A decoded packet header, pointing into the receive buffer.
+ */
+typedef struct
+{
+    uint8_t type;           // Packet type (upper nibble of the fixed header)
+    uint8_t flags;          // Fixed header flags (lower nibble)
+    const uint8_t *body;    // Variable header + payload
+    size_t body_len;        // Length of body
+    size_t total_len;       // Fixed header + body (bytes to consume)
+} fleet_mqtt_packet_t;
+
+/**
+ * @brief Encode a CONNECT packet with clean session and no credentials.
+ *
+ * @return size_t Encoded length, 0 if the buffer is too small.
+ */
+size_t fleet_mqtt_connect(uint8_t *out, size_t out_len, const char *client_id, uint16_t keepalive_s);
+
+/**
+ * @brief Encode a PUBLISH packet; packet_id is ignored for QoS 0.
+ *
+ * @return size_t Encoded length, 0 if the buffer is too small.
+ */
+size_t fleet_mqtt_publish(uint8_t *out, size_t out_len, const char *topic,
+                          const void *payload, size_t payload_len, int qos, uint16_t packet_id);
+
+/**
+ * @brief Encode a SUBSCRIBE packet for a single topic filter.
+ *
+ * @return size_t Encoded length, 0 if the buffer is too small.
+ */
+size_t fleet_mqtt_subscribe(uint8_t *out, size_t out_len, const char *topic, int qos, uint16_t packet_id);
+
+/**
+ * @brief Encode a two byte packet without variable header (PINGREQ, DISCONNECT).
+ *
+ * @return size_t Encoded length (always 2), 0 if the buffer is too small.
+ */
+size_t fleet_mqtt_simple(uint8_t *out, size_t out_len, uint8_t type);
+
+/**
+ * @brief Decode one packet from the start of the buffer.
+ *
+ * @return int 1 if a complete packet was decoded, 0 if more data is needed, -1 on malformed input.
+ */
+int fleet_mqtt_parse(const uint8_t *in, size_t in_len, fleet_mqtt_packet_t *packet);
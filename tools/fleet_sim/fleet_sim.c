@@ -0,0 +1,904 @@
+/**
+ * @file fleet_sim.c
+ * @brief Linux load generator simulating a fleet of cold-storage devices
+ *
+ * Every virtual device uses the firmware's own topic scheme and payload
+ * encoding (main/telemetry.c) and follows the main loop timing of main.c:
+ * periodic readings every mqtt_send_interval_ms and, while a threshold is
+ * exceeded, one publish per sensor read (SENSOR_READ_INTERVAL_MS).
+ * All devices are driven from a single epoll loop.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "app_config.h"
+#include "telemetry.h"
+#include "fleet_mqtt.h"
+
+#define FLEET_DEFAULT_SEND_INTERVAL_MS 60000 // Mirrors mqtt_send_interval_ms in app_config.c
+#define FLEET_KEEPALIVE_S 120                // esp-mqtt default keepalive
+#define FLEET_INFLIGHT 32                    // Outstanding QoS1 publishes tracked per device
+#define FLEET_RX_MAX 256
+#define FLEET_TX_MAX 512
+#define FLEET_HIST_BUCKETS (64 * 16)
+#define FLEET_MAX_EVENTS 1024
+#define FLEET_RETRY_MIN_MS 100               // First retry after a failed connection attempt
+#define FLEET_RETRY_MAX_MS 10000             // esp-mqtt default reconnect_timeout_ms
+
+typedef enum
+{
+    DEVICE_IDLE,
+    DEVICE_CONNECTING,
+    DEVICE_WAIT_CONNACK,
+    DEVICE_ONLINE,
+} device_state_t;
+
+typedef enum
+{
+    TRANSPORT_WIFI, // network.c: readings JSON on every publish
+    TRANSPORT_GSM,  // gsm_module.c: subscribe + hello on connect, alert text while above threshold
+} transport_t;
+
+typedef struct
+{
+    int fd;
+    device_state_t state;
+    uint8_t mac[6];
+    bool in_storm;
+    uint16_t next_packet_id;
+    uint16_t failures; // consecutive failed connection attempts
+    uint16_t rx_len;
+    uint16_t tx_len;
+    uint64_t connect_start_us;
+    uint64_t retry_us; // earliest next connection attempt while idle
+    uint64_t next_sample_us;
+    uint64_t next_sensor_us;
+    uint64_t alert_until_us;
+    uint64_t last_tx_us;
+    uint64_t inflight_us[FLEET_INFLIGHT]; // send time indexed by packet_id % FLEET_INFLIGHT, 0 = free
+    char topic[TELEMETRY_TOPIC_MAX];
+    uint8_t rx[FLEET_RX_MAX];
+    uint8_t tx[FLEET_TX_MAX];
+} fleet_device_t;
+
+/**
+ * @brief Log-linear latency histogram (16 sub-buckets per power of two, ~6% precision)
+ */
+typedef struct
+{
+    uint64_t buckets[FLEET_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t max;
+} fleet_hist_t;
+
+typedef struct
+{
+    uint64_t published;
+    uint64_t acked;
+    uint64_t backlogged;
+    uint64_t lost_acks;
+    uint64_t connects;
+    uint64_t connect_failures;
+    uint64_t disconnects;
+    uint64_t tx_bytes;
+} fleet_counters_t;
+
+typedef struct
+{
+    const char *host;
+    const char *port;
+    const char *pub_suffix;
+    const char *sub_suffix;
+    unsigned devices;
+    unsigned duration_s;
+    unsigned interval_ms;
+    unsigned sensor_ms;
+    unsigned connect_rate;
+    int qos;
+    transport_t transport;
+    double alert_fraction;
+    unsigned alert_period_s;
+    unsigned alert_duration_s;
+    double storm_fraction;
+    unsigned storm_period_s;
+    unsigned seed;
+} fleet_options_t;
+
+static volatile sig_atomic_t s_stop = 0;
+static fleet_counters_t s_total;
+static uint32_t s_online;         // devices in DEVICE_ONLINE
+static uint32_t s_inflight;       // QoS1 publishes waiting for their PUBACK
+static uint32_t s_in_storm;       // devices dropped by the last storm and not back online yet
+static uint64_t s_connect_tokens; // connection attempts taken from the --connect-rate budget
+static fleet_hist_t s_latency;
+static fleet_hist_t s_connect_latency;
+static struct addrinfo *s_broker;
+static int s_epoll = -1;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static size_t rss_bytes(void)
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void hist_record(fleet_hist_t *h, uint64_t value)
+{
+    size_t idx;
+    if (value < 16)
+    {
+        idx = value;
+    }
+    else
+    {
+        int msb = 63 - __builtin_clzll(value);
+        idx = (size_t)(msb - 3) * 16 + ((value >> (msb - 4)) & 15);
+    }
+    h->buckets[idx]++;
+    h->count++;
+    if (value > h->max)
+    {
+        h->max = value;
+    }
+}
+
+static uint64_t hist_percentile(const fleet_hist_t *h, double p)
+{
+    if (h->count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p * (double)h->count);
+    uint64_t seen = 0;
+    for (size_t idx = 0; idx < FLEET_HIST_BUCKETS; idx++)
+    {
+        seen += h->buckets[idx];
+        if (seen > rank)
+        {
+            if (idx < 16)
+            {
+                return idx;
+            }
+            int msb = (int)(idx / 16) + 3;
+            return (uint64_t)(16 + idx % 16) << (msb - 4);
+        }
+    }
+    return h->max;
+}
+
+static double rand_unit(void)
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void device_readings(const fleet_device_t *dev, uint64_t now, sensor_readings_t *readings)
+{
+    bool alert = dev->alert_until_us > now;
+    // Cold room readings, pushed above the default thresholds (app_config.c) while alerting
+    readings->dht_temp = (float)(alert ? 31.0 + rand_unit() * 4.0 : 2.0 + rand_unit() * 4.0);
+    readings->dht_humidity = (float)(alert ? 81.0 + rand_unit() * 10.0 : 60.0 + rand_unit() * 10.0);
+    readings->ds_temp = (float)(2.0 + rand_unit() * 4.0);
+}
+
+/**
+ * @brief Delays the next connection attempt after a failed one (exponential backoff with jitter)
+ */
+static void device_backoff(fleet_device_t *dev, uint64_t now)
+{
+    uint64_t delay_ms = FLEET_RETRY_MAX_MS;
+    if (dev->failures < 8 && ((uint64_t)FLEET_RETRY_MIN_MS << dev->failures) < FLEET_RETRY_MAX_MS)
+    {
+        delay_ms = (uint64_t)FLEET_RETRY_MIN_MS << dev->failures;
+    }
+    dev->failures++;
+    dev->retry_us = now + (uint64_t)((0.5 + rand_unit() * 0.5) * (double)delay_ms * 1000.0);
+}
+
+static void device_close(fleet_device_t *dev)
+{
+    if (dev->fd >= 0)
+    {
+        epoll_ctl(s_epoll, EPOLL_CTL_DEL, dev->fd, NULL);
+        close(dev->fd);
+        dev->fd = -1;
+    }
+    for (size_t i = 0; i < FLEET_INFLIGHT; i++)
+    {
+        if (dev->inflight_us[i])
+        {
+            s_total.lost_acks++;
+            s_inflight--;
+            dev->inflight_us[i] = 0;
+        }
+    }
+    if (dev->state == DEVICE_ONLINE)
+    {
+        // dropped connection, reconnect right away (subject to --connect-rate)
+        s_online--;
+        dev->retry_us = 0;
+    }
+    else if (dev->state != DEVICE_IDLE)
+    {
+        device_backoff(dev, now_us()); // refused or failed before CONNACK
+    }
+    dev->state = DEVICE_IDLE;
+    dev->rx_len = 0;
+    dev->tx_len = 0;
+}
+
+static void device_update_events(fleet_device_t *dev, uint32_t index)
+{
+    struct epoll_event ev = {
+        .events = EPOLLIN | (dev->tx_len || dev->state == DEVICE_CONNECTING ? EPOLLOUT : 0),
+        .data.u32 = index,
+    };
+    epoll_ctl(s_epoll, EPOLL_CTL_MOD, dev->fd, &ev);
+}
+
+static bool device_flush(fleet_device_t *dev, uint32_t index)
+{
+    if (dev->tx_len == 0)
+    {
+        return true;
+    }
+    ssize_t sent = send(dev->fd, dev->tx, dev->tx_len, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            device_update_events(dev, index);
+            return true;
+        }
+        return false;
+    }
+    s_total.tx_bytes += (uint64_t)sent;
+    memmove(dev->tx, dev->tx + sent, dev->tx_len - (size_t)sent);
+    dev->tx_len -= (uint16_t)sent;
+    device_update_events(dev, index);
+    return true;
+}
+
+static bool device_queue(fleet_device_t *dev, uint32_t index, const uint8_t *data, size_t len, uint64_t now)
+{
+    if (dev->tx_len + len > FLEET_TX_MAX)
+    {
+        return false;
+    }
+    memcpy(dev->tx + dev->tx_len, data, len);
+    dev->tx_len += (uint16_t)len;
+    dev->last_tx_us = now;
+    return device_flush(dev, index);
+}
+
+static void device_connect(fleet_device_t *dev, uint32_t index, uint64_t now)
+{
+    dev->fd = socket(s_broker->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (dev->fd < 0)
+    {
+        s_total.connect_failures++;
+        device_backoff(dev, now);
+        return;
+    }
+    int one = 1;
+    setsockopt(dev->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(dev->fd, s_broker->ai_addr, s_broker->ai_addrlen) < 0 && errno != EINPROGRESS)
+    {
+        s_total.connect_failures++;
+        close(dev->fd);
+        dev->fd = -1;
+        device_backoff(dev, now);
+        return;
+    }
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.u32 = index};
+    epoll_ctl(s_epoll, EPOLL_CTL_ADD, dev->fd, &ev);
+    dev->state = DEVICE_CONNECTING;
+    dev->connect_start_us = now;
+}
+
+static void device_publish(fleet_device_t *dev, uint32_t index, const fleet_options_t *opt,
+                           const char *payload, size_t payload_len, uint64_t now)
+{
+    uint8_t packet[FLEET_TX_MAX];
+    uint16_t packet_id = 0;
+    if (opt->qos > 0)
+    {
+        packet_id = dev->next_packet_id++;
+        if (dev->next_packet_id == 0)
+        {
+            dev->next_packet_id = 2;
+        }
+        if (dev->inflight_us[packet_id % FLEET_INFLIGHT])
+        {
+            s_total.backlogged++; // esp-mqtt would keep this one in its outbox
+            return;
+        }
+    }
+    size_t len = fleet_mqtt_publish(packet, sizeof(packet), dev->topic, payload, payload_len, opt->qos, packet_id);
+    if (len == 0 || !device_queue(dev, index, packet, len, now))
+    {
+        s_total.backlogged++;
+        return;
+    }
+    if (opt->qos > 0)
+    {
+        dev->inflight_us[packet_id % FLEET_INFLIGHT] = now;
+        s_inflight++;
+    }
+    s_total.published++;
+}
+
+static void device_publish_readings(fleet_device_t *dev, uint32_t index, const fleet_options_t *opt, uint64_t now)
+{
+    sensor_readings_t readings;
+    char payload[TELEMETRY_PAYLOAD_MAX];
+    device_readings(dev, now, &readings);
+    int len = telemetry_format_payload(payload, sizeof(payload), &readings);
+    device_publish(dev, index, opt, payload, (size_t)len, now);
+}
+
+static void device_publish_alert(fleet_device_t *dev, uint32_t index, const fleet_options_t *opt, uint64_t now)
+{
+    sensor_readings_t readings;
+    char msg[TELEMETRY_ALERT_MAX];
+    device_readings(dev, now, &readings);
+    int len = telemetry_format_alert(msg, sizeof(msg), &readings);
+    device_publish(dev, index, opt, msg, (size_t)len, now);
+}
+
+static void device_online(fleet_device_t *dev, uint32_t index, const fleet_options_t *opt, uint64_t now)
+{
+    dev->state = DEVICE_ONLINE;
+    dev->failures = 0;
+    if (dev->in_storm)
+    {
+        dev->in_storm = false;
+        s_in_storm--;
+    }
+    s_online++;
+    s_total.connects++;
+    hist_record(&s_connect_latency, now - dev->connect_start_us);
+    // random phase, so the fleet doesn't publish in lock step
+    dev->next_sample_us = now + (uint64_t)(rand_unit() * opt->interval_ms * 1000.0);
+    dev->next_sensor_us = now + (uint64_t)(rand_unit() * opt->sensor_ms * 1000.0);
+    if (opt->transport == TRANSPORT_GSM)
+    {
+        // Mirrors MQTT_EVENT_CONNECTED in gsm_module.c: subscribe and publish a hello message
+        char sub_topic[TELEMETRY_TOPIC_MAX];
+        uint8_t packet[FLEET_TX_MAX];
+        telemetry_format_topic(sub_topic, sizeof(sub_topic), dev->mac, opt->sub_suffix);
+        // packet id 1 is never handed out to publishes
+        device_queue(dev, index, packet, fleet_mqtt_subscribe(packet, sizeof(packet), sub_topic, 0, 1), now);
+        static const char hello[] = "Hello from SIM7670C via PPPoS";
+        device_publish(dev, index, opt, hello, sizeof(hello) - 1, now);
+    }
+}
+
+static bool device_handle_packet(fleet_device_t *dev, uint32_t index, const fleet_options_t *opt,
+                                 const fleet_mqtt_packet_t *packet, uint64_t now)
+{
+    switch (packet->type)
+    {
+    case FLEET_MQTT_CONNACK:
+        if (dev->state != DEVICE_WAIT_CONNACK || packet->body_len < 2 || packet->body[1] != 0)
+        {
+            s_total.connect_failures++;
+            return false;
+        }
+        device_online(dev, index, opt, now);
+        return true;
+    case FLEET_MQTT_PUBACK:
+    {
+        if (packet->body_len < 2)
+        {
+            return false;
+        }
+        uint16_t packet_id = (uint16_t)(packet->body[0] << 8 | packet->body[1]);
+        uint64_t sent = dev->inflight_us[packet_id % FLEET_INFLIGHT];
+        if (sent)
+        {
+            hist_record(&s_latency, now - sent);
+            dev->inflight_us[packet_id % FLEET_INFLIGHT] = 0;
+            s_inflight--;
+            s_total.acked++;
+        }
+        return true;
+    }
+    default:
+        return true; // SUBACK, PINGRESP and command publishes are not part of the measurement
+    }
+}
+
+static void device_on_event(fleet_device_t *dev, uint32_t index, const fleet_options_t *opt, uint32_t events, uint64_t now)
+{
+    if (dev->state == DEVICE_CONNECTING && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+    {
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        getsockopt(dev->fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+        if (err != 0)
+        {
+            s_total.connect_failures++;
+            device_close(dev);
+            return;
+        }
+        char client_id[24];
+        uint8_t packet[64];
+        // esp-mqtt default client id: ESP32_ + last three bytes of the MAC
+        snprintf(client_id, sizeof(client_id), "ESP32_%02X%02X%02X", dev->mac[3], dev->mac[4], dev->mac[5]);
+        size_t len = fleet_mqtt_connect(packet, sizeof(packet), client_id, FLEET_KEEPALIVE_S);
+        dev->state = DEVICE_WAIT_CONNACK;
+        if (!device_queue(dev, index, packet, len, now))
+        {
+            device_close(dev);
+            return;
+        }
+        device_update_events(dev, index);
+        return;
+    }
+    if (events & EPOLLOUT)
+    {
+        if (!device_flush(dev, index))
+        {
+            s_total.disconnects++;
+            device_close(dev);
+            return;
+        }
+    }
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+    {
+        ssize_t got = recv(dev->fd, dev->rx + dev->rx_len, FLEET_RX_MAX - dev->rx_len, 0);
+        if (got <= 0)
+        {
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return;
+            }
+            s_total.disconnects++;
+            device_close(dev);
+            return;
+        }
+        dev->rx_len += (uint16_t)got;
+        size_t offset = 0;
+        fleet_mqtt_packet_t packet;
+        int ret;
+        while ((ret = fleet_mqtt_parse(dev->rx + offset, dev->rx_len - offset, &packet)) == 1)
+        {
+            if (!device_handle_packet(dev, index, opt, &packet, now))
+            {
+                device_close(dev);
+                return;
+            }
+            offset += packet.total_len;
+        }
+        if (ret < 0 || (offset == 0 && dev->rx_len == FLEET_RX_MAX))
+        {
+            s_total.disconnects++; // malformed or oversized packet
+            device_close(dev);
+            return;
+        }
+        memmove(dev->rx, dev->rx + offset, dev->rx_len - offset);
+        dev->rx_len -= (uint16_t)offset;
+    }
+}
+
+static void device_tick(fleet_device_t *dev, uint32_t index, const fleet_options_t *opt, uint64_t now)
+{
+    if (dev->state != DEVICE_ONLINE)
+    {
+        return;
+    }
+    if (now >= dev->next_sample_us)
+    {
+        device_publish_readings(dev, index, opt, now);
+        dev->next_sample_us += (uint64_t)opt->interval_ms * 1000;
+    }
+    if (now >= dev->next_sensor_us)
+    {
+        dev->next_sensor_us += (uint64_t)opt->sensor_ms * 1000;
+        if (dev->alert_until_us > now)
+        {
+            // main.c publishes on every sensor read while a threshold is exceeded
+            if (opt->transport == TRANSPORT_GSM)
+            {
+                device_publish_alert(dev, index, opt, now);
+            }
+            else
+            {
+                device_publish_readings(dev, index, opt, now);
+            }
+        }
+    }
+    if (now - dev->last_tx_us > (uint64_t)FLEET_KEEPALIVE_S * 500000)
+    {
+        uint8_t ping[2];
+        device_queue(dev, index, ping, fleet_mqtt_simple(ping, sizeof(ping), FLEET_MQTT_PINGREQ), now);
+    }
+}
+
+/**
+ * @brief Takes one connection attempt (first connect or reconnect) from the --connect-rate budget,
+ * the unused budget accumulates for at most one second
+ */
+static bool connect_allowed(const fleet_options_t *opt, uint64_t elapsed_us)
+{
+    if (opt->connect_rate == 0)
+    {
+        return true;
+    }
+    uint64_t budget = elapsed_us * opt->connect_rate / 1000000ULL + 1;
+    if (budget > s_connect_tokens + opt->connect_rate)
+    {
+        s_connect_tokens = budget - opt->connect_rate;
+    }
+    if (s_connect_tokens >= budget)
+    {
+        return false;
+    }
+    s_connect_tokens++;
+    return true;
+}
+
+static void print_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -H, --host HOST            broker host (default 127.0.0.1)\n"
+            "  -p, --port PORT            broker port (default 1883)\n"
+            "  -n, --devices N            number of simulated devices (default 1000)\n"
+            "  -d, --duration S           test duration in seconds (default 60)\n"
+            "  -i, --interval MS          periodic publish interval (default %d, mqtt_send_interval_ms)\n"
+            "  -s, --sensor MS            sensor read interval (default %d, SENSOR_READ_INTERVAL_MS)\n"
+            "  -q, --qos Q                publish QoS 0 or 1 (default 1)\n"
+            "  -t, --transport wifi|gsm   traffic shape of network.c or gsm_module.c (default wifi)\n"
+            "  -r, --connect-rate N       new connections per second, 0 = all at once (default 0)\n"
+            "      --alert-fraction F     fraction of devices entering an alert burst (default 0.05)\n"
+            "      --alert-period S       seconds between alert bursts, 0 = none (default 20)\n"
+            "      --alert-duration S     seconds a device stays above threshold (default 10)\n"
+            "      --storm-fraction F     fraction of devices dropped in a reconnect storm (default 1.0)\n"
+            "      --storm-period S       seconds between reconnect storms, 0 = none (default 0)\n"
+            "      --pub-topic SUFFIX     publish topic suffix (default " TELEMETRY_DEFAULT_PUB_TOPIC ")\n"
+            "      --sub-topic SUFFIX     subscribe topic suffix (default " TELEMETRY_DEFAULT_SUB_TOPIC ")\n"
+            "      --seed N               random seed (default 1)\n",
+            name, FLEET_DEFAULT_SEND_INTERVAL_MS, SENSOR_READ_INTERVAL_MS);
+}
+
+static int parse_options(int argc, char **argv, fleet_options_t *opt)
+{
+    enum
+    {
+        OPT_ALERT_FRACTION = 256,
+        OPT_ALERT_PERIOD,
+        OPT_ALERT_DURATION,
+        OPT_STORM_FRACTION,
+        OPT_STORM_PERIOD,
+        OPT_PUB_TOPIC,
+        OPT_SUB_TOPIC,
+        OPT_SEED,
+    };
+    static const struct option long_options[] = {
+        {"host", required_argument, NULL, 'H'},
+        {"port", required_argument, NULL, 'p'},
+        {"devices", required_argument, NULL, 'n'},
+        {"duration", required_argument, NULL, 'd'},
+        {"interval", required_argument, NULL, 'i'},
+        {"sensor", required_argument, NULL, 's'},
+        {"qos", required_argument, NULL, 'q'},
+        {"transport", required_argument, NULL, 't'},
+        {"connect-rate", required_argument, NULL, 'r'},
+        {"alert-fraction", required_argument, NULL, OPT_ALERT_FRACTION},
+        {"alert-period", required_argument, NULL, OPT_ALERT_PERIOD},
+        {"alert-duration", required_argument, NULL, OPT_ALERT_DURATION},
+        {"storm-fraction", required_argument, NULL, OPT_STORM_FRACTION},
+        {"storm-period", required_argument, NULL, OPT_STORM_PERIOD},
+        {"pub-topic", required_argument, NULL, OPT_PUB_TOPIC},
+        {"sub-topic", required_argument, NULL, OPT_SUB_TOPIC},
+        {"seed", required_argument, NULL, OPT_SEED},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    *opt = (fleet_options_t){
+        .host = "127.0.0.1",
+        .port = "1883",
+        .pub_suffix = TELEMETRY_DEFAULT_PUB_TOPIC,
+        .sub_suffix = TELEMETRY_DEFAULT_SUB_TOPIC,
+        .devices = 1000,
+        .duration_s = 60,
+        .interval_ms = FLEET_DEFAULT_SEND_INTERVAL_MS,
+        .sensor_ms = SENSOR_READ_INTERVAL_MS,
+        .qos = 1,
+        .transport = TRANSPORT_WIFI,
+        .alert_fraction = 0.05,
+        .alert_period_s = 20,
+        .alert_duration_s = 10,
+        .storm_fraction = 1.0,
+        .seed = 1,
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "H:p:n:d:i:s:q:t:r:h", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'H': opt->host = optarg; break;
+        case 'p': opt->port = optarg; break;
+        case 'n': opt->devices = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'd': opt->duration_s = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'i': opt->interval_ms = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 's': opt->sensor_ms = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'q': opt->qos = atoi(optarg) > 0 ? 1 : 0; break;
+        case 'r': opt->connect_rate = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 't':
+            if (strcmp(optarg, "gsm") == 0)
+            {
+                opt->transport = TRANSPORT_GSM;
+            }
+            else if (strcmp(optarg, "wifi") == 0)
+            {
+                opt->transport = TRANSPORT_WIFI;
+            }
+            else
+            {
+                return -1;
+            }
+            break;
+        case OPT_ALERT_FRACTION: opt->alert_fraction = atof(optarg); break;
+        case OPT_ALERT_PERIOD: opt->alert_period_s = (unsigned)strtoul(optarg, NULL, 0); break;
+        case OPT_ALERT_DURATION: opt->alert_duration_s = (unsigned)strtoul(optarg, NULL, 0); break;
+        case OPT_STORM_FRACTION: opt->storm_fraction = atof(optarg); break;
+        case OPT_STORM_PERIOD: opt->storm_period_s = (unsigned)strtoul(optarg, NULL, 0); break;
+        case OPT_PUB_TOPIC: opt->pub_suffix = optarg; break;
+        case OPT_SUB_TOPIC: opt->sub_suffix = optarg; break;
+        case OPT_SEED: opt->seed = (unsigned)strtoul(optarg, NULL, 0); break;
+        default:
+            return -1;
+        }
+    }
+    if (opt->devices == 0 || opt->devices > 0xFFFFFF || opt->interval_ms == 0 || opt->sensor_ms == 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    s_stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+    fleet_options_t opt;
+    if (parse_options(argc, argv, &opt) != 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    srand(opt.seed);
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    int err = getaddrinfo(opt.host, opt.port, &hints, &s_broker);
+    if (err != 0)
+    {
+        fprintf(stderr, "Cannot resolve %s:%s: %s\n", opt.host, opt.port, gai_strerror(err));
+        return 1;
+    }
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < opt.devices + 64)
+    {
+        limit.rlim_cur = limit.rlim_max < opt.devices + 64 ? limit.rlim_max : opt.devices + 64;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < opt.devices + 64)
+        {
+            fprintf(stderr, "Warning: file descriptor limit %lu is too low for %u devices\n",
+                    (unsigned long)limit.rlim_cur, opt.devices);
+        }
+    }
+    s_epoll = epoll_create1(0);
+    if (s_epoll < 0)
+    {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    size_t rss_before = rss_bytes();
+    fleet_device_t *devices = calloc(opt.devices, sizeof(fleet_device_t));
+    if (devices == NULL)
+    {
+        fprintf(stderr, "Cannot allocate %u devices\n", opt.devices);
+        return 1;
+    }
+    for (uint32_t i = 0; i < opt.devices; i++)
+    {
+        fleet_device_t *dev = &devices[i];
+        dev->fd = -1;
+        dev->next_packet_id = 2; // 1 is reserved for the GSM subscription
+        // Espressif OUI followed by the device index
+        const uint8_t mac[6] = {0x24, 0x0A, 0xC4, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        memcpy(dev->mac, mac, sizeof(mac));
+        telemetry_format_topic(dev->topic, sizeof(dev->topic), dev->mac, opt.pub_suffix);
+    }
+
+    printf("Simulating %u devices (%s, QoS%d) against %s:%s for %us, topic %s ...\n",
+           opt.devices, opt.transport == TRANSPORT_GSM ? "gsm" : "wifi", opt.qos,
+           opt.host, opt.port, opt.duration_s, devices[0].topic);
+
+    struct epoll_event events[FLEET_MAX_EVENTS];
+    const uint64_t start = now_us();
+    const uint64_t end = start + (uint64_t)opt.duration_s * 1000000ULL;
+    uint64_t next_report = start + 1000000;
+    uint64_t next_alert = opt.alert_period_s ? start + (uint64_t)opt.alert_period_s * 1000000ULL : UINT64_MAX;
+    uint64_t next_storm = opt.storm_period_s ? start + (uint64_t)opt.storm_period_s * 1000000ULL : UINT64_MAX;
+    uint64_t storm_start = 0;
+    uint32_t storm_pending = 0;
+    uint32_t started = 0;
+    size_t rss_online = 0;
+    fleet_counters_t last = s_total;
+    uint64_t now = start;
+
+    while (!s_stop && now < end)
+    {
+        // Ramp up new connections
+        while (started < opt.devices && connect_allowed(&opt, now - start))
+        {
+            device_connect(&devices[started], started, now);
+            started++;
+        }
+
+        int n = epoll_wait(s_epoll, events, FLEET_MAX_EVENTS, 5);
+        now = now_us();
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t index = events[i].data.u32;
+            device_on_event(&devices[index], index, &opt, events[i].events, now);
+        }
+
+        for (uint32_t i = 0; i < started; i++)
+        {
+            fleet_device_t *dev = &devices[i];
+            if (dev->state == DEVICE_IDLE)
+            {
+                // reconnect like esp-mqtt's auto reconnect, at the connect rate and with backoff
+                if (now >= dev->retry_us && connect_allowed(&opt, now - start))
+                {
+                    device_connect(dev, i, now);
+                }
+                continue;
+            }
+            device_tick(dev, i, &opt, now);
+        }
+        if (rss_online == 0 && s_online == opt.devices)
+        {
+            rss_online = rss_bytes();
+        }
+
+        if (now >= next_alert)
+        {
+            uint32_t alerted = 0;
+            for (uint32_t i = 0; i < started; i++)
+            {
+                if (rand_unit() < opt.alert_fraction)
+                {
+                    devices[i].alert_until_us = now + (uint64_t)opt.alert_duration_s * 1000000ULL;
+                    devices[i].next_sensor_us = now;
+                    alerted++;
+                }
+            }
+            printf("  alert burst: %u devices above threshold for %us\n", alerted, opt.alert_duration_s);
+            next_alert += (uint64_t)opt.alert_period_s * 1000000ULL;
+        }
+
+        if (now >= next_storm)
+        {
+            storm_pending = 0;
+            for (uint32_t i = 0; i < started; i++)
+            {
+                if (devices[i].state == DEVICE_ONLINE && rand_unit() < opt.storm_fraction)
+                {
+                    device_close(&devices[i]);
+                    if (!devices[i].in_storm)
+                    {
+                        devices[i].in_storm = true;
+                        s_in_storm++;
+                    }
+                    s_total.disconnects++;
+                    storm_pending++;
+                }
+            }
+            storm_start = now;
+            printf("  reconnect storm: dropped %u connections\n", storm_pending);
+            next_storm += (uint64_t)opt.storm_period_s * 1000000ULL;
+        }
+        if (storm_pending && s_in_storm == 0)
+        {
+            printf("  reconnect storm: %u devices back online in %.1f ms\n",
+                   storm_pending, (double)(now - storm_start) / 1000.0);
+            storm_pending = 0;
+        }
+
+        if (now >= next_report)
+        {
+            printf("t=%4.0fs online=%u pub/s=%llu ack/s=%llu inflight=%u backlog=%llu ack p50=%.2fms p99=%.2fms\n",
+                   (double)(now - start) / 1e6, s_online,
+                   (unsigned long long)(s_total.published - last.published),
+                   (unsigned long long)(s_total.acked - last.acked), s_inflight,
+                   (unsigned long long)s_total.backlogged,
+                   (double)hist_percentile(&s_latency, 0.50) / 1000.0,
+                   (double)hist_percentile(&s_latency, 0.99) / 1000.0);
+            fflush(stdout);
+            last = s_total;
+            next_report += 1000000;
+        }
+    }
+
+    double elapsed = (double)(now - start) / 1e6;
+    size_t rss_after = rss_online ? rss_online : rss_bytes();
+    printf("\n=== Summary (%.1fs, %u devices) ===\n", elapsed, opt.devices);
+    printf("publishes:       %llu (%.1f msg/s), %.1f KiB/s out\n",
+           (unsigned long long)s_total.published, (double)s_total.published / elapsed,
+           (double)s_total.tx_bytes / 1024.0 / elapsed);
+    printf("pubacks:         %llu (%.1f msg/s), lost %llu, backlogged %llu\n",
+           (unsigned long long)s_total.acked, (double)s_total.acked / elapsed,
+           (unsigned long long)s_total.lost_acks, (unsigned long long)s_total.backlogged);
+    printf("puback latency:  p50=%.2fms p90=%.2fms p99=%.2fms p99.9=%.2fms max=%.2fms\n",
+           (double)hist_percentile(&s_latency, 0.50) / 1000.0,
+           (double)hist_percentile(&s_latency, 0.90) / 1000.0,
+           (double)hist_percentile(&s_latency, 0.99) / 1000.0,
+           (double)hist_percentile(&s_latency, 0.999) / 1000.0,
+           (double)s_latency.max / 1000.0);
+    printf("connects:        %llu ok, %llu failed, %llu disconnects, connack p50=%.2fms p99=%.2fms\n",
+           (unsigned long long)s_total.connects, (unsigned long long)s_total.connect_failures,
+           (unsigned long long)s_total.disconnects,
+           (double)hist_percentile(&s_connect_latency, 0.50) / 1000.0,
+           (double)hist_percentile(&s_connect_latency, 0.99) / 1000.0);
+    printf("memory/device:   %zu bytes state, %.0f bytes RSS%s\n", sizeof(fleet_device_t),
+           (double)(rss_after > rss_before ? rss_after - rss_before : 0) / opt.devices,
+           rss_online ? "" : " (not all devices came online)");
+
+    for (uint32_t i = 0; i < started; i++)
+    {
+        if (devices[i].state == DEVICE_ONLINE)
+        {
+            uint8_t packet[2];
+            send(devices[i].fd, packet, fleet_mqtt_simple(packet, sizeof(packet), FLEET_MQTT_DISCONNECT), MSG_NOSIGNAL);
+        }
+        device_close(&devices[i]);
+    }
+    free(devices);
+    freeaddrinfo(s_broker);
+    close(s_epoll);
+    return 0;
+}